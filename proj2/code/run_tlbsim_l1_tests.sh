@@ -11,7 +11,7 @@ mkdir -p reports
 
 make -j
 
-for input in inputs/*; do
+for input in inputs/*.txt; do
     input_file=$(basename "$input" .txt)
 
     expected_output_file=outputs/$EXPECTED_OUTPUTS_TARGET_DIR/$input_file.out
@@ -11,7 +11,110 @@ mkdir -p reports
 
 make -j
 
-for input in inputs/*; do
+# A run restored from a checkpoint taken halfway must end like the full run.
+checkpoint_input=inputs/single_page_eviction_to_disk.txt
+report_file=reports/checkpoint_restore.diff
+
+echo "Running checkpoint test for $checkpoint_input -> $report_file"
+./build/tlbsim --log none $checkpoint_input > reports/checkpoint_full.out 2> /dev/null
+./build/tlbsim --log none --checkpoint reports/checkpoint.bin --checkpoint-at 32768 $checkpoint_input > /dev/null 2>&1
+./build/tlbsim --log none --restore reports/checkpoint.bin $checkpoint_input > reports/checkpoint_restore.out 2> /dev/null
+
+echo "#####################################################################" > $report_file
+echo "# Input: $checkpoint_input (checkpoint after 32768 references)" >> $report_file
+echo "# Left side: expected (reports/checkpoint_full.out)" >> $report_file
+echo "# Right side: actual (reports/checkpoint_restore.out)" >> $report_file
+echo "#####################################################################" >> $report_file
+
+if diff -y --expand-tabs reports/checkpoint_full.out reports/checkpoint_restore.out >> $report_file; then
+    echo "# Test checkpoint_restore passed" >> $report_file
+else
+    echo "# Test checkpoint_restore failed" >> $report_file
+fi
+
+# The binary version of an input must replay like the text one.
+convert_input=inputs/random_100.txt
+report_file=reports/convert_round_trip.diff
+
+echo "Running conversion test for $convert_input -> $report_file"
+./build/tlbsim $convert_input > reports/convert_text.out 2> /dev/null
+./build/tlbsim --convert reports/random_100.bin $convert_input > /dev/null 2>&1
+./build/tlbsim reports/random_100.bin > reports/convert_round_trip.out 2> /dev/null
+
+echo "#####################################################################" > $report_file
+echo "# Input: reports/random_100.bin (converted from $convert_input)" >> $report_file
+echo "# Left side: expected (reports/convert_text.out)" >> $report_file
+echo "# Right side: actual (reports/convert_round_trip.out)" >> $report_file
+echo "#####################################################################" >> $report_file
+
+if diff -y --expand-tabs reports/convert_text.out reports/convert_round_trip.out >> $report_file; then
+    echo "# Test convert_round_trip passed" >> $report_file
+else
+    echo "# Test convert_round_trip failed" >> $report_file
+fi
+
+# Sampled runs fast-forward the binary version of a kernel through its seek
+# index, and must replay like the kernel.
+sample_input=kernel:mm1,n=64
+sample_options="--sample-period 16384 --sample-unit 512 --sample-warmup 512 --sample-warming 2048"
+report_file=reports/sampled_convert_round_trip.diff
+
+echo "Running sampled conversion test for $sample_input -> $report_file"
+./build/tlbsim --log none $sample_options $sample_input > reports/sampled_kernel.out 2> /dev/null
+./build/tlbsim --convert reports/mm1_64.bin $sample_input > /dev/null 2>&1
+./build/tlbsim --log none $sample_options reports/mm1_64.bin > reports/sampled_convert_round_trip.out 2> /dev/null
+
+echo "#####################################################################" > $report_file
+echo "# Input: reports/mm1_64.bin (converted from $sample_input, $sample_options)" >> $report_file
+echo "# Left side: expected (reports/sampled_kernel.out)" >> $report_file
+echo "# Right side: actual (reports/sampled_convert_round_trip.out)" >> $report_file
+echo "#####################################################################" >> $report_file
+
+if diff -y --expand-tabs reports/sampled_kernel.out reports/sampled_convert_round_trip.out >> $report_file; then
+    echo "# Test sampled_convert_round_trip passed" >> $report_file
+else
+    echo "# Test sampled_convert_round_trip failed" >> $report_file
+fi
+
+# Inputs run with options: "<name> <input> <options>", expected in
+# outputs/$EXPECTED_OUTPUTS_TARGET_DIR/<name>.out. Inputs that only make sense
+# with options live in inputs/options.
+option_cases=(
+    "l1_entries_16 inputs/working_set_32_pages.txt --l1-entries 16"
+    "page_replacement_fifo inputs/single_page_eviction_to_disk.txt --page-replacement fifo"
+    "page_replacement_clock inputs/single_page_eviction_to_disk.txt --page-replacement clock"
+    "page_replacement_aging inputs/single_page_eviction_to_disk.txt --page-replacement aging"
+    "page_replacement_wsclock inputs/single_page_eviction_to_disk.txt --page-replacement wsclock"
+    "multi_core_shootdowns inputs/options/multi_core_shootdowns.txt --cores 2 --huge-pages always"
+    "multi_core_shootdown_latency inputs/options/multi_core_shootdowns.txt --cores 2 --huge-pages always --shootdown-latency 2000 --shootdown-handler 100"
+    "sampled_mm1 kernel:mm1,n=64 --sample-period 16384 --sample-unit 512 --sample-warmup 512 --sample-warming 2048"
+    "parallel_shootdowns inputs/options/multi_core_shootdowns.txt --cores 2 --huge-pages always --threads 2"
+    "dcache_evictions inputs/options/dcache_evictions.txt --huge-pages always --dcache-l1-size 4K --dcache-l1-ways 4 --dcache-l2-size 256K --dcache-l2-ways 8"
+)
+
+for option_case in "${option_cases[@]}"; do
+    read -r case_name input options <<< "$option_case"
+
+    expected_output_file=outputs/$EXPECTED_OUTPUTS_TARGET_DIR/$case_name.out
+    report_file=reports/$case_name.diff
+
+    echo "Running test for $case_name -> $report_file"
+    ./build/tlbsim --log none $options $input > reports/$case_name.out 2> /dev/null
+
+    echo "#####################################################################" > $report_file
+    echo "# Input: $input ($options)" >> $report_file
+    echo "# Left side: expected ($expected_output_file)" >> $report_file
+    echo "# Right side: actual (reports/$case_name.out)" >> $report_file
+    echo "#####################################################################" >> $report_file
+
+    if diff -y --expand-tabs $expected_output_file reports/$case_name.out >> $report_file; then
+        echo "# Test $case_name passed" >> $report_file
+    else
+        echo "# Test $case_name failed" >> $report_file
+    fi
+done
+
+for input in inputs/*.txt; do
     input_file=$(basename "$input" .txt)
 
     expected_output_file=outputs/$EXPECTED_OUTPUTS_TARGET_DIR/$input_file.out
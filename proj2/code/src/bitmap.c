@@ -0,0 +1,91 @@
+#include "bitmap.h"
+
+#include <stdlib.h>
+
+#include "log.h"
+
+void bitmap_init(bitmap_t* bitmap, uint64_t n_bits) {
+  uint64_t n_words = (n_bits + 63) / 64;
+
+  free(bitmap->words);
+  free(bitmap->summary);
+  bitmap->n_bits = n_bits;
+  bitmap->n_summary_words = (n_words + 63) / 64;
+  bitmap->words = calloc(n_words ? n_words : 1, sizeof(uint64_t));
+  bitmap->summary =
+      calloc(bitmap->n_summary_words ? bitmap->n_summary_words : 1,
+             sizeof(uint64_t));
+  bitmap->hint = bitmap->n_summary_words;
+
+  if (!bitmap->words || !bitmap->summary) {
+    panic("Failed to allocate bitmap of %" PRIu64 " bits", n_bits);
+  }
+}
+
+void bitmap_free(bitmap_t* bitmap) {
+  free(bitmap->words);
+  free(bitmap->summary);
+  bitmap->words = NULL;
+  bitmap->summary = NULL;
+  bitmap->n_bits = 0;
+  bitmap->n_summary_words = 0;
+  bitmap->hint = 0;
+}
+
+void bitmap_checkpoint(bitmap_t* bitmap, checkpoint_t* checkpoint) {
+  checkpoint_data(checkpoint, bitmap->words,
+                  (bitmap->n_bits + 63) / 64 * sizeof(uint64_t));
+  checkpoint_data(checkpoint, bitmap->summary,
+                  bitmap->n_summary_words * sizeof(uint64_t));
+  CHECKPOINT_VALUE(checkpoint, bitmap->hint);
+}
+
+void bitmap_set(bitmap_t* bitmap, uint64_t bit) {
+  uint64_t word = bit / 64;
+  uint64_t summary_word = word / 64;
+  bitmap->words[word] |= 1llu << (bit % 64);
+  bitmap->summary[summary_word] |= 1llu << (word % 64);
+  if (summary_word < bitmap->hint) {
+    bitmap->hint = summary_word;
+  }
+}
+
+void bitmap_clear(bitmap_t* bitmap, uint64_t bit) {
+  uint64_t word = bit / 64;
+  bitmap->words[word] &= ~(1llu << (bit % 64));
+  if (!bitmap->words[word]) {
+    bitmap->summary[word / 64] &= ~(1llu << (word % 64));
+  }
+}
+
+bool bitmap_test(const bitmap_t* bitmap, uint64_t bit) {
+  return (bitmap->words[bit / 64] >> (bit % 64)) & 1;
+}
+
+uint64_t bitmap_find_first(bitmap_t* bitmap) {
+  for (; bitmap->hint < bitmap->n_summary_words; bitmap->hint++) {
+    uint64_t summary = bitmap->summary[bitmap->hint];
+    if (summary) {
+      uint64_t word = bitmap->hint * 64 + __builtin_ctzll(summary);
+      return word * 64 + __builtin_ctzll(bitmap->words[word]);
+    }
+  }
+  return bitmap->n_bits;
+}
+
+uint64_t bitmap_find_block(const bitmap_t* bitmap, uint64_t block_bits) {
+  uint64_t block_words = block_bits / 64;
+  uint64_t n_words = bitmap->n_bits / 64;
+
+  for (uint64_t first = 0; first + block_words <= n_words;
+       first += block_words) {
+    uint64_t word = first;
+    while (word < first + block_words && bitmap->words[word] == ~0llu) {
+      word++;
+    }
+    if (word == first + block_words) {
+      return first * 64;
+    }
+  }
+  return bitmap->n_bits;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "checkpoint.h"
+
+// Two-level bitmap with a fast lowest-set-bit search.
+// Each bit of `summary` tells whether the corresponding word of `words` has a
+// set bit, so finding the lowest set bit only needs a couple of find-first-set
+// operations, starting from `hint`.
+typedef struct {
+  uint64_t* words;
+  uint64_t* summary;
+  uint64_t n_bits;
+  uint64_t n_summary_words;
+
+  // No summary word below this one has a set bit.
+  uint64_t hint;
+} bitmap_t;
+
+// (Re)allocates a bitmap of n_bits cleared bits. Panics on failure.
+void bitmap_init(bitmap_t* bitmap, uint64_t n_bits);
+void bitmap_free(bitmap_t* bitmap);
+
+// Saves or restores the bits of a bitmap initialized with the same size.
+void bitmap_checkpoint(bitmap_t* bitmap, checkpoint_t* checkpoint);
+
+void bitmap_set(bitmap_t* bitmap, uint64_t bit);
+void bitmap_clear(bitmap_t* bitmap, uint64_t bit);
+bool bitmap_test(const bitmap_t* bitmap, uint64_t bit);
+
+// Returns the lowest set bit, or n_bits if none is set.
+uint64_t bitmap_find_first(bitmap_t* bitmap);
+
+// Returns the first bit of the lowest block of block_bits set bits aligned on
+// block_bits, or n_bits if there is none. block_bits must be a multiple of 64.
+uint64_t bitmap_find_block(const bitmap_t* bitmap, uint64_t block_bits);
@@ -0,0 +1,404 @@
+#include "cache.h"
+
+#include <stdlib.h>
+
+#include "bitmap.h"
+#include "constants.h"
+#include "log.h"
+
+typedef struct {
+  bool valid;
+  bool dirty;
+  // Line number: the address without its offset in the line.
+  uint64_t tag;
+  uint64_t last_use;
+} cache_line_t;
+
+typedef struct {
+  cache_line_t* lines;
+  uint64_t ways;
+  uint64_t sets;
+  uint64_t line_bits;
+  time_ns_t latency_ns;
+  cache_stats_t stats;
+} cache_t;
+
+// The hierarchy of a core. Only touched by the thread simulating the core,
+// and by cache_flush_page() on the main thread.
+typedef struct {
+  cache_t levels[CACHE_LEVELS];
+  uint64_t use;
+
+  // Frames the core filled lines of since they were last flushed.
+  bitmap_t cached_frames;
+
+  uint64_t dram_reads;
+  uint64_t dram_writes;
+  time_ns_t vipt_saved_ns;
+} cache_core_t;
+
+cache_config_t cache_config;
+cache_core_t* cache_cores = NULL;
+unsigned cache_core_count = 0;
+
+// Levels that are not left out, from L1 down.
+cache_level_t cache_levels[CACHE_LEVELS];
+unsigned cache_level_count = 0;
+
+// Latency every reference saves when the L1 is VIPT.
+time_ns_t cache_vipt_overlap_ns = 0;
+
+const char* cache_level_name(cache_level_t level) {
+  switch (level) {
+    case CACHE_L1:
+      return "L1";
+    case CACHE_L2:
+      return "L2";
+    case CACHE_LLC:
+      return "LLC";
+    case CACHE_LEVELS:
+      break;
+  }
+  return "?";
+}
+
+const char* cache_write_policy_name(cache_write_policy_t write) {
+  switch (write) {
+    case CACHE_WRITE_BACK:
+      return "back";
+    case CACHE_WRITE_THROUGH:
+      return "through";
+  }
+  return "?";
+}
+
+const char* cache_write_miss_name(cache_write_miss_t write_miss) {
+  switch (write_miss) {
+    case CACHE_WRITE_ALLOCATE:
+      return "allocate";
+    case CACHE_WRITE_AROUND:
+      return "around";
+  }
+  return "?";
+}
+
+const char* cache_index_name(cache_index_t index) {
+  switch (index) {
+    case CACHE_INDEX_PHYSICAL:
+      return "physical";
+    case CACHE_INDEX_VIRTUAL:
+      return "virtual";
+  }
+  return "?";
+}
+
+static inline bool is_power_of_two(uint64_t x) {
+  return x && (x & (x - 1)) == 0;
+}
+
+void cache_init(const cache_config_t* config, const tlb_config_t* tlb) {
+  unsigned cores = tlb->cores;
+  if (cache_cores) {
+    for (unsigned core = 0; core < cache_core_count; core++) {
+      for (unsigned level = 0; level < CACHE_LEVELS; level++) {
+        free(cache_cores[core].levels[level].lines);
+      }
+      bitmap_free(&cache_cores[core].cached_frames);
+    }
+    free(cache_cores);
+    cache_cores = NULL;
+  }
+  cache_config = *config;
+  cache_core_count = cores;
+  cache_level_count = 0;
+
+  for (cache_level_t level = CACHE_L1; level < CACHE_LEVELS; level++) {
+    const cache_level_config_t* level_config = &config->levels[level];
+    if (level_config->size == 0) {
+      continue;
+    }
+    uint64_t lines = level_config->size / level_config->line_size;
+    uint64_t ways = level_config->ways ? level_config->ways : lines;
+    if (!is_power_of_two(level_config->line_size) ||
+        level_config->line_size > PAGE_SIZE_BYTES ||
+        level_config->size % level_config->line_size != 0 || lines == 0 ||
+        ways > lines || lines % ways != 0 || !is_power_of_two(lines / ways)) {
+      panic("Invalid %s data cache geometry: %" PRIu64 " B, %" PRIu64
+            " B lines, %" PRIu64 " ways (expected a power of two of lines "
+            "and of sets, and lines up to a page)",
+            cache_level_name(level), level_config->size,
+            level_config->line_size, level_config->ways);
+    }
+    cache_levels[cache_level_count++] = level;
+  }
+
+  cache_vipt_overlap_ns = 0;
+  if (config->l1_index == CACHE_INDEX_VIRTUAL) {
+    const cache_level_config_t* l1 = &config->levels[CACHE_L1];
+    if (l1->size == 0) {
+      panic("A virtually indexed L1 data cache needs an L1 data cache");
+    }
+    uint64_t ways = l1->ways ? l1->ways : l1->size / l1->line_size;
+    if (l1->size / ways > PAGE_SIZE_BYTES) {
+      panic("Virtually indexed L1 data cache of %" PRIu64 " B per way: the "
+            "set index does not fit in the %d bits of the page offset "
+            "(expected at most %" PRIu64 " B per way)",
+            l1->size / ways, PAGE_SIZE_BITS, PAGE_SIZE_BYTES);
+    }
+    cache_vipt_overlap_ns = l1->latency_ns < tlb->l1.latency_ns
+                                ? l1->latency_ns
+                                : tlb->l1.latency_ns;
+  }
+  if (cache_level_count == 0) {
+    return;
+  }
+
+  cache_cores = calloc(cores, sizeof(cache_core_t));
+  if (!cache_cores) {
+    panic("Failed to allocate data caches");
+  }
+  for (unsigned core = 0; core < cores; core++) {
+    bitmap_init(&cache_cores[core].cached_frames, DRAM_PAGE_CAPACITY);
+    for (unsigned i = 0; i < cache_level_count; i++) {
+      const cache_level_config_t* level_config =
+          &config->levels[cache_levels[i]];
+      cache_t* cache = &cache_cores[core].levels[cache_levels[i]];
+      uint64_t lines = level_config->size / level_config->line_size;
+      cache->ways = level_config->ways ? level_config->ways : lines;
+      cache->sets = lines / cache->ways;
+      cache->line_bits = __builtin_ctzll(level_config->line_size);
+      cache->latency_ns = level_config->latency_ns;
+      cache->lines = calloc(lines, sizeof(cache_line_t));
+      if (!cache->lines) {
+        panic("Failed to allocate data caches");
+      }
+    }
+  }
+}
+
+bool cache_enabled() { return cache_cores != NULL; }
+
+void cache_checkpoint(checkpoint_t* checkpoint) {
+  for (unsigned core_id = 0; cache_enabled() && core_id < cache_core_count;
+       core_id++) {
+    cache_core_t* core = &cache_cores[core_id];
+    for (unsigned i = 0; i < cache_level_count; i++) {
+      cache_t* cache = &core->levels[cache_levels[i]];
+      checkpoint_data(checkpoint, cache->lines,
+                      cache->sets * cache->ways * sizeof(cache_line_t));
+      CHECKPOINT_VALUE(checkpoint, cache->stats);
+    }
+    CHECKPOINT_VALUE(checkpoint, core->use);
+    bitmap_checkpoint(&core->cached_frames, checkpoint);
+    CHECKPOINT_VALUE(checkpoint, core->dram_reads);
+    CHECKPOINT_VALUE(checkpoint, core->dram_writes);
+    CHECKPOINT_VALUE(checkpoint, core->vipt_saved_ns);
+  }
+}
+
+cache_line_t* find_cache_line(cache_t* cache, uint64_t tag) {
+  cache_line_t* set = &cache->lines[(tag & (cache->sets - 1)) * cache->ways];
+  for (uint64_t way = 0; way < cache->ways; way++) {
+    if (set[way].valid && set[way].tag == tag) {
+      return &set[way];
+    }
+  }
+  return NULL;
+}
+
+// Free way of the set of `tag`, else the least recently used one.
+cache_line_t* get_cache_victim(cache_t* cache, uint64_t tag) {
+  cache_line_t* set = &cache->lines[(tag & (cache->sets - 1)) * cache->ways];
+  cache_line_t* victim = &set[0];
+  for (uint64_t way = 0; way < cache->ways; way++) {
+    if (!set[way].valid) {
+      return &set[way];
+    }
+    if (set[way].last_use < victim->last_use) {
+      victim = &set[way];
+    }
+  }
+  return victim;
+}
+
+void cache_dram_access(cache_core_t* core, pa_dram_t address, op_t op) {
+  log_dram_access(address, op);
+  if (op == OP_READ) {
+    core->dram_reads++;
+  } else {
+    core->dram_writes++;
+  }
+}
+
+// Buffered write of `address` from the level above level i: updates the
+// first level from i down that holds it, or DRAM. When warming, DRAM is left
+// alone: it holds no state.
+void cache_write_down(cache_core_t* core, unsigned i, pa_dram_t address,
+                      bool warm) {
+  for (; i < cache_level_count; i++) {
+    cache_t* cache = &core->levels[cache_levels[i]];
+    cache_line_t* line = find_cache_line(cache, address >> cache->line_bits);
+    if (!line) {
+      continue;
+    }
+    if (cache_config.write == CACHE_WRITE_BACK) {
+      line->dirty = true;
+      return;
+    }
+  }
+  if (!warm) {
+    cache_dram_access(core, address, OP_WRITE);
+  }
+}
+
+void cache_write_line(cache_core_t* core, unsigned i, cache_line_t* line,
+                      pa_dram_t address, bool warm) {
+  if (cache_config.write == CACHE_WRITE_BACK) {
+    line->dirty = true;
+  } else {
+    cache_write_down(core, i + 1, address, warm);
+  }
+}
+
+// Looks `address` up from level i down. Returns the latency. When warming,
+// only the lines change: the statistics and DRAM are left alone.
+time_ns_t cache_access_from(cache_core_t* core, unsigned i, pa_dram_t address,
+                            op_t op, bool warm) {
+  if (i == cache_level_count) {
+    if (!warm) {
+      cache_dram_access(core, address, op);
+    }
+    return DRAM_LATENCY_NS;
+  }
+
+  cache_t* cache = &core->levels[cache_levels[i]];
+  time_ns_t time = cache->latency_ns;
+  uint64_t tag = address >> cache->line_bits;
+  cache_line_t* line = find_cache_line(cache, tag);
+  if (line) {
+    if (!warm) {
+      cache->stats.hits++;
+    }
+    line->last_use = ++core->use;
+    if (op == OP_WRITE) {
+      cache_write_line(core, i, line, address, warm);
+    }
+    return time;
+  }
+
+  if (!warm) {
+    cache->stats.misses++;
+  }
+  if (op == OP_WRITE && cache_config.write_miss == CACHE_WRITE_AROUND) {
+    return time + cache_access_from(core, i + 1, address, OP_WRITE, warm);
+  }
+
+  time +=
+      cache_access_from(core, i + 1, tag << cache->line_bits, OP_READ, warm);
+  line = get_cache_victim(cache, tag);
+  if (line->valid && line->dirty) {
+    if (!warm) {
+      cache->stats.write_backs++;
+    }
+    cache_write_down(core, i + 1, line->tag << cache->line_bits, warm);
+  }
+  bitmap_set(&core->cached_frames, address >> PAGE_SIZE_BITS);
+  line->valid = true;
+  line->dirty = false;
+  line->tag = tag;
+  line->last_use = ++core->use;
+  if (op == OP_WRITE) {
+    cache_write_line(core, i, line, address, warm);
+  }
+  return time;
+}
+
+void cache_access(pa_dram_t address, op_t op) {
+  cache_core_t* core = &cache_cores[get_current_core()];
+  address &= DRAM_ADDRESS_MASK;
+  // The set index is the same in both modes, so are the lines; only the
+  // latency differs
+  time_ns_t time = cache_access_from(core, 0, address, op, false);
+  time -= cache_vipt_overlap_ns;
+  core->vipt_saved_ns += cache_vipt_overlap_ns;
+  increment_time(TIME_MEMORY, time);
+}
+
+void cache_warm(pa_dram_t address, op_t op) {
+  cache_core_t* core = &cache_cores[get_current_core()];
+  cache_access_from(core, 0, address & DRAM_ADDRESS_MASK, op, true);
+}
+
+unsigned cache_first_line_bits() {
+  if (!cache_enabled()) {
+    return PAGE_SIZE_BITS;
+  }
+  return cache_cores[0].levels[cache_levels[0]].line_bits;
+}
+
+void cache_flush_page(pa_dram_t dram_page_number) {
+  if (!cache_enabled() || dram_page_number >= DRAM_PAGE_CAPACITY) {
+    return;
+  }
+
+  pa_dram_t first = dram_page_number << PAGE_SIZE_BITS;
+  for (unsigned core_id = 0; core_id < cache_core_count; core_id++) {
+    cache_core_t* core = &cache_cores[core_id];
+    if (!bitmap_test(&core->cached_frames, dram_page_number)) {
+      continue;
+    }
+    bitmap_clear(&core->cached_frames, dram_page_number);
+    for (unsigned i = 0; i < cache_level_count; i++) {
+      cache_t* cache = &core->levels[cache_levels[i]];
+      uint64_t first_tag = first >> cache->line_bits;
+      uint64_t last_tag = (first + PAGE_SIZE_BYTES - 1) >> cache->line_bits;
+      for (uint64_t tag = first_tag; tag <= last_tag; tag++) {
+        cache_line_t* line = find_cache_line(cache, tag);
+        if (!line) {
+          continue;
+        }
+        // Every level is flushed, so the line goes straight to DRAM
+        if (line->dirty) {
+          cache->stats.write_backs++;
+          cache_dram_access(core, tag << cache->line_bits, OP_WRITE);
+        }
+        line->valid = false;
+      }
+    }
+  }
+}
+
+cache_stats_t get_total_cache_stats(cache_level_t level) {
+  cache_stats_t total = {0};
+  for (unsigned core = 0; cache_enabled() && core < cache_core_count; core++) {
+    const cache_stats_t* stats = &cache_cores[core].levels[level].stats;
+    total.hits += stats->hits;
+    total.misses += stats->misses;
+    total.write_backs += stats->write_backs;
+  }
+  return total;
+}
+
+uint64_t get_total_cache_dram_reads() {
+  uint64_t total = 0;
+  for (unsigned core = 0; cache_enabled() && core < cache_core_count; core++) {
+    total += cache_cores[core].dram_reads;
+  }
+  return total;
+}
+
+time_ns_t get_total_cache_vipt_saved_time() {
+  time_ns_t total = 0;
+  for (unsigned core = 0; cache_enabled() && core < cache_core_count; core++) {
+    total += cache_cores[core].vipt_saved_ns;
+  }
+  return total;
+}
+
+uint64_t get_total_cache_dram_writes() {
+  uint64_t total = 0;
+  for (unsigned core = 0; cache_enabled() && core < cache_core_count; core++) {
+    total += cache_cores[core].dram_writes;
+  }
+  return total;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "checkpoint.h"
+#include "clock.h"
+#include "memory.h"
+#include "tlb.h"
+
+// Data-cache hierarchy, between the translated (physical) addresses of the
+// references and DRAM. Every core has its own L1, L2 and LLC, physically
+// tagged (and indexed, but see cache_index_t), with LRU replacement; there is
+// no coherence between cores. A level with size 0 is left out, and without any level the
+// references go straight to DRAM as before (logged, but not charged).
+//
+// A reference pays the latency of every level it looks up, down to the one
+// that hits, and DRAM_LATENCY_NS if none does. Lines are filled from the
+// level below on the way back. Write-backs of dirty victims, and writes
+// passed down by write-through levels, are buffered: they update the line of
+// the first level below that holds it, or DRAM, without being charged.
+// write-back: a write hit only dirties the line.
+// write-through: a write hit is also passed down, down to DRAM.
+// allocate: a write miss fills the line, then writes it, like a read miss.
+// around: a write miss is passed down as a write, without filling the line.
+typedef enum { CACHE_WRITE_BACK, CACHE_WRITE_THROUGH } cache_write_policy_t;
+typedef enum { CACHE_WRITE_ALLOCATE, CACHE_WRITE_AROUND } cache_write_miss_t;
+
+// How the L1 picks the set of an address.
+// physical (PIPT): from the physical address, once the TLB translated it.
+// virtual (VIPT): from the page offset, which translation leaves alone, so
+//                 the set is read while the L1 TLB is looked up, and only the
+//                 tag check waits for the physical address. The L1 hits and
+//                 misses are those of PIPT, but a reference is charged
+//                 min(L1 TLB latency, L1 latency) less. The set index must
+//                 fit in the page offset (no aliasing): at most
+//                 PAGE_SIZE_BYTES per way.
+typedef enum { CACHE_INDEX_PHYSICAL, CACHE_INDEX_VIRTUAL } cache_index_t;
+
+typedef enum { CACHE_L1, CACHE_L2, CACHE_LLC, CACHE_LEVELS } cache_level_t;
+
+// ways == 0 is fully associative.
+typedef struct {
+  uint64_t size;
+  uint64_t line_size;
+  uint64_t ways;
+  time_ns_t latency_ns;
+} cache_level_config_t;
+
+typedef struct {
+  cache_level_config_t levels[CACHE_LEVELS];
+  cache_write_policy_t write;
+  cache_write_miss_t write_miss;
+  cache_index_t l1_index;
+} cache_config_t;
+
+#define CACHE_DEFAULT_CONFIG                                          \
+  ((cache_config_t){{{0, 64, 8, 1}, {0, 64, 8, 4}, {0, 64, 16, 12}}, \
+                    CACHE_WRITE_BACK, CACHE_WRITE_ALLOCATE,            \
+                    CACHE_INDEX_PHYSICAL})
+
+const char* cache_level_name(cache_level_t level);
+const char* cache_write_policy_name(cache_write_policy_t write);
+const char* cache_write_miss_name(cache_write_miss_t write_miss);
+const char* cache_index_name(cache_index_t index);
+
+// (Re)initializes empty caches for the cores of the TLB configuration.
+// Panics on an invalid geometry.
+void cache_init(const cache_config_t* config, const tlb_config_t* tlb);
+bool cache_enabled();
+
+// Saves or restores the lines and statistics of every core. Restoring needs
+// cache_init() with the same configuration first.
+void cache_checkpoint(checkpoint_t* checkpoint);
+
+// Reads or writes the data at `address` from the current core, charging it.
+void cache_access(pa_dram_t address, op_t op);
+
+// Same lines filled, evicted and dirtied as cache_access(), for functional
+// warming (see sample.h): without time, statistics or DRAM accesses.
+void cache_warm(pa_dram_t address, op_t op);
+
+// Line size (log2) of the first level. A reference to the line the core
+// referenced last hits there, without changing any state but the statistics
+// (unless it is the first write). PAGE_SIZE_BITS without data caches.
+unsigned cache_first_line_bits();
+
+// Writes back the dirty lines of a DRAM frame and invalidates its lines in
+// every core, when the frame changes hands.
+void cache_flush_page(pa_dram_t dram_page_number);
+
+typedef struct {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t write_backs;
+} cache_stats_t;
+
+// Totals of every core, for a level that is not left out.
+cache_stats_t get_total_cache_stats(cache_level_t level);
+
+// Line reads and writes that reached DRAM.
+uint64_t get_total_cache_dram_reads();
+uint64_t get_total_cache_dram_writes();
+
+// Latency a VIPT L1 hid behind the L1 TLB lookups, versus PIPT.
+time_ns_t get_total_cache_vipt_saved_time();
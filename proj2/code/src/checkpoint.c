@@ -0,0 +1,97 @@
+#include "checkpoint.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "log.h"
+
+// Size of the default state of glibc's rand(), so that initstate() picks the
+// same generator as srand().
+#define CHECKPOINT_RANDOM_STATE_SIZE 128
+
+static char random_state[CHECKPOINT_RANDOM_STATE_SIZE];
+static char random_scratch[CHECKPOINT_RANDOM_STATE_SIZE];
+
+// Constants a checkpoint only makes sense with.
+static const uint64_t checkpoint_layout[] = {
+    VIRTUAL_ADDRESS_BITS, PAGE_SIZE_BITS, DRAM_ADDRESS_BITS, DISK_ADDRESS_BITS,
+    PAGE_TABLE_LEVEL_BITS, MAX_CORES, ASID_BITS,
+};
+
+void checkpoint_create(checkpoint_t* checkpoint, const char* path) {
+  checkpoint->path = path;
+  checkpoint->saving = true;
+  checkpoint->file = fopen(path, "wb");
+  if (!checkpoint->file) {
+    panic("Failed to create checkpoint %s", path);
+  }
+
+  fwrite(CHECKPOINT_MAGIC, 1, CHECKPOINT_MAGIC_SIZE, checkpoint->file);
+  fwrite(checkpoint_layout, sizeof(checkpoint_layout), 1, checkpoint->file);
+}
+
+void checkpoint_open(checkpoint_t* checkpoint, const char* path) {
+  checkpoint->path = path;
+  checkpoint->saving = false;
+  checkpoint->file = fopen(path, "rb");
+  if (!checkpoint->file) {
+    panic("Failed to open checkpoint %s", path);
+  }
+
+  char magic[CHECKPOINT_MAGIC_SIZE];
+  if (fread(magic, 1, CHECKPOINT_MAGIC_SIZE, checkpoint->file) !=
+          CHECKPOINT_MAGIC_SIZE ||
+      memcmp(magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE) != 0) {
+    panic("%s is not a checkpoint", path);
+  }
+
+  uint64_t layout[sizeof(checkpoint_layout) / sizeof(checkpoint_layout[0])];
+  checkpoint_data(checkpoint, layout, sizeof(layout));
+  if (memcmp(layout, checkpoint_layout, sizeof(layout)) != 0) {
+    panic("Checkpoint %s was saved with other memory sizes (see "
+          "constants.h)",
+          path);
+  }
+}
+
+void checkpoint_close(checkpoint_t* checkpoint) {
+  if (checkpoint->saving) {
+    if (ferror(checkpoint->file) | fclose(checkpoint->file)) {
+      panic("Failed to write checkpoint %s", checkpoint->path);
+    }
+  } else {
+    fclose(checkpoint->file);
+  }
+  checkpoint->file = NULL;
+}
+
+void checkpoint_data(checkpoint_t* checkpoint, void* data, size_t size) {
+  if (size == 0) {
+    return;
+  }
+  if (checkpoint->saving) {
+    fwrite(data, size, 1, checkpoint->file);
+  } else if (fread(data, size, 1, checkpoint->file) != 1) {
+    panic("Truncated checkpoint %s", checkpoint->path);
+  }
+}
+
+void checkpoint_seed_random(unsigned seed) {
+  initstate(seed, random_state, sizeof(random_state));
+}
+
+void checkpoint_random(checkpoint_t* checkpoint) {
+  if (checkpoint->saving) {
+    // Makes glibc store its position in the state
+    setstate(random_state);
+    checkpoint_data(checkpoint, random_state, sizeof(random_state));
+    return;
+  }
+
+  // setstate() stores the position in the current state first, so that one
+  // must not be random_state
+  initstate(1, random_scratch, sizeof(random_scratch));
+  checkpoint_data(checkpoint, random_state, sizeof(random_state));
+  setstate(random_state);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Checkpoint files hold the whole state of a simulation, so that a run can
+// resume from it instead of replaying the references that led there:
+// CHECKPOINT_MAGIC, the constants of constants.h that size the simulated
+// memory, then what the simulator writes (its configuration, the references
+// simulated, and the state of every module, through their *_checkpoint()
+// functions). Structures are written as they are in memory, so a checkpoint
+// can only be restored by a build of the same simulator on the same host.
+//
+// Modules save and restore their state with the same function, which passes
+// every field through checkpoint_data(): it writes it when saving, and reads
+// it back when restoring. Modules are initialized with the configuration of
+// the checkpoint before they are restored, so that their tables have the
+// right size.
+#define CHECKPOINT_MAGIC "TLBCKP01"
+#define CHECKPOINT_MAGIC_SIZE 8
+
+typedef struct {
+  const char* path;
+  FILE* file;
+  bool saving;
+} checkpoint_t;
+
+// Creates a checkpoint to save, or opens one to restore. Panics on error.
+void checkpoint_create(checkpoint_t* checkpoint, const char* path);
+void checkpoint_open(checkpoint_t* checkpoint, const char* path);
+void checkpoint_close(checkpoint_t* checkpoint);
+
+// Writes `size` bytes from `data`, or reads them into `data`. Panics if the
+// checkpoint is truncated.
+void checkpoint_data(checkpoint_t* checkpoint, void* data, size_t size);
+
+#define CHECKPOINT_VALUE(checkpoint, value) \
+  checkpoint_data((checkpoint), &(value), sizeof(value))
+
+// Seeds rand() with a state that checkpoints include, so that random
+// replacement and placement go on as if the run had not stopped. The
+// sequence is the same as with srand().
+void checkpoint_seed_random(unsigned seed);
+void checkpoint_random(checkpoint_t* checkpoint);
@@ -1,7 +1,206 @@
 #include "clock.h"
 
-time_ns_t current_time = 0;
+#include <stdlib.h>
+#include <string.h>
 
-void reset_time() { current_time = 0; }
-time_ns_t get_time() { return current_time; }
-void increment_time(time_ns_t dt) { current_time += dt; }
\ No newline at end of file
+#include "constants.h"
+#include "log.h"
+
+typedef struct {
+  time_ns_t time;
+  time_ns_t stall_ns[TIME_CAUSES];
+
+  // Miss being handled (overlap mode), and its latency so far.
+  bool in_miss;
+  time_ns_t miss_ns[TIME_CAUSES];
+
+  // Completion times of the outstanding misses; free slots are in the past.
+  time_ns_t walk_slots[TIMING_MAX_SLOTS];
+  time_ns_t io_slots[TIMING_MAX_SLOTS];
+
+  uint64_t overlapped_walks;
+  uint64_t overlapped_ios;
+  time_ns_t overlapped_ns;
+} core_clock_t;
+
+timing_config_t timing_config = TIMING_DEFAULT_CONFIG;
+core_clock_t core_clocks[MAX_CORES];
+bool clock_frozen = false;
+// Per host thread, so that the parallel engine can run one core per thread.
+__thread core_clock_t* current_clock = &core_clocks[0];
+__thread unsigned current_core = 0;
+
+const char* timing_mode_name(timing_mode_t mode) {
+  switch (mode) {
+    case TIMING_BLOCKING:
+      return "blocking";
+    case TIMING_OVERLAP:
+      return "overlap";
+  }
+  return "?";
+}
+
+const char* time_cause_name(time_cause_t cause) {
+  switch (cause) {
+    case TIME_TLB:
+      return "TLB";
+    case TIME_MEMORY:
+      return "memory";
+    case TIME_DISK:
+      return "disk";
+    case TIME_SHOOTDOWN:
+      return "shootdowns";
+    case TIME_CAUSES:
+      break;
+  }
+  return "?";
+}
+
+void clock_init(const timing_config_t* config) {
+  if (config->walk_slots == 0 || config->walk_slots > TIMING_MAX_SLOTS ||
+      config->io_slots == 0 || config->io_slots > TIMING_MAX_SLOTS) {
+    panic("Invalid number of outstanding misses: %u walks, %u I/Os "
+          "(expected 1 to %d)",
+          config->walk_slots, config->io_slots, TIMING_MAX_SLOTS);
+  }
+
+  timing_config = *config;
+  memset(core_clocks, 0, sizeof(core_clocks));
+  clock_frozen = false;
+  clock_select_core(0);
+}
+
+void clock_checkpoint(checkpoint_t* checkpoint) {
+  CHECKPOINT_VALUE(checkpoint, core_clocks);
+}
+
+time_ns_t get_time() { return current_clock->time; }
+
+void increment_time(time_cause_t cause, time_ns_t dt) {
+  if (clock_frozen) {
+    return;
+  }
+  if (current_clock->in_miss) {
+    current_clock->miss_ns[cause] += dt;
+    return;
+  }
+  current_clock->time += dt;
+  current_clock->stall_ns[cause] += dt;
+}
+
+time_ns_t get_time_in_miss() {
+  time_ns_t now = current_clock->time;
+  if (current_clock->in_miss) {
+    for (time_cause_t cause = 0; cause < TIME_CAUSES; cause++) {
+      now += current_clock->miss_ns[cause];
+    }
+  }
+  return now;
+}
+
+void wait_until(time_cause_t cause, time_ns_t time) {
+  if (clock_frozen) {
+    return;
+  }
+  core_clock_t* clock = current_clock;
+  if (clock->in_miss) {
+    time_ns_t now = get_time_in_miss();
+    if (time > now) {
+      clock->miss_ns[cause] += time - now;
+    }
+    return;
+  }
+  if (time > clock->time) {
+    clock->stall_ns[cause] += time - clock->time;
+    clock->time = time;
+  }
+}
+
+void clock_begin_miss() {
+  if (timing_config.mode == TIMING_OVERLAP) {
+    current_clock->in_miss = true;
+    memset(current_clock->miss_ns, 0, sizeof(current_clock->miss_ns));
+  }
+}
+
+time_ns_t clock_end_miss(time_cause_t* cause) {
+  core_clock_t* clock = current_clock;
+  *cause = TIME_MEMORY;
+  if (!clock->in_miss) {
+    return clock->time;
+  }
+  clock->in_miss = false;
+
+  time_ns_t latency = 0;
+  for (time_cause_t c = 0; c < TIME_CAUSES; c++) {
+    latency += clock->miss_ns[c];
+  }
+
+  bool io = clock->miss_ns[TIME_DISK] > 0;
+  time_ns_t* slots = io ? clock->io_slots : clock->walk_slots;
+  unsigned n_slots = io ? timing_config.io_slots : timing_config.walk_slots;
+  if (io) {
+    *cause = TIME_DISK;
+    clock->overlapped_ios++;
+  } else {
+    clock->overlapped_walks++;
+  }
+  clock->overlapped_ns += latency;
+
+  // Wait for the first slot to free up if they are all busy
+  unsigned slot = 0;
+  for (unsigned i = 1; i < n_slots; i++) {
+    if (slots[i] < slots[slot]) {
+      slot = i;
+    }
+  }
+  wait_until(*cause, slots[slot]);
+
+  slots[slot] = clock->time + latency;
+  return slots[slot];
+}
+
+void clock_drain() {
+  unsigned core = current_core;
+  for (unsigned i = 0; i < MAX_CORES; i++) {
+    clock_select_core(i);
+    for (unsigned slot = 0; slot < TIMING_MAX_SLOTS; slot++) {
+      wait_until(TIME_MEMORY, current_clock->walk_slots[slot]);
+      wait_until(TIME_DISK, current_clock->io_slots[slot]);
+    }
+  }
+  clock_select_core(core);
+}
+
+void clock_freeze(bool frozen) { clock_frozen = frozen; }
+
+void clock_select_core(unsigned core) {
+  current_core = core;
+  current_clock = &core_clocks[core];
+}
+unsigned get_current_core() { return current_core; }
+time_ns_t get_core_time(unsigned core) { return core_clocks[core].time; }
+
+time_ns_t get_elapsed_time() {
+  time_ns_t elapsed = 0;
+  for (unsigned core = 0; core < MAX_CORES; core++) {
+    if (core_clocks[core].time > elapsed) {
+      elapsed = core_clocks[core].time;
+    }
+  }
+  return elapsed;
+}
+
+#define CLOCK_TOTAL(field)                            \
+  uint64_t total = 0;                                 \
+  for (unsigned core = 0; core < MAX_CORES; core++) { \
+    total += core_clocks[core].field;                 \
+  }                                                   \
+  return total;
+
+time_ns_t get_total_stall_time(time_cause_t cause) {
+  CLOCK_TOTAL(stall_ns[cause])
+}
+uint64_t get_total_overlapped_walks() { CLOCK_TOTAL(overlapped_walks) }
+uint64_t get_total_overlapped_ios() { CLOCK_TOTAL(overlapped_ios) }
+time_ns_t get_total_overlapped_time() { CLOCK_TOTAL(overlapped_ns) }
@@ -1,9 +1,87 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "checkpoint.h"
+
 typedef uint64_t time_ns_t;
 
-void reset_time();
+// What simulated time is spent on.
+typedef enum {
+  TIME_TLB,        // TLB lookups and invalidations
+  TIME_MEMORY,     // DRAM accesses: page walks, PTE updates, page copies
+  TIME_DISK,       // swap reads and writes
+  TIME_SHOOTDOWN,  // TLB shootdowns, sent or handled
+  TIME_CAUSES,
+} time_cause_t;
+
+// blocking: every latency stalls the core, one after the other.
+// overlap: a TLB miss (its page walk, and the disk I/Os of a page fault) is
+//          issued and left running while the core goes on, like a
+//          non-blocking cache with MSHRs. At most walk_slots misses without
+//          disk I/O, and io_slots misses with some, are outstanding per core:
+//          the core stalls when all slots are busy, and when it uses a
+//          translation whose miss is not over.
+typedef enum { TIMING_BLOCKING, TIMING_OVERLAP } timing_mode_t;
+
+typedef struct {
+  timing_mode_t mode;
+  unsigned walk_slots;
+  unsigned io_slots;
+} timing_config_t;
+
+#define TIMING_DEFAULT_CONFIG ((timing_config_t){TIMING_BLOCKING, 4, 4})
+
+// Largest number of outstanding misses of each kind.
+#define TIMING_MAX_SLOTS 64
+
+const char* timing_mode_name(timing_mode_t mode);
+const char* time_cause_name(time_cause_t cause);
+
+// Every simulated core has its own clock. get_time() and increment_time()
+// use the clock of the current core, chosen with clock_select_core(). The
+// current core is per host thread.
+// clock_init() resets every clock. Panics on an invalid configuration.
+void clock_init(const timing_config_t* config);
+void clock_checkpoint(checkpoint_t* checkpoint);
 time_ns_t get_time();
-void increment_time(time_ns_t dt);
\ No newline at end of file
+void increment_time(time_cause_t cause, time_ns_t dt);
+
+// Same as get_time(), but during a miss in overlap mode, the miss is that much
+// further along: its issue time plus the latency charged to it so far.
+time_ns_t get_time_in_miss();
+
+// Stalls the current core until `time`, if it is not there yet. During a miss
+// in overlap mode, delays the completion of the miss instead.
+void wait_until(time_cause_t cause, time_ns_t time);
+
+// Brackets the handling of a TLB miss. In overlap mode, the time charged in
+// between makes up the latency of the miss instead of advancing the clock;
+// clock_end_miss() issues it in a free slot and returns when it completes,
+// with the cause a wait for it is charged to. In blocking mode it returns
+// the current time.
+void clock_begin_miss();
+time_ns_t clock_end_miss(time_cause_t* cause);
+
+// Stalls every core until its outstanding misses complete.
+void clock_drain();
+
+// While frozen, increment_time() and wait_until() leave every clock alone:
+// functional warming (see sample.h) replays the state changes of references,
+// not their time.
+void clock_freeze(bool frozen);
+
+void clock_select_core(unsigned core);
+unsigned get_current_core();
+time_ns_t get_core_time(unsigned core);
+
+// Time of the core that finished last.
+time_ns_t get_elapsed_time();
+
+// Time every core stalled on a cause, and misses issued in overlap mode (with
+// and without disk I/O) with their total latency.
+time_ns_t get_total_stall_time(time_cause_t cause);
+uint64_t get_total_overlapped_walks();
+uint64_t get_total_overlapped_ios();
+time_ns_t get_total_overlapped_time();
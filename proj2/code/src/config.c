@@ -0,0 +1,522 @@
+#include "config.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+const struct option config_options[] = {
+    {"l1-entries", required_argument, NULL, 0},
+    {"l1-ways", required_argument, NULL, 0},
+    {"l1-latency", required_argument, NULL, 0},
+    {"l1-replacement", required_argument, NULL, 0},
+    {"l1-huge-entries", required_argument, NULL, 0},
+    {"l1-huge-ways", required_argument, NULL, 0},
+    {"l2-entries", required_argument, NULL, 0},
+    {"l2-ways", required_argument, NULL, 0},
+    {"l2-latency", required_argument, NULL, 0},
+    {"l2-replacement", required_argument, NULL, 0},
+    {"l2-huge-entries", required_argument, NULL, 0},
+    {"l2-huge-ways", required_argument, NULL, 0},
+    {"tlb-huge", required_argument, NULL, 0},
+    {"asid-mode", required_argument, NULL, 0},
+    {"tlb-prefetch", required_argument, NULL, 0},
+    {"prefetch-target", required_argument, NULL, 0},
+    {"prefetch-buffer", required_argument, NULL, 0},
+    {"prefetch-degree", required_argument, NULL, 0},
+    {"prefetch-table", required_argument, NULL, 0},
+    {"cores", required_argument, NULL, 0},
+    {"shootdown-latency", required_argument, NULL, 0},
+    {"shootdown-handler", required_argument, NULL, 0},
+    {"page-replacement", required_argument, NULL, 0},
+    {"wsclock-tau", required_argument, NULL, 0},
+    {"page-walk", required_argument, NULL, 0},
+    {"pwc-entries", required_argument, NULL, 0},
+    {"pwc-ways", required_argument, NULL, 0},
+    {"pwc-latency", required_argument, NULL, 0},
+    {"huge-pages", required_argument, NULL, 0},
+    {"huge-promote-threshold", required_argument, NULL, 0},
+    {"swap-placement", required_argument, NULL, 0},
+    {"swap-slots", required_argument, NULL, 0},
+    {"swap-readahead", required_argument, NULL, 0},
+    {"swap-cache", required_argument, NULL, 0},
+    {"disk-model", required_argument, NULL, 0},
+    {"write-buffer", required_argument, NULL, 0},
+    {"write-batch", required_argument, NULL, 0},
+    {"timing", required_argument, NULL, 0},
+    {"walk-slots", required_argument, NULL, 0},
+    {"io-slots", required_argument, NULL, 0},
+    {"dcache-l1-size", required_argument, NULL, 0},
+    {"dcache-l1-line", required_argument, NULL, 0},
+    {"dcache-l1-ways", required_argument, NULL, 0},
+    {"dcache-l1-latency", required_argument, NULL, 0},
+    {"dcache-l2-size", required_argument, NULL, 0},
+    {"dcache-l2-line", required_argument, NULL, 0},
+    {"dcache-l2-ways", required_argument, NULL, 0},
+    {"dcache-l2-latency", required_argument, NULL, 0},
+    {"dcache-llc-size", required_argument, NULL, 0},
+    {"dcache-llc-line", required_argument, NULL, 0},
+    {"dcache-llc-ways", required_argument, NULL, 0},
+    {"dcache-llc-latency", required_argument, NULL, 0},
+    {"dcache-write", required_argument, NULL, 0},
+    {"dcache-write-miss", required_argument, NULL, 0},
+    {"dcache-l1-index", required_argument, NULL, 0},
+    {NULL, 0, NULL, 0},
+};
+
+// strtoull() without the leading blanks and sign it accepts: it would read
+// "-1" as the largest value. Sets `end` to `value` if there is no number, or
+// if it does not fit.
+static uint64_t parse_number(const char* value, char** end) {
+  *end = (char*)value;
+  if (*value < '0' || *value > '9') {
+    return 0;
+  }
+  errno = 0;
+  uint64_t parsed = strtoull(value, end, 0);
+  if (errno == ERANGE) {
+    *end = (char*)value;
+  }
+  return parsed;
+}
+
+uint64_t parse_u64(const char* name, const char* value) {
+  char* end;
+  uint64_t parsed = parse_number(value, &end);
+  if (end == value || *end != '\0') {
+    panic("Invalid value for %s: %s", name, value);
+  }
+  return parsed;
+}
+
+unsigned parse_unsigned(const char* name, const char* value) {
+  uint64_t parsed = parse_u64(name, value);
+  if (parsed > UINT_MAX) {
+    panic("Invalid value for %s: %s (expected at most %u)", name, value,
+          UINT_MAX);
+  }
+  return parsed;
+}
+
+// A number of bytes, with an optional K, M or G (binary) suffix.
+uint64_t parse_size(const char* name, const char* value) {
+  char* end;
+  uint64_t parsed = parse_number(value, &end);
+  unsigned shift = 0;
+  switch (*end) {
+    case 'K':
+      shift = 10;
+      end++;
+      break;
+    case 'M':
+      shift = 20;
+      end++;
+      break;
+    case 'G':
+      shift = 30;
+      end++;
+      break;
+  }
+  if (end == value || *end != '\0' || parsed > (UINT64_MAX >> shift)) {
+    panic("Invalid value for %s: %s", name, value);
+  }
+  return parsed << shift;
+}
+
+tlb_replacement_t parse_tlb_replacement(const char* name, const char* value) {
+  for (tlb_replacement_t replacement = TLB_REPLACEMENT_LRU;
+       replacement <= TLB_REPLACEMENT_RANDOM; replacement++) {
+    if (strcmp(value, tlb_replacement_name(replacement)) == 0) {
+      return replacement;
+    }
+  }
+  panic("Invalid value for %s: %s (expected lru, fifo or random)", name, value);
+}
+
+page_replacement_t parse_page_replacement(const char* name,
+                                          const char* value) {
+  for (page_replacement_t replacement = PAGE_REPLACEMENT_LOWEST;
+       replacement <= PAGE_REPLACEMENT_WSCLOCK; replacement++) {
+    if (strcmp(value, page_replacement_name(replacement)) == 0) {
+      return replacement;
+    }
+  }
+  panic("Invalid value for %s: %s (expected lowest, fifo, clock, aging or "
+        "wsclock)",
+        name, value);
+}
+
+huge_pages_t parse_huge_pages(const char* name, const char* value) {
+  for (huge_pages_t huge_pages = HUGE_PAGES_OFF;
+       huge_pages <= HUGE_PAGES_PROMOTE; huge_pages++) {
+    if (strcmp(value, huge_pages_name(huge_pages)) == 0) {
+      return huge_pages;
+    }
+  }
+  panic("Invalid value for %s: %s (expected off, always or promote)", name,
+        value);
+}
+
+tlb_prefetch_policy_t parse_tlb_prefetch_policy(const char* name,
+                                                const char* value) {
+  for (tlb_prefetch_policy_t policy = TLB_PREFETCH_NONE;
+       policy <= TLB_PREFETCH_DISTANCE; policy++) {
+    if (strcmp(value, tlb_prefetch_policy_name(policy)) == 0) {
+      return policy;
+    }
+  }
+  panic("Invalid value for %s: %s (expected none, sequential, stride or "
+        "distance)",
+        name, value);
+}
+
+swap_placement_t parse_swap_placement(const char* name, const char* value) {
+  for (swap_placement_t placement = SWAP_PLACEMENT_NEXT;
+       placement <= SWAP_PLACEMENT_RANDOM; placement++) {
+    if (strcmp(value, swap_placement_name(placement)) == 0) {
+      return placement;
+    }
+  }
+  panic("Invalid value for %s: %s (expected next, cluster or random)", name,
+        value);
+}
+
+bool set_tlb_level_option(tlb_level_config_t* level, const char* name,
+                          const char* field, const char* value) {
+  if (strcmp(field, "entries") == 0) {
+    level->entries = parse_u64(name, value);
+  } else if (strcmp(field, "ways") == 0) {
+    level->ways = parse_u64(name, value);
+  } else if (strcmp(field, "latency") == 0) {
+    level->latency_ns = parse_u64(name, value);
+  } else if (strcmp(field, "replacement") == 0) {
+    level->replacement = parse_tlb_replacement(name, value);
+  } else if (strcmp(field, "huge-entries") == 0) {
+    level->huge_entries = parse_u64(name, value);
+  } else if (strcmp(field, "huge-ways") == 0) {
+    level->huge_ways = parse_u64(name, value);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool set_cache_level_option(cache_level_config_t* level, const char* name,
+                            const char* field, const char* value) {
+  if (strcmp(field, "size") == 0) {
+    level->size = parse_size(name, value);
+  } else if (strcmp(field, "line") == 0) {
+    level->line_size = parse_size(name, value);
+  } else if (strcmp(field, "ways") == 0) {
+    level->ways = parse_u64(name, value);
+  } else if (strcmp(field, "latency") == 0) {
+    level->latency_ns = parse_u64(name, value);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool config_set_option(sim_config_t* config, const char* name,
+                       const char* value) {
+  if (strncmp(name, "l1-", 3) == 0) {
+    return set_tlb_level_option(&config->tlb.l1, name, name + 3, value);
+  }
+  if (strncmp(name, "l2-", 3) == 0) {
+    return set_tlb_level_option(&config->tlb.l2, name, name + 3, value);
+  }
+  if (strcmp(name, "tlb-huge") == 0) {
+    if (strcmp(value, tlb_huge_name(TLB_HUGE_SEPARATE)) == 0) {
+      config->tlb.huge = TLB_HUGE_SEPARATE;
+    } else if (strcmp(value, tlb_huge_name(TLB_HUGE_UNIFIED)) == 0) {
+      config->tlb.huge = TLB_HUGE_UNIFIED;
+    } else {
+      panic("Invalid value for %s: %s (expected separate or unified)", name,
+            value);
+    }
+    return true;
+  }
+  if (strcmp(name, "asid-mode") == 0) {
+    if (strcmp(value, tlb_asid_mode_name(TLB_ASID_TAGGED)) == 0) {
+      config->tlb.asid_mode = TLB_ASID_TAGGED;
+    } else if (strcmp(value, tlb_asid_mode_name(TLB_ASID_FLUSH)) == 0) {
+      config->tlb.asid_mode = TLB_ASID_FLUSH;
+    } else {
+      panic("Invalid value for %s: %s (expected tagged or flush)", name,
+            value);
+    }
+    return true;
+  }
+  if (strcmp(name, "tlb-prefetch") == 0) {
+    config->tlb.prefetch.policy = parse_tlb_prefetch_policy(name, value);
+    return true;
+  }
+  if (strcmp(name, "prefetch-target") == 0) {
+    if (strcmp(value, tlb_prefetch_target_name(TLB_PREFETCH_BUFFER)) == 0) {
+      config->tlb.prefetch.target = TLB_PREFETCH_BUFFER;
+    } else if (strcmp(value, tlb_prefetch_target_name(TLB_PREFETCH_L2)) == 0) {
+      config->tlb.prefetch.target = TLB_PREFETCH_L2;
+    } else {
+      panic("Invalid value for %s: %s (expected buffer or l2)", name, value);
+    }
+    return true;
+  }
+  if (strcmp(name, "prefetch-buffer") == 0) {
+    config->tlb.prefetch.buffer_entries = parse_u64(name, value);
+    return true;
+  }
+  if (strcmp(name, "prefetch-degree") == 0) {
+    config->tlb.prefetch.degree = parse_u64(name, value);
+    return true;
+  }
+  if (strcmp(name, "prefetch-table") == 0) {
+    config->tlb.prefetch.table_entries = parse_u64(name, value);
+    return true;
+  }
+  if (strcmp(name, "cores") == 0) {
+    config->tlb.cores = parse_unsigned(name, value);
+    return true;
+  }
+  if (strcmp(name, "shootdown-latency") == 0) {
+    config->tlb.shootdown_latency_ns = parse_u64(name, value);
+    return true;
+  }
+  if (strcmp(name, "shootdown-handler") == 0) {
+    config->tlb.shootdown_handler_ns = parse_u64(name, value);
+    return true;
+  }
+  if (strcmp(name, "huge-pages") == 0) {
+    config->page_table.huge_pages = parse_huge_pages(name, value);
+    return true;
+  }
+  if (strcmp(name, "huge-promote-threshold") == 0) {
+    config->page_table.huge_promote_threshold = parse_u64(name, value);
+    return true;
+  }
+  if (strcmp(name, "page-replacement") == 0) {
+    config->page_table.replacement = parse_page_replacement(name, value);
+    return true;
+  }
+  if (strcmp(name, "page-walk") == 0) {
+    if (strcmp(value, page_walk_name(PAGE_WALK_FLAT)) == 0) {
+      config->page_table.walk = PAGE_WALK_FLAT;
+    } else if (strcmp(value, page_walk_name(PAGE_WALK_RADIX)) == 0) {
+      config->page_table.walk = PAGE_WALK_RADIX;
+    } else {
+      panic("Invalid value for %s: %s (expected flat or radix)", name, value);
+    }
+    return true;
+  }
+  if (strcmp(name, "pwc-entries") == 0) {
+    config->page_table.walk_cache.entries = parse_u64(name, value);
+    return true;
+  }
+  if (strcmp(name, "pwc-ways") == 0) {
+    config->page_table.walk_cache.ways = parse_u64(name, value);
+    return true;
+  }
+  if (strcmp(name, "pwc-latency") == 0) {
+    config->page_table.walk_cache.latency_ns = parse_u64(name, value);
+    return true;
+  }
+  if (strcmp(name, "wsclock-tau") == 0) {
+    config->page_table.wsclock_tau = parse_u64(name, value);
+    return true;
+  }
+  if (strcmp(name, "swap-placement") == 0) {
+    config->page_table.swap.placement = parse_swap_placement(name, value);
+    return true;
+  }
+  if (strcmp(name, "swap-slots") == 0) {
+    config->page_table.swap.slots = parse_u64(name, value);
+    return true;
+  }
+  if (strcmp(name, "swap-readahead") == 0) {
+    config->page_table.swap.readahead = parse_u64(name, value);
+    return true;
+  }
+  if (strcmp(name, "swap-cache") == 0) {
+    config->page_table.swap.cache_entries = parse_u64(name, value);
+    return true;
+  }
+  if (strcmp(name, "disk-model") == 0) {
+    if (strcmp(value, swap_disk_name(SWAP_DISK_FLAT)) == 0) {
+      config->page_table.swap.disk = SWAP_DISK_FLAT;
+    } else if (strcmp(value, swap_disk_name(SWAP_DISK_SEEK)) == 0) {
+      config->page_table.swap.disk = SWAP_DISK_SEEK;
+    } else {
+      panic("Invalid value for %s: %s (expected flat or seek)", name, value);
+    }
+    return true;
+  }
+  if (strcmp(name, "write-buffer") == 0) {
+    config->page_table.write_buffer.entries = parse_u64(name, value);
+    return true;
+  }
+  if (strcmp(name, "write-batch") == 0) {
+    config->page_table.write_buffer.batch = parse_u64(name, value);
+    return true;
+  }
+  if (strcmp(name, "timing") == 0) {
+    if (strcmp(value, timing_mode_name(TIMING_BLOCKING)) == 0) {
+      config->timing.mode = TIMING_BLOCKING;
+    } else if (strcmp(value, timing_mode_name(TIMING_OVERLAP)) == 0) {
+      config->timing.mode = TIMING_OVERLAP;
+    } else {
+      panic("Invalid value for %s: %s (expected blocking or overlap)", name,
+            value);
+    }
+    return true;
+  }
+  if (strncmp(name, "dcache-l1-", 10) == 0 &&
+      strcmp(name, "dcache-l1-index") != 0) {
+    return set_cache_level_option(&config->cache.levels[CACHE_L1], name,
+                                  name + 10, value);
+  }
+  if (strncmp(name, "dcache-l2-", 10) == 0) {
+    return set_cache_level_option(&config->cache.levels[CACHE_L2], name,
+                                  name + 10, value);
+  }
+  if (strncmp(name, "dcache-llc-", 11) == 0) {
+    return set_cache_level_option(&config->cache.levels[CACHE_LLC], name,
+                                  name + 11, value);
+  }
+  if (strcmp(name, "dcache-l1-index") == 0) {
+    if (strcmp(value, cache_index_name(CACHE_INDEX_PHYSICAL)) == 0) {
+      config->cache.l1_index = CACHE_INDEX_PHYSICAL;
+    } else if (strcmp(value, cache_index_name(CACHE_INDEX_VIRTUAL)) == 0) {
+      config->cache.l1_index = CACHE_INDEX_VIRTUAL;
+    } else {
+      panic("Invalid value for %s: %s (expected physical or virtual)", name,
+            value);
+    }
+    return true;
+  }
+  if (strcmp(name, "dcache-write") == 0) {
+    if (strcmp(value, cache_write_policy_name(CACHE_WRITE_BACK)) == 0) {
+      config->cache.write = CACHE_WRITE_BACK;
+    } else if (strcmp(value, cache_write_policy_name(CACHE_WRITE_THROUGH)) ==
+               0) {
+      config->cache.write = CACHE_WRITE_THROUGH;
+    } else {
+      panic("Invalid value for %s: %s (expected back or through)", name,
+            value);
+    }
+    return true;
+  }
+  if (strcmp(name, "dcache-write-miss") == 0) {
+    if (strcmp(value, cache_write_miss_name(CACHE_WRITE_ALLOCATE)) == 0) {
+      config->cache.write_miss = CACHE_WRITE_ALLOCATE;
+    } else if (strcmp(value, cache_write_miss_name(CACHE_WRITE_AROUND)) == 0) {
+      config->cache.write_miss = CACHE_WRITE_AROUND;
+    } else {
+      panic("Invalid value for %s: %s (expected allocate or around)", name,
+            value);
+    }
+    return true;
+  }
+  if (strcmp(name, "walk-slots") == 0) {
+    config->timing.walk_slots = parse_unsigned(name, value);
+    return true;
+  }
+  if (strcmp(name, "io-slots") == 0) {
+    config->timing.io_slots = parse_unsigned(name, value);
+    return true;
+  }
+  return false;
+}
+
+void config_log(const sim_config_t* config) {
+  log_dbg("TLB L1:                %" PRIu64 " entries, %" PRIu64
+          " ways, %" PRIu64 " ns, %s",
+          config->tlb.l1.entries, config->tlb.l1.ways,
+          config->tlb.l1.latency_ns,
+          tlb_replacement_name(config->tlb.l1.replacement));
+  log_dbg("TLB L2:                %" PRIu64 " entries, %" PRIu64
+          " ways, %" PRIu64 " ns, %s",
+          config->tlb.l2.entries, config->tlb.l2.ways,
+          config->tlb.l2.latency_ns,
+          tlb_replacement_name(config->tlb.l2.replacement));
+  if (config->tlb.cores > 1) {
+    log_dbg("Cores:                 %u, shootdowns %" PRIu64
+            " ns + %" PRIu64 " ns per target core",
+            config->tlb.cores, config->tlb.shootdown_latency_ns,
+            config->tlb.shootdown_handler_ns);
+  }
+  if (config->tlb.asid_mode != TLB_ASID_TAGGED) {
+    log_dbg("ASID mode:             %s",
+            tlb_asid_mode_name(config->tlb.asid_mode));
+  }
+  if (config->tlb.prefetch.policy != TLB_PREFETCH_NONE) {
+    if (config->tlb.prefetch.target == TLB_PREFETCH_BUFFER) {
+      log_dbg("TLB prefetch:          %s, degree %" PRIu64
+              ", %" PRIu64 "-entry buffer",
+              tlb_prefetch_policy_name(config->tlb.prefetch.policy),
+              config->tlb.prefetch.degree,
+              config->tlb.prefetch.buffer_entries);
+    } else {
+      log_dbg("TLB prefetch:          %s, degree %" PRIu64 ", into L2",
+              tlb_prefetch_policy_name(config->tlb.prefetch.policy),
+              config->tlb.prefetch.degree);
+    }
+  }
+  log_dbg("Page replacement:      %s",
+          page_replacement_name(config->page_table.replacement));
+  log_dbg("Page walk:             %s (%d levels)",
+          page_walk_name(config->page_table.walk), PAGE_TABLE_LEVELS);
+  if (config->page_table.huge_pages != HUGE_PAGES_OFF) {
+    log_dbg("Huge pages:            %s (promote at %" PRIu64
+            " pages), TLB %s, L1 %" PRIu64 "x%" PRIu64 ", L2 %" PRIu64
+            "x%" PRIu64,
+            huge_pages_name(config->page_table.huge_pages),
+            config->page_table.huge_promote_threshold,
+            tlb_huge_name(config->tlb.huge), config->tlb.l1.huge_entries,
+            config->tlb.l1.huge_ways, config->tlb.l2.huge_entries,
+            config->tlb.l2.huge_ways);
+  }
+  if (config->page_table.walk_cache.entries) {
+    log_dbg("Page walk cache:       %" PRIu64 " entries, %" PRIu64
+            " ways, %" PRIu64 " ns",
+            config->page_table.walk_cache.entries,
+            config->page_table.walk_cache.ways,
+            config->page_table.walk_cache.latency_ns);
+  }
+  if (swap_config_changed(&config->page_table.swap)) {
+    log_dbg("Swap:                  %s, %" PRIu64 " slots, readahead %" PRIu64
+            " (%" PRIu64 "-slot cache), disk %s",
+            swap_placement_name(config->page_table.swap.placement),
+            config->page_table.swap.slots, config->page_table.swap.readahead,
+            config->page_table.swap.cache_entries,
+            swap_disk_name(config->page_table.swap.disk));
+  }
+  if (config->page_table.write_buffer.entries) {
+    log_dbg("Write buffer:          %" PRIu64 " pages, up to %" PRIu64
+            " pages per disk write",
+            config->page_table.write_buffer.entries,
+            config->page_table.write_buffer.batch);
+  }
+  for (cache_level_t level = CACHE_L1; level < CACHE_LEVELS; level++) {
+    const cache_level_config_t* cache = &config->cache.levels[level];
+    if (cache->size) {
+      log_dbg("Data cache %-3s:        %" PRIu64 " B, %" PRIu64
+              " B lines, %" PRIu64 " ways, %" PRIu64 " ns, write-%s, "
+              "write-%s",
+              cache_level_name(level), cache->size, cache->line_size,
+              cache->ways, cache->latency_ns,
+              cache_write_policy_name(config->cache.write),
+              cache_write_miss_name(config->cache.write_miss));
+    }
+  }
+  if (config->cache.l1_index != CACHE_INDEX_PHYSICAL) {
+    log_dbg("Data cache L1 index:   %s",
+            cache_index_name(config->cache.l1_index));
+  }
+  if (config->timing.mode != TIMING_BLOCKING) {
+    log_dbg("Timing:                %s, %u page walks and %u disk I/Os "
+            "outstanding per core",
+            timing_mode_name(config->timing.mode), config->timing.walk_slots,
+            config->timing.io_slots);
+  }
+}
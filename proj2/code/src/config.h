@@ -0,0 +1,43 @@
+#pragma once
+
+#include <getopt.h>
+#include <stdbool.h>
+
+#include "cache.h"
+#include "page_table.h"
+#include "tlb.h"
+
+// Simulator parameters that can be changed at runtime, either from the command
+// line (--name value) or from a sweep file (name=value).
+typedef struct {
+  tlb_config_t tlb;
+  page_table_config_t page_table;
+  timing_config_t timing;
+  cache_config_t cache;
+} sim_config_t;
+
+#define SIM_DEFAULT_CONFIG                 \
+  ((sim_config_t){                         \
+      .tlb = TLB_DEFAULT_CONFIG,           \
+      .page_table = PAGE_TABLE_DEFAULT_CONFIG, \
+      .timing = TIMING_DEFAULT_CONFIG,     \
+      .cache = CACHE_DEFAULT_CONFIG,       \
+  })
+
+// getopt_long() descriptions of every option accepted by config_set_option(),
+// terminated by an all-zero entry. All of them take an argument and return 0.
+extern const struct option config_options[];
+
+// Sets option `name` (without the leading "--") to `value`.
+// Returns false if the option is unknown, panics if the value is invalid.
+bool config_set_option(sim_config_t* config, const char* name, const char* value);
+
+// Parses an unsigned number (decimal, 0x hexadecimal or 0 octal) for option
+// `name`. Panics unless the whole value is a number that fits, without sign.
+uint64_t parse_u64(const char* name, const char* value);
+
+// Same as parse_u64(), for options stored in an unsigned.
+unsigned parse_unsigned(const char* name, const char* value);
+
+// Logs the configuration to stderr.
+void config_log(const sim_config_t* config);
@@ -7,7 +7,11 @@
 // The total amount of available virtual memory is determined by the number of
 // bits of the virtual address. For example, a 32-bit virtual address space can
 // address 2^32 bytes of memory, or 4 GiB.
+// It can be overridden at build time (e.g. make VIRTUAL_ADDRESS_BITS=48) to
+// model x86-64 style 48-bit or 57-bit address spaces.
+#ifndef VIRTUAL_ADDRESS_BITS
 #define VIRTUAL_ADDRESS_BITS 32
+#endif
 
 // This is the size of a page, expressed as the exponent of a power of two of
 // the total page size in bytes. A page is a fixed-length contiguous block of
@@ -36,13 +40,38 @@
 // hardware.
 #define DISK_ADDRESS_BITS 48
 
+// The page table is a radix tree. Each level translates PAGE_TABLE_LEVEL_BITS
+// bits of the virtual page number: 512 entries of 8 bytes fill one 4 KiB page,
+// as on x86-64, so a 48-bit address space needs 4 levels and a 57-bit one 5.
+#define PAGE_TABLE_LEVEL_BITS 9
+
+// A huge page is mapped by an entry of the level above the leaves of the page
+// table, so it covers 2^PAGE_TABLE_LEVEL_BITS pages (2 MiB with 4 KiB pages).
+#define HUGE_PAGE_ORDER PAGE_TABLE_LEVEL_BITS
+
+// Largest number of simulated cores, each with its own TLBs and clock.
+#define MAX_CORES 64
+
+// Address spaces are identified by 12-bit ASIDs, like x86 PCIDs. Pages of
+// every address space are keyed by the ASID above the virtual page number, so
+// VIRTUAL_ADDRESS_BITS - PAGE_SIZE_BITS + ASID_BITS must fit in 64 bits.
+#define ASID_BITS 12
+
 #define TLB_L1_SIZE 32
 #define TLB_L2_SIZE 512
+#define TLB_L1_HUGE_SIZE 32
+#define TLB_L2_HUGE_SIZE 32
 
 #define TLB_L1_LATENCY_NS 1
 #define TLB_L2_LATENCY_NS 2
+#define TLB_SHOOTDOWN_LATENCY_NS 1000
+#define TLB_SHOOTDOWN_HANDLER_NS 500
+#define PARALLEL_WINDOW_NS 10000
 #define DRAM_LATENCY_NS 100
 #define DISK_LATENCY_NS 1000000
+// Transfer of a page that follows the previous one on disk, without a seek
+// (disk model "seek" only).
+#define DISK_SEQUENTIAL_LATENCY_NS 20000
 
 // ========================================================================
 // Constants defined from the constants above.
@@ -58,9 +87,16 @@
 #define DISK_PAGE_CAPACITY \
   (uint64_t)(1llu << (DISK_ADDRESS_BITS - PAGE_SIZE_BITS))
 #define TOTAL_PAGES (uint64_t)(1llu << (VIRTUAL_ADDRESS_BITS - PAGE_SIZE_BITS))
+#define HUGE_PAGE_SIZE_BITS (PAGE_SIZE_BITS + HUGE_PAGE_ORDER)
+#define HUGE_PAGE_PAGES (uint64_t)(1llu << HUGE_PAGE_ORDER)
+#define PAGE_TABLE_LEVELS                                          \
+  ((VIRTUAL_ADDRESS_BITS - PAGE_SIZE_BITS + PAGE_TABLE_LEVEL_BITS - 1) / \
+   PAGE_TABLE_LEVEL_BITS)
 
 #define VIRTUAL_ADDRESS_MASK (VIRTUAL_SIZE_BYTES - 1)
 #define DRAM_ADDRESS_MASK (DRAM_SIZE_BYTES - 1)
 #define DISK_ADDRESS_MASK (DISK_SIZE_BYTES - 1)
 #define PAGE_INDEX_MASK (TOTAL_PAGES - 1)
 #define PAGE_OFFSET_MASK (PAGE_SIZE_BYTES - 1)
+#define HUGE_PAGE_OFFSET_MASK ((1llu << HUGE_PAGE_SIZE_BITS) - 1)
+#define MAX_ASIDS (1u << ASID_BITS)
@@ -0,0 +1,160 @@
+#include "event.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "log.h"
+
+#define EVENT_BUFFER_SIZE (1 << 20)
+
+// Longest encoding of a record: the header byte and three 64-bit varints.
+#define EVENT_MAX_RECORD_SIZE (1 + 3 * 10)
+
+FILE* event_file = NULL;
+unsigned event_core = 0;
+time_ns_t event_previous_times[MAX_CORES];
+
+static inline size_t encode_varint(uint64_t value, uint8_t* out) {
+  size_t size = 0;
+  while (value >= 0x80) {
+    out[size++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  out[size++] = value;
+  return size;
+}
+
+static inline bool decode_varint(const uint8_t** cursor, const uint8_t* end,
+                                 uint64_t* value) {
+  *value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    if (*cursor == end) {
+      return false;
+    }
+    uint8_t byte = *(*cursor)++;
+    *value |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void event_open(const char* path) {
+  event_file = fopen(path, "wb");
+  if (!event_file) {
+    panic("Failed to create events file %s", path);
+  }
+  setvbuf(event_file, NULL, _IOFBF, EVENT_BUFFER_SIZE);
+  fwrite(EVENT_MAGIC, 1, EVENT_MAGIC_SIZE, event_file);
+  event_core = 0;
+  memset(event_previous_times, 0, sizeof(event_previous_times));
+}
+
+void event_close() {
+  if (!event_file) {
+    return;
+  }
+  if (ferror(event_file) | fclose(event_file)) {
+    panic("Failed to write events file");
+  }
+  event_file = NULL;
+}
+
+static void write_record(event_kind_t kind, op_t op, unsigned level,
+                         time_ns_t delta, uint64_t value, uint64_t frame) {
+  uint8_t buffer[EVENT_MAX_RECORD_SIZE];
+  size_t size = 0;
+  buffer[size++] = (level << 5) | ((op == OP_WRITE) << 4) | kind;
+  size += encode_varint(delta, buffer + size);
+  size += encode_varint(value, buffer + size);
+  size += encode_varint(frame, buffer + size);
+  fwrite(buffer, 1, size, event_file);
+}
+
+void event_write(event_kind_t kind, op_t op, unsigned level, uint64_t value,
+                 uint64_t frame) {
+  unsigned core = get_current_core();
+  if (core != event_core) {
+    write_record(EVENT_CORE, OP_READ, 0, 0, core, 0);
+    event_core = core;
+  }
+
+  time_ns_t time = get_time();
+  write_record(kind, op, level, time - event_previous_times[core], value,
+               frame);
+  event_previous_times[core] = time;
+}
+
+void event_reader_open(const char* path, event_reader_t* reader) {
+  memset(reader, 0, sizeof(*reader));
+  reader->path = path;
+
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    panic("Failed to open events file %s", path);
+  }
+
+  struct stat st;
+  if (fstat(fileno(file), &st) != 0 || (size_t)st.st_size < EVENT_MAGIC_SIZE) {
+    panic("Invalid events file %s", path);
+  }
+
+  void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+  fclose(file);
+  if (data == MAP_FAILED) {
+    panic("Failed to map events file %s", path);
+  }
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+  if (memcmp(data, EVENT_MAGIC, EVENT_MAGIC_SIZE) != 0) {
+    panic("Invalid events file %s", path);
+  }
+
+  reader->data = data;
+  reader->size = st.st_size;
+  reader->cursor = reader->data + EVENT_MAGIC_SIZE;
+}
+
+bool event_next(event_reader_t* reader, event_t* event) {
+  const uint8_t* end = reader->data + reader->size;
+  while (reader->cursor != end) {
+    const uint8_t* cursor = reader->cursor;
+    uint8_t header = *cursor++;
+    uint64_t delta;
+    if (!decode_varint(&cursor, end, &delta) ||
+        !decode_varint(&cursor, end, &event->value) ||
+        !decode_varint(&cursor, end, &event->frame) ||
+        (header & 0x0f) >= EVENT_KINDS) {
+      panic("Truncated events file %s", reader->path);
+    }
+    reader->cursor = cursor;
+
+    if ((header & 0x0f) == EVENT_CORE) {
+      if (event->value >= MAX_CORES) {
+        panic("Invalid core %" PRIu64 " in events file %s", event->value,
+              reader->path);
+      }
+      reader->core = event->value;
+      continue;
+    }
+
+    reader->times[reader->core] += delta;
+    event->time = reader->times[reader->core];
+    event->core = reader->core;
+    event->kind = header & 0x0f;
+    event->op = (header & 0x10) ? OP_WRITE : OP_READ;
+    event->level = header >> 5;
+    return true;
+  }
+  return false;
+}
+
+void event_reader_close(event_reader_t* reader) {
+  if (reader->data) {
+    munmap((void*)reader->data, reader->size);
+  }
+  memset(reader, 0, sizeof(*reader));
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "clock.h"
+#include "constants.h"
+#include "memory.h"
+
+// Binary event stream (--events FILE), decoded offline by build/tlbevents.
+//
+// EVENT_MAGIC, then one variable-length record per event:
+//
+//   byte 0:  [level:3][op:1][kind:4]
+//   varint:  time elapsed since the previous event of the same core, in ns
+//   varint:  value (address or VPN, see event_kind_t)
+//   varint:  frame (physical page number, when the event has one)
+//
+// Events belong to core 0 until an EVENT_CORE record switches cores. Every
+// core has its own clock, so times only increase within a core.
+//
+// Varints are LEB128. Most events take 5 to 10 bytes, instead of ~25 for the
+// text log.
+#define EVENT_MAGIC "TLBEVT01"
+#define EVENT_MAGIC_SIZE 8
+
+typedef enum {
+  EVENT_INSTRUCTION,  // op, value = virtual address
+  EVENT_DRAM,         // op, value = DRAM address
+  EVENT_DISK,         // op, value = disk address
+  EVENT_TLB_HIT,      // level (1 or 2), value = VPN, frame
+  EVENT_TLB_MISS,     // level (1 or 2), value = VPN
+  EVENT_PAGE_FAULT,   // value = VPN, frame it is mapped to
+  EVENT_EVICTION,     // op = OP_WRITE if dirty, value = VPN, frame it freed
+  EVENT_CORE,         // value = core of the next events (not returned)
+  EVENT_CONTEXT_SWITCH,  // value = ASID the core switches to
+  EVENT_KINDS,
+} event_kind_t;
+
+typedef struct {
+  time_ns_t time;
+  unsigned core;
+  event_kind_t kind;
+  op_t op;
+  uint8_t level;
+  uint64_t value;
+  uint64_t frame;
+} event_t;
+
+// Output stream, NULL when events are not recorded.
+extern FILE* event_file;
+
+// Starts recording events to a file. Panics on error.
+void event_open(const char* path);
+void event_close();
+
+void event_write(event_kind_t kind, op_t op, unsigned level, uint64_t value,
+                 uint64_t frame);
+
+// Records an event at the current time, if events are recorded.
+static inline void event_emit(event_kind_t kind, op_t op, unsigned level,
+                              uint64_t value, uint64_t frame) {
+  if (event_file) {
+    event_write(kind, op, level, value, frame);
+  }
+}
+
+// Sequential reader over an event file, memory-mapped like binary traces.
+typedef struct {
+  const char* path;
+  const uint8_t* data;
+  size_t size;
+  const uint8_t* cursor;
+  unsigned core;
+  time_ns_t times[MAX_CORES];
+} event_reader_t;
+
+// Opens an event file. Panics on error.
+void event_reader_open(const char* path, event_reader_t* reader);
+
+// Reads the next event. Returns false at the end of the file, panics if the
+// file is malformed.
+bool event_next(event_reader_t* reader, event_t* event);
+void event_reader_close(event_reader_t* reader);
@@ -0,0 +1,69 @@
+#include "job.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "log.h"
+
+unsigned job_default_count() {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  return cpus > 0 ? (unsigned)cpus : 1;
+}
+
+job_t job_start(job_fn_t fn, void* arg, size_t result_size) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    panic("Failed to create job pipe");
+  }
+
+  // Flush before forking so buffered output is not duplicated by the child.
+  fflush(stdout);
+  fflush(stderr);
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    panic("Failed to fork job");
+  }
+
+  if (pid == 0) {
+    close(fds[0]);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    dup2(devnull, STDERR_FILENO);
+
+    void* result = calloc(1, result_size);
+    if (!result) {
+      _exit(EXIT_FAILURE);
+    }
+    fn(arg, result);
+
+    // The parent drains the pipe in job_finish() before waiting, so results
+    // larger than PIPE_BUF do not block.
+    FILE* pipe_out = fdopen(fds[1], "w");
+    bool sent = pipe_out && fwrite(result, result_size, 1, pipe_out) == 1 &&
+                fclose(pipe_out) == 0;
+    _exit(sent ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  close(fds[1]);
+  return (job_t){pid, fds[0], result_size};
+}
+
+bool job_finish(job_t* job, void* result) {
+  FILE* pipe_in = fdopen(job->fd, "r");
+  bool received = pipe_in && fread(result, job->result_size, 1, pipe_in) == 1;
+  if (pipe_in) {
+    fclose(pipe_in);
+  } else {
+    close(job->fd);
+  }
+
+  int status;
+  if (waitpid(job->pid, &status, 0) != job->pid) {
+    return false;
+  }
+  return received && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Forked worker processes.
+// Kept apart from memory.h, whose read()/write() clash with <unistd.h>. Since
+// they also replace the libc symbols at link time, pipes are accessed through
+// stdio only.
+
+typedef struct {
+  pid_t pid;
+  int fd;
+  size_t result_size;
+} job_t;
+
+// Number of online host CPUs, the default number of parallel jobs.
+unsigned job_default_count();
+
+typedef void (*job_fn_t)(void* arg, void* result);
+
+// Runs fn(arg, result) in a child process whose stdout/stderr are discarded.
+// The child inherits a copy-on-write snapshot of the parent's memory.
+job_t job_start(job_fn_t fn, void* arg, size_t result_size);
+
+// Waits for the child and copies its result. Returns false if it failed.
+bool job_finish(job_t* job, void* result);
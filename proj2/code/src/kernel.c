@@ -0,0 +1,366 @@
+#include "kernel.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "log.h"
+
+#define KERNEL_NAME_SIZE 16
+
+const char* kernel_name(kernel_id_t id) {
+  switch (id) {
+    case KERNEL_SPARK:
+      return "spark";
+    case KERNEL_CM1:
+      return "cm1";
+    case KERNEL_CM2:
+      return "cm2";
+    case KERNEL_MM1:
+      return "mm1";
+    case KERNEL_MM2:
+      return "mm2";
+    case KERNEL_MM3:
+      return "mm3";
+  }
+  return "?";
+}
+
+static inline bool is_power_of_two(uint64_t x) {
+  return x && (x & (x - 1)) == 0;
+}
+
+void kernel_parse(const char* spec, kernel_config_t* config) {
+  char name[KERNEL_NAME_SIZE];
+  size_t length = strcspn(spec, ",");
+  if (length >= KERNEL_NAME_SIZE) {
+    panic("Unknown kernel %s", spec);
+  }
+  memcpy(name, spec, length);
+  name[length] = '\0';
+
+  kernel_id_t id;
+  for (id = KERNEL_SPARK; id <= KERNEL_MM3; id++) {
+    if (strcmp(name, kernel_name(id)) == 0) {
+      break;
+    }
+  }
+  switch (id) {
+    case KERNEL_SPARK:
+      *config = (kernel_config_t){id, 4 << 10, 4 << 20, 100, 0, 0};
+      break;
+    case KERNEL_CM1:
+      *config = (kernel_config_t){id, 8 << 10, 64 << 10, 200, 0, 0};
+      break;
+    case KERNEL_CM2:
+      *config = (kernel_config_t){id, 64 << 10, 2 << 20, 200, 0, 0};
+      break;
+    case KERNEL_MM1:
+    case KERNEL_MM2:
+    case KERNEL_MM3:
+      *config = (kernel_config_t){id, 0, 0, 0, 512, 32};
+      break;
+    default:
+      panic("Unknown kernel %s (expected spark, cm1, cm2, mm1, mm2 or mm3)",
+            name);
+  }
+
+  for (const char* option = spec + length; *option;) {
+    option++;
+    char* end;
+    const char* value = strchr(option, '=');
+    uint64_t parsed = value ? strtoull(value + 1, &end, 0) : 0;
+    if (!value || value[1] < '0' || value[1] > '9' ||
+        (*end != ',' && *end != '\0')) {
+      panic("Invalid kernel option in %s (expected key=value)", spec);
+    }
+
+    size_t key_length = value - option;
+    if (key_length == 3 && strncmp(option, "min", 3) == 0) {
+      config->min = parsed;
+    } else if (key_length == 3 && strncmp(option, "max", 3) == 0) {
+      config->max = parsed;
+    } else if (key_length == 6 && strncmp(option, "repeat", 6) == 0) {
+      config->repeat = parsed;
+    } else if (key_length == 1 && strncmp(option, "n", 1) == 0) {
+      config->n = parsed;
+    } else if (key_length == 5 && strncmp(option, "block", 5) == 0) {
+      config->block = parsed;
+    } else {
+      panic("Unknown kernel option in %s (expected min, max, repeat, n or "
+            "block)",
+            spec);
+    }
+    option = end;
+  }
+
+  if (id <= KERNEL_CM2 && (!is_power_of_two(config->min) || config->min < 2 ||
+                           !is_power_of_two(config->max) ||
+                           config->min > config->max)) {
+    panic("Invalid stride sweep in %s: %" PRIu64 " to %" PRIu64
+          " B (expected powers of two, from 2 B)",
+          spec, config->min, config->max);
+  }
+  if (id >= KERNEL_MM1 &&
+      (config->n == 0 || config->block == 0 || config->n % config->block)) {
+    panic("Invalid matrices in %s: %" PRIu64 " x %" PRIu64 ", blocks of %" PRIu64
+          " (expected a block size that divides n)",
+          spec, config->n, config->n, config->block);
+  }
+}
+
+void kernel_start(kernel_t* kernel, const kernel_config_t* config) {
+  memset(kernel, 0, sizeof(*kernel));
+  kernel->config = *config;
+  if (config->id <= KERNEL_CM2) {
+    kernel->loop[0] = config->min;
+    kernel->loop[1] = 1;
+    kernel->limit = config->min;
+    kernel->repeats = config->repeat + 1;
+  }
+}
+
+static inline void kernel_emit(kernel_t* kernel, op_t op, va_t address) {
+  kernel->ops[kernel->count] = op;
+  kernel->addresses[kernel->count] = address;
+  kernel->count++;
+}
+
+// Array `index` of the matrix products, each of n x n int16.
+static inline va_t kernel_matrix(const kernel_t* kernel, unsigned index) {
+  uint64_t bytes = kernel->config.n * kernel->config.n * sizeof(int16_t);
+  uint64_t stride = (bytes + PAGE_SIZE_BYTES - 1) & ~(PAGE_SIZE_BYTES - 1);
+  return KERNEL_BASE_ADDRESS + index * stride;
+}
+
+static inline va_t kernel_element(const kernel_t* kernel, va_t matrix,
+                                  uint64_t row, uint64_t column) {
+  return matrix + (row * kernel->config.n + column) * sizeof(int16_t);
+}
+
+// Moves nested loop counters (outermost first) to their next iteration, each
+// going from 0 below limits[i] by steps[i]. Returns false once they all wrap.
+bool kernel_advance(uint64_t* loop, const uint64_t* limits,
+                    const uint64_t* steps, unsigned depth) {
+  for (unsigned i = depth; i-- > 0;) {
+    loop[i] += steps[i];
+    if (loop[i] < limits[i]) {
+      return true;
+    }
+    loop[i] = 0;
+  }
+  return false;
+}
+
+// Iterations of nested loop counters (see kernel_advance()) before they all
+// wrap, the current one included.
+uint64_t kernel_iterations_left(const uint64_t* loop, const uint64_t* limits,
+                                const uint64_t* steps, unsigned depth) {
+  uint64_t done = 0;
+  uint64_t total = 1;
+  for (unsigned i = 0; i < depth; i++) {
+    uint64_t radix = limits[i] / steps[i];
+    done = done * radix + loop[i] / steps[i];
+    total *= radix;
+  }
+  return total - done;
+}
+
+// Same as `iterations` calls of kernel_advance(), as long as the counters do
+// not all wrap.
+void kernel_advance_by(uint64_t* loop, const uint64_t* limits,
+                       const uint64_t* steps, unsigned depth,
+                       uint64_t iterations) {
+  for (unsigned i = depth; i-- > 0 && iterations;) {
+    uint64_t radix = limits[i] / steps[i];
+    uint64_t digit = loop[i] / steps[i] + iterations;
+    iterations = digit / radix;
+    loop[i] = digit % radix * steps[i];
+  }
+}
+
+void stride_sweep_step(kernel_t* kernel) {
+  uint64_t* size = &kernel->loop[0];
+  uint64_t* stride = &kernel->loop[1];
+  uint64_t* repeat = &kernel->loop[2];
+  uint64_t* index = &kernel->loop[3];
+
+  kernel_emit(kernel, OP_READ, KERNEL_BASE_ADDRESS + *index);
+  kernel_emit(kernel, OP_WRITE, KERNEL_BASE_ADDRESS + *index);
+
+  *index += *stride;
+  if (*index < kernel->limit) {
+    return;
+  }
+  *index = 0;
+  if (++*repeat < kernel->repeats) {
+    return;
+  }
+  *repeat = 0;
+  *stride *= 2;
+  if (*stride > *size / 2) {
+    *stride = 1;
+    *size *= 2;
+    if (*size > kernel->config.max) {
+      kernel->done = true;
+      return;
+    }
+  }
+  kernel->limit = *size - *stride + 1;
+  kernel->repeats = kernel->config.repeat * *stride + 1;
+}
+
+// One iteration of res[i][j] += factor1[i][k] * factor2[k][j], or of
+// factor2[j][k] if transposed.
+void multiply_step(kernel_t* kernel, uint64_t i, uint64_t j, uint64_t k,
+                   bool transposed) {
+  va_t factor2 = transposed ? kernel_matrix(kernel, 3) : kernel_matrix(kernel, 1);
+  kernel_emit(kernel, OP_READ,
+              kernel_element(kernel, kernel_matrix(kernel, 0), i, k));
+  kernel_emit(kernel, OP_READ,
+              transposed ? kernel_element(kernel, factor2, j, k)
+                         : kernel_element(kernel, factor2, k, j));
+  kernel_emit(kernel, OP_READ,
+              kernel_element(kernel, kernel_matrix(kernel, 2), i, j));
+  kernel_emit(kernel, OP_WRITE,
+              kernel_element(kernel, kernel_matrix(kernel, 2), i, j));
+}
+
+void matrix_step(kernel_t* kernel) {
+  uint64_t n = kernel->config.n;
+  uint64_t block = kernel->config.block;
+  uint64_t* loop = kernel->loop;
+  bool more;
+
+  switch (kernel->config.id) {
+    case KERNEL_MM2:
+      if (kernel->phase == 0) {
+        // transpose[i][j] = factor2[j][i]
+        kernel_emit(kernel, OP_READ,
+                    kernel_element(kernel, kernel_matrix(kernel, 1), loop[1],
+                                   loop[0]));
+        kernel_emit(kernel, OP_WRITE,
+                    kernel_element(kernel, kernel_matrix(kernel, 3), loop[0],
+                                   loop[1]));
+        if (!kernel_advance(loop, (uint64_t[]){n, n}, (uint64_t[]){1, 1}, 2)) {
+          kernel->phase = 1;
+        }
+        return;
+      }
+      // fallthrough
+    case KERNEL_MM1:
+      multiply_step(kernel, loop[0], loop[1], loop[2],
+                    kernel->config.id == KERNEL_MM2);
+      more = kernel_advance(loop, (uint64_t[]){n, n, n},
+                            (uint64_t[]){1, 1, 1}, 3);
+      break;
+    case KERNEL_MM3:
+      // i, j, k by blocks, then inner_i, inner_k, inner_j
+      multiply_step(kernel, loop[0] + loop[3], loop[1] + loop[5],
+                    loop[2] + loop[4], false);
+      more = kernel_advance(
+          loop, (uint64_t[]){n, n, n, block, block, block},
+          (uint64_t[]){block, block, block, 1, 1, 1}, 6);
+      break;
+    default:
+      more = false;
+      break;
+  }
+  kernel->done = !more;
+}
+
+// Generates the accesses of the next iteration.
+void kernel_step(kernel_t* kernel) {
+  kernel->count = 0;
+  kernel->next = 0;
+  if (kernel->config.id <= KERNEL_CM2) {
+    stride_sweep_step(kernel);
+  } else {
+    matrix_step(kernel);
+  }
+}
+
+// Skips whole iterations, up to `references` accesses, without generating
+// them. The last iteration of a loop nest is left to kernel_step(), which
+// moves to the next one. Returns the accesses skipped.
+uint64_t kernel_jump(kernel_t* kernel, uint64_t references) {
+  uint64_t n = kernel->config.n;
+  uint64_t block = kernel->config.block;
+  uint64_t* loop = kernel->loop;
+  uint64_t iterations;
+
+  switch (kernel->config.id) {
+    case KERNEL_SPARK:
+    case KERNEL_CM1:
+    case KERNEL_CM2:
+      // Within one pass over the array, 2 accesses per iteration
+      iterations = (kernel->limit - 1 - loop[3]) / loop[1];
+      iterations = iterations < references / 2 ? iterations : references / 2;
+      loop[3] += iterations * loop[1];
+      return 2 * iterations;
+    case KERNEL_MM2:
+      if (kernel->phase == 0) {
+        uint64_t limits[] = {n, n};
+        uint64_t steps[] = {1, 1};
+        iterations = kernel_iterations_left(loop, limits, steps, 2) - 1;
+        iterations = iterations < references / 2 ? iterations : references / 2;
+        kernel_advance_by(loop, limits, steps, 2, iterations);
+        return 2 * iterations;
+      }
+      // fallthrough
+    case KERNEL_MM1: {
+      uint64_t limits[] = {n, n, n};
+      uint64_t steps[] = {1, 1, 1};
+      iterations = kernel_iterations_left(loop, limits, steps, 3) - 1;
+      iterations = iterations < references / 4 ? iterations : references / 4;
+      kernel_advance_by(loop, limits, steps, 3, iterations);
+      return 4 * iterations;
+    }
+    case KERNEL_MM3: {
+      uint64_t limits[] = {n, n, n, block, block, block};
+      uint64_t steps[] = {block, block, block, 1, 1, 1};
+      iterations = kernel_iterations_left(loop, limits, steps, 6) - 1;
+      iterations = iterations < references / 4 ? iterations : references / 4;
+      kernel_advance_by(loop, limits, steps, 6, iterations);
+      return 4 * iterations;
+    }
+  }
+  return 0;
+}
+
+uint64_t kernel_skip(kernel_t* kernel, uint64_t references) {
+  uint64_t skipped = 0;
+  while (skipped < references) {
+    if (kernel->next == kernel->count) {
+      if (kernel->done) {
+        break;
+      }
+      skipped += kernel_jump(kernel, references - skipped);
+      if (skipped == references) {
+        break;
+      }
+      kernel_step(kernel);
+    }
+    uint64_t left = kernel->count - kernel->next;
+    if (left > references - skipped) {
+      left = references - skipped;
+    }
+    kernel->next += left;
+    skipped += left;
+  }
+  return skipped;
+}
+
+bool kernel_next(kernel_t* kernel, op_t* op, va_t* address) {
+  if (kernel->next == kernel->count) {
+    if (kernel->done) {
+      return false;
+    }
+    kernel_step(kernel);
+  }
+
+  *op = kernel->ops[kernel->next];
+  *address = kernel->addresses[kernel->next];
+  kernel->next++;
+  return true;
+}
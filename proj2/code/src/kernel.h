@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "memory.h"
+
+// Built-in address streams of the proj1 benchmark kernels, read like an
+// instructions file named "kernel:NAME[,key=value...]" (core 0, ASID 0):
+//
+// - spark, cm1, cm2: the stride sweep. For every array size from `min` to
+//   `max` bytes (powers of two), and every stride from 1 to size / 2, the
+//   loop `array[index] = array[index] + 1` over index = 0, stride, ... below
+//   size - stride + 1, repeated repeat * stride + 1 times (spark's warm-up
+//   pass and its timed passes, or cm's `repeat <= N * stride`). Every
+//   iteration reads then writes one byte. spark: 4 KiB to 4 MiB, repeat 100;
+//   cm1: 8 KiB to 64 KiB, repeat 200; cm2: 64 KiB to 2 MiB, repeat 200.
+// - mm1, mm2, mm3: `res[i][j] += factor1[i][k] * factor2[k][j]` on n x n
+//   int16 matrices (n = 512), the naive i, j, k loops, after transposing
+//   factor2 (mm2, which multiplies by the transpose, factor2[j][k]), or by
+//   blocks of `block` x `block` (mm3, block = 32 for 64-byte lines). Every
+//   iteration reads factor1, factor2 and res, then writes res, like the -O1
+//   builds measured with PAPI (3 loads and 1 store per iteration). The
+//   transposition reads factor2[j][i] and writes the transpose[i][j].
+//
+// Arrays are page-aligned, one after the other from KERNEL_BASE_ADDRESS.
+#define KERNEL_PREFIX "kernel:"
+#define KERNEL_BASE_ADDRESS 0x10000000llu
+
+typedef enum {
+  KERNEL_SPARK,
+  KERNEL_CM1,
+  KERNEL_CM2,
+  KERNEL_MM1,
+  KERNEL_MM2,
+  KERNEL_MM3,
+} kernel_id_t;
+
+typedef struct {
+  kernel_id_t id;
+  // Stride sweeps.
+  uint64_t min;
+  uint64_t max;
+  uint64_t repeat;
+  // Matrix products.
+  uint64_t n;
+  uint64_t block;
+} kernel_config_t;
+
+typedef struct {
+  kernel_config_t config;
+  bool done;
+
+  // Loop counters, outermost first, and the bounds the sweep derives.
+  uint64_t loop[6];
+  uint64_t limit;
+  uint64_t repeats;
+
+  // mm2: transposing (0) or multiplying (1).
+  unsigned phase;
+
+  // Accesses of the current iteration not returned yet.
+  op_t ops[4];
+  va_t addresses[4];
+  unsigned count;
+  unsigned next;
+} kernel_t;
+
+const char* kernel_name(kernel_id_t id);
+
+// Parses the part of an instructions file name after KERNEL_PREFIX. Panics
+// if it is invalid.
+void kernel_parse(const char* spec, kernel_config_t* config);
+
+void kernel_start(kernel_t* kernel, const kernel_config_t* config);
+
+// Next access of the stream. Returns false at its end.
+bool kernel_next(kernel_t* kernel, op_t* op, va_t* address);
+
+// Skips the next `references` accesses of the stream, without generating
+// most of them. Returns the number skipped, fewer at its end.
+uint64_t kernel_skip(kernel_t* kernel, uint64_t references);
@@ -0,0 +1,68 @@
+#include "log.h"
+
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LOG_BUFFER_SIZE (1 << 20)
+
+bool log_enabled[LOG_CATEGORIES] = {true, true, true};
+FILE* log_debug_stream = NULL;
+
+static const char* log_category_names[LOG_CATEGORIES] = {
+    [LOG_EVENTS] = "events",
+    [LOG_DEBUG] = "debug",
+    [LOG_INSTRUCTIONS] = "instructions",
+};
+
+static char stdout_buffer[LOG_BUFFER_SIZE];
+static char stderr_buffer[LOG_BUFFER_SIZE];
+
+bool same_file(FILE* a, FILE* b) {
+  struct stat stat_a, stat_b;
+  if (fstat(fileno(a), &stat_a) != 0 || fstat(fileno(b), &stat_b) != 0) {
+    return false;
+  }
+  return stat_a.st_dev == stat_b.st_dev && stat_a.st_ino == stat_b.st_ino;
+}
+
+void log_init() {
+  // Terminals keep their default buffering, to see the lines as they come.
+  if (!isatty(fileno(stdout))) {
+    setvbuf(stdout, stdout_buffer, _IOFBF, LOG_BUFFER_SIZE);
+  }
+  if (!isatty(fileno(stderr))) {
+    setvbuf(stderr, stderr_buffer, _IOFBF, LOG_BUFFER_SIZE);
+  }
+  log_debug_stream = same_file(stdout, stderr) ? stdout : stderr;
+}
+
+bool log_set_categories(const char* list) {
+  bool enabled[LOG_CATEGORIES] = {false};
+
+  const char* name = list;
+  while (*name) {
+    size_t length = strcspn(name, ",");
+
+    bool found = false;
+    for (int category = 0; category < LOG_CATEGORIES; category++) {
+      bool all = length == 3 && strncmp(name, "all", 3) == 0;
+      if (all || (strlen(log_category_names[category]) == length &&
+                  strncmp(name, log_category_names[category], length) == 0)) {
+        enabled[category] = true;
+        found = true;
+      }
+    }
+    if (!found && !(length == 4 && strncmp(name, "none", 4) == 0)) {
+      return false;
+    }
+
+    name += length;
+    if (*name == ',') {
+      name++;
+    }
+  }
+
+  memcpy(log_enabled, enabled, sizeof(enabled));
+  return true;
+}
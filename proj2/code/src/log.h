@@ -1,26 +1,81 @@
 #pragma once
 
 #include <inttypes.h>
+#include <stdbool.h>
 #include <stdio.h>
 
 #include "clock.h"
 
+// Log categories, each of which can be turned off at runtime (--log) or
+// compiled out (-DLOG_DISABLE_EVENTS, ...; see the Makefile).
+// events: timestamped DRAM and disk accesses, on stdout (log_clk).
+// debug: simulator internals, on stderr (log_dbg).
+// instructions: every instruction of the trace, on stderr (log_instr).
+// The report (log) and panics are always printed.
+typedef enum {
+  LOG_EVENTS,
+  LOG_DEBUG,
+  LOG_INSTRUCTIONS,
+  LOG_CATEGORIES,
+} log_category_t;
+
+extern bool log_enabled[LOG_CATEGORIES];
+
+// Stream of the stderr categories: stderr, or stdout when both go to the same
+// file, so that the lines stay in order.
+extern FILE* log_debug_stream;
+
+// Gives stdout and stderr large buffers, unless they are terminals: lines are
+// no longer flushed one by one, only when a buffer fills up and at exit.
+// Call before logging anything.
+void log_init();
+
+// Enables the categories of a comma-separated list ("all", "none", or
+// category names) and disables the others. Returns false on an unknown name.
+bool log_set_categories(const char* list);
+
+#ifdef LOG_DISABLE_EVENTS
+#define LOG_EVENTS_ENABLED false
+#else
+#define LOG_EVENTS_ENABLED log_enabled[LOG_EVENTS]
+#endif
+
+#ifdef LOG_DISABLE_DEBUG
+#define LOG_DEBUG_ENABLED false
+#else
+#define LOG_DEBUG_ENABLED log_enabled[LOG_DEBUG]
+#endif
+
+#ifdef LOG_DISABLE_INSTRUCTIONS
+#define LOG_INSTRUCTIONS_ENABLED false
+#else
+#define LOG_INSTRUCTIONS_ENABLED log_enabled[LOG_INSTRUCTIONS]
+#endif
+
 #define log(fmt, ...)                \
   do {                               \
     printf(fmt "\n", ##__VA_ARGS__); \
-    fflush(stdout);                  \
   } while (0);
 
-#define log_clk(fmt, ...)                                         \
-  do {                                                            \
-    printf("[%" PRIu64 "] " fmt "\n", get_time(), ##__VA_ARGS__); \
-    fflush(stdout);                                               \
+#define log_clk(fmt, ...)                                           \
+  do {                                                              \
+    if (LOG_EVENTS_ENABLED) {                                       \
+      printf("[%" PRIu64 "] " fmt "\n", get_time(), ##__VA_ARGS__); \
+    }                                                               \
+  } while (0);
+
+#define log_dbg(fmt, ...)                                     \
+  do {                                                        \
+    if (LOG_DEBUG_ENABLED) {                                  \
+      fprintf(log_debug_stream, fmt "\n", ##__VA_ARGS__);     \
+    }                                                         \
   } while (0);
 
-#define log_dbg(fmt, ...)                     \
-  do {                                        \
-    fprintf(stderr, fmt "\n", ##__VA_ARGS__); \
-    fflush(stderr);                           \
+#define log_instr(fmt, ...)                                   \
+  do {                                                        \
+    if (LOG_INSTRUCTIONS_ENABLED) {                           \
+      fprintf(log_debug_stream, fmt "\n", ##__VA_ARGS__);     \
+    }                                                         \
   } while (0);
 
 #define panic(fmt, ...)                        \
@@ -1,14 +1,307 @@
+#include <errno.h>
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "cache.h"
+#include "checkpoint.h"
 #include "clock.h"
+#include "config.h"
 #include "constants.h"
+#include "event.h"
+#include "job.h"
 #include "log.h"
 #include "memory.h"
 #include "page_table.h"
+#include "parallel.h"
+#include "reuse.h"
+#include "sample.h"
+#include "sweep.h"
 #include "tlb.h"
+#include "trace.h"
+
+#define USAGE                                                             \
+  "Usage: %s [options] <instructions_file>\n"                             \
+  "  (or kernel:spark|cm1|cm2[,min=B][,max=B][,repeat=N] or\n"          \
+  "   kernel:mm1|mm2|mm3[,n=N][,block=N]: a proj1 benchmark kernel)\n"  \
+  "  --convert FILE   write the instructions in binary format to FILE\n"  \
+  "  --sweep FILE     replay the trace once per configuration of FILE\n"  \
+  "  --jobs N         run up to N sweep configurations in parallel\n"     \
+  "  --events FILE    record the simulation events to FILE (binary; see\n" \
+  "                   build/tlbevents)\n"                              \
+  "  --checkpoint FILE  save the state of the simulation to FILE after\n" \
+  "                   --checkpoint-at N references (default: all), and stop\n" \
+  "  --restore FILE   resume the simulation saved in FILE, with its\n"   \
+  "                   configuration, from the next reference of the\n"   \
+  "                   instructions file, or from reference --resume-at N\n" \
+  "  --log LIST       log categories to print: all (default), none, or\n" \
+  "                   a comma-separated list of events,debug,instructions\n" \
+  "  --reuse-profile FILE  write the reuse distances of the references,\n" \
+  "                   the TLB miss ratio curve and the page accesses to FILE\n" \
+  "  --mrc-sizes LIST  TLB sizes to report the miss ratio of (comma-\n"   \
+  "                   separated; default 16,32,...,4096)\n"              \
+  "  --sample-period K  estimate the run from units of --sample-unit N\n" \
+  "                   references (default 1000) every K, after\n"      \
+  "                   --sample-warmup N detailed references (default\n" \
+  "                   2000); the --sample-warming N references before\n" \
+  "                   (default 20000; 0 for all) only warm up the state,\n" \
+  "                   and the others are skipped\n"                       \
+  "  --threads N      simulate the cores on N host threads, in windows of\n" \
+  "  --window NS      simulated time (default 10000 ns, at most the\n"   \
+  "                   shootdown latency); no logging. The cores run in\n" \
+  "                   simulated-time order, not trace order: under DRAM\n" \
+  "                   pressure, faults and elapsed time of a multi-core\n" \
+  "                   trace can differ from the serial run by up to about\n" \
+  "                   15%% and 30%%\n"                                 \
+  "  --l1-entries N   --l1-ways N   --l1-latency NS   --l1-replacement P\n" \
+  "  --l2-entries N   --l2-ways N   --l2-latency NS   --l2-replacement P\n" \
+  "  --page-replacement lowest|fifo|clock|aging|wsclock\n"               \
+  "  --wsclock-tau N  working-set window of wsclock, in references\n"   \
+  "  --page-walk flat|radix  one DRAM read per walk, or one per level\n" \
+  "  --pwc-entries N  --pwc-ways N  --pwc-latency NS  page walk cache\n" \
+  "                   of upper-level entries (radix walks only)\n"     \
+  "  --huge-pages off|always|promote  --huge-promote-threshold N\n"     \
+  "  --tlb-huge separate|unified  --l1-huge-entries N  --l1-huge-ways N\n" \
+  "                   --l2-huge-entries N  --l2-huge-ways N\n"          \
+  "  --cores N        cores with private TLBs (trace lines \"<core> R|W\n" \
+  "                   <address>\")\n"                                    \
+  "  --shootdown-latency NS  --shootdown-handler NS  TLB shootdown cost,\n" \
+  "                   on the initiating and on every other core\n"      \
+  "  --asid-mode tagged|flush  keep ASID-tagged TLB entries on context\n" \
+  "                   switches (\"[<core>] C <asid>\" lines), or flush them\n" \
+  "  --swap-placement next|cluster|random  --swap-slots N  swap slots\n" \
+  "  --swap-readahead N  --swap-cache N  slots read after a swapped-in\n" \
+  "                   page, and kept for later faults\n"               \
+  "  --disk-model flat|seek  same cost for every disk access, or cheap\n" \
+  "                   sequential transfers\n"                         \
+  "  --write-buffer N  buffer up to N dirty pages evicted to disk, and\n" \
+  "                   write them in the background  --write-batch N\n"  \
+  "                   pages per disk write at most\n"                    \
+  "  --timing blocking|overlap  serialize every latency, or overlap TLB\n" \
+  "                   misses  --walk-slots N  --io-slots N  outstanding\n" \
+  "                   misses per core, without and with disk I/O\n"     \
+  "  --tlb-prefetch none|sequential|stride|distance  prefetch translations\n" \
+  "                   on L2 TLB misses  --prefetch-degree N\n"           \
+  "  --prefetch-target buffer|l2  --prefetch-buffer N  --prefetch-table N\n" \
+  "  --dcache-L-size B  --dcache-L-line B  --dcache-L-ways N\n"          \
+  "  --dcache-L-latency NS  data cache level L (l1, l2 or llc) of every\n" \
+  "                   core; size 0 (default) leaves it out\n"           \
+  "  --dcache-write back|through  --dcache-write-miss allocate|around\n" \
+  "  --dcache-l1-index physical|virtual  PIPT, or VIPT L1 read during the\n" \
+  "                   L1 TLB lookup\n"                                 \
+  "  (ways: 1 = direct-mapped, 0 = fully associative;\n"                  \
+  "   P: lru, fifo or random)"
+
+static const struct option main_options[] = {
+    {"convert", required_argument, NULL, 0},
+    {"sweep", required_argument, NULL, 0},
+    {"jobs", required_argument, NULL, 0},
+    {"log", required_argument, NULL, 0},
+    {"events", required_argument, NULL, 0},
+    {"threads", required_argument, NULL, 0},
+    {"window", required_argument, NULL, 0},
+    {"reuse-profile", required_argument, NULL, 0},
+    {"mrc-sizes", required_argument, NULL, 0},
+    {"checkpoint", required_argument, NULL, 0},
+    {"checkpoint-at", required_argument, NULL, 0},
+    {"restore", required_argument, NULL, 0},
+    {"resume-at", required_argument, NULL, 0},
+    {"sample-period", required_argument, NULL, 0},
+    {"sample-unit", required_argument, NULL, 0},
+    {"sample-warmup", required_argument, NULL, 0},
+    {"sample-warming", required_argument, NULL, 0},
+};
+
+// TLB sizes of the miss ratio curve reported by the reuse profiler.
+#define MAX_MRC_SIZES 32
+
+// Parses a comma-separated list of sizes. Returns their number.
+unsigned parse_mrc_sizes(const char* list, uint64_t* sizes) {
+  unsigned n = 0;
+  const char* cursor = list;
+  for (;;) {
+    char* end;
+    errno = 0;
+    uint64_t size = strtoull(cursor, &end, 0);
+    if (*cursor < '0' || *cursor > '9' || errno == ERANGE || size == 0 ||
+        n == MAX_MRC_SIZES || (*end != ',' && *end != '\0')) {
+      panic("Invalid value for mrc-sizes: %s (expected up to %d sizes, "
+            "e.g. 64,128,1024)",
+            list, MAX_MRC_SIZES);
+    }
+    sizes[n++] = size;
+    if (*end == '\0') {
+      return n;
+    }
+    cursor = end + 1;
+  }
+}
+
+// Formats the confidence interval of a sampled estimate, of half width
+// `percent`.
+const char* format_sample_interval(char* buffer, size_t size,
+                                   const sample_estimate_t* estimate,
+                                   double percent) {
+  if (!estimate->estimable) {
+    snprintf(buffer, size, "interval not estimable, the units did not vary");
+  } else {
+    snprintf(buffer, size, "+/- %.2g%%", percent);
+  }
+  return buffer;
+}
+
+// Saves or restores the state of every module, once they are initialized with
+// the configuration of the checkpoint.
+void checkpoint_simulation(checkpoint_t* checkpoint) {
+  checkpoint_random(checkpoint);
+  clock_checkpoint(checkpoint);
+  page_table_checkpoint(checkpoint);
+  tlb_checkpoint(checkpoint);
+  cache_checkpoint(checkpoint);
+}
+
+// A checkpoint starts with the configuration, the references simulated and
+// the references of the instructions file read so far (more than simulated
+// if the run resumed at a later reference).
+void save_checkpoint(const char* path, sim_config_t* config,
+                     uint64_t references, uint64_t position) {
+  checkpoint_t checkpoint;
+  checkpoint_create(&checkpoint, path);
+  CHECKPOINT_VALUE(&checkpoint, *config);
+  CHECKPOINT_VALUE(&checkpoint, references);
+  CHECKPOINT_VALUE(&checkpoint, position);
+  checkpoint_simulation(&checkpoint);
+  checkpoint_close(&checkpoint);
+  log_dbg("Saved checkpoint %s after %" PRIu64 " references", path,
+          references);
+}
+
+// main_options followed by config_options, for getopt_long().
+struct option* build_long_options() {
+  size_t n_main = sizeof(main_options) / sizeof(main_options[0]);
+  size_t n_config = 0;
+  while (config_options[n_config].name) {
+    n_config++;
+  }
+
+  struct option* options = calloc(n_main + n_config + 1, sizeof(struct option));
+  if (!options) {
+    panic("Failed to allocate options");
+  }
+  memcpy(options, main_options, sizeof(main_options));
+  memcpy(options + n_main, config_options, n_config * sizeof(struct option));
+  return options;
+}
 
 int main(int argc, char* argv[]) {
+  log_init();
+
+  sim_config_t config = SIM_DEFAULT_CONFIG;
+  const char* convert_path = NULL;
+  const char* sweep_path = NULL;
+  const char* events_path = NULL;
+  unsigned jobs = job_default_count();
+  unsigned threads = 0;
+  time_ns_t window_ns = PARALLEL_WINDOW_NS;
+  const char* reuse_path = NULL;
+  bool reuse_profile = false;
+  uint64_t mrc_sizes[MAX_MRC_SIZES];
+  unsigned n_mrc_sizes = 0;
+  for (uint64_t size = 16; size <= 4096; size *= 2) {
+    mrc_sizes[n_mrc_sizes++] = size;
+  }
+  const char* checkpoint_path = NULL;
+  uint64_t checkpoint_at = 0;
+  const char* restore_path = NULL;
+  bool has_resume_at = false;
+  uint64_t resume_at = 0;
+  sample_config_t sample = SAMPLE_DEFAULT_CONFIG;
+  bool has_config_options = false;
+
+  struct option* long_options = build_long_options();
+  int opt, option_index;
+  while ((opt = getopt_long(argc, argv, "", long_options, &option_index)) != -1) {
+    if (opt != 0) {
+      panic(USAGE, argv[0]);
+    }
+
+    const char* name = long_options[option_index].name;
+    if (strcmp(name, "convert") == 0) {
+      convert_path = optarg;
+    } else if (strcmp(name, "sweep") == 0) {
+      sweep_path = optarg;
+    } else if (strcmp(name, "jobs") == 0) {
+      jobs = parse_unsigned(name, optarg);
+      if (jobs == 0) {
+        panic("Invalid value for %s: %s (expected at least 1)", name, optarg);
+      }
+    } else if (strcmp(name, "events") == 0) {
+      events_path = optarg;
+    } else if (strcmp(name, "threads") == 0) {
+      threads = parse_unsigned(name, optarg);
+    } else if (strcmp(name, "window") == 0) {
+      window_ns = parse_u64(name, optarg);
+    } else if (strcmp(name, "reuse-profile") == 0) {
+      reuse_path = optarg;
+      reuse_profile = true;
+    } else if (strcmp(name, "mrc-sizes") == 0) {
+      n_mrc_sizes = parse_mrc_sizes(optarg, mrc_sizes);
+      reuse_profile = true;
+    } else if (strcmp(name, "checkpoint") == 0) {
+      checkpoint_path = optarg;
+    } else if (strcmp(name, "checkpoint-at") == 0) {
+      checkpoint_at = parse_u64(name, optarg);
+    } else if (strcmp(name, "restore") == 0) {
+      restore_path = optarg;
+    } else if (strcmp(name, "resume-at") == 0) {
+      resume_at = parse_u64(name, optarg);
+      has_resume_at = true;
+    } else if (strcmp(name, "sample-period") == 0) {
+      sample.period = parse_u64(name, optarg);
+    } else if (strcmp(name, "sample-unit") == 0) {
+      sample.unit = parse_u64(name, optarg);
+    } else if (strcmp(name, "sample-warmup") == 0) {
+      sample.warmup = parse_u64(name, optarg);
+    } else if (strcmp(name, "sample-warming") == 0) {
+      sample.warming = parse_u64(name, optarg);
+    } else if (strcmp(name, "log") == 0) {
+      if (!log_set_categories(optarg)) {
+        panic("Invalid value for log: %s (expected all, none, events, debug "
+              "or instructions)",
+              optarg);
+      }
+    } else if (config_set_option(&config, name, optarg)) {
+      has_config_options = true;
+    } else {
+      panic(USAGE, argv[0]);
+    }
+  }
+  free(long_options);
+
+  // The modules are restored once initialized with the configuration
+  checkpoint_t restore;
+  uint64_t restored_references = 0;
+  uint64_t restored_position = 0;
+  if (restore_path) {
+    if (has_config_options) {
+      panic("Simulator options cannot be used with --restore: the "
+            "configuration is the one of the checkpoint");
+    }
+    checkpoint_open(&restore, restore_path);
+    CHECKPOINT_VALUE(&restore, config);
+    CHECKPOINT_VALUE(&restore, restored_references);
+    CHECKPOINT_VALUE(&restore, restored_position);
+    if (!has_resume_at) {
+      resume_at = restored_position;
+    }
+  } else if (has_resume_at) {
+    panic("--resume-at needs --restore");
+  }
+  if (checkpoint_at && !checkpoint_path) {
+    panic("--checkpoint-at needs --checkpoint");
+  }
+
   log_dbg("=========== System Properties ===========");
   log_dbg("Virtual address:       %d bits", VIRTUAL_ADDRESS_BITS);
   log_dbg("Page index:            %d bits", PAGE_SIZE_BITS);
@@ -19,51 +312,137 @@ int main(int argc, char* argv[]) {
   log_dbg("Disk address space:    %" PRIu64 " B", DISK_SIZE_BYTES);
   log_dbg("Page size:             %" PRIu64 " B", PAGE_SIZE_BYTES);
   log_dbg("Total pages:           %" PRIu64, TOTAL_PAGES);
+  config_log(&config);
   log_dbg("=========================================");
 
-  if (argc < 2) {
-    panic("Usage: %s <instructions_file>", argv[0]);
+  if (optind >= argc) {
+    panic(USAGE, argv[0]);
+  }
+
+  if (convert_path) {
+    uint64_t count = trace_convert(argv[optind], convert_path);
+    log("Converted %" PRIu64 " instructions to %s", count, convert_path);
+    return 0;
   }
 
-  srand(0xcafebabe);
-  reset_time();
-  page_table_init();
-  tlb_init();
+  if (sweep_path && events_path) {
+    panic("--events cannot be used with --sweep");
+  }
+  if (sweep_path && reuse_profile) {
+    panic("--reuse-profile and --mrc-sizes cannot be used with --sweep");
+  }
+  if (threads && (sweep_path || events_path)) {
+    panic("--threads cannot be used with --sweep or --events");
+  }
+  if (sweep_path && (checkpoint_path || restore_path)) {
+    panic("--checkpoint and --restore cannot be used with --sweep");
+  }
+  if (threads && checkpoint_path) {
+    panic("--checkpoint cannot be used with --threads");
+  }
+  if (sample.period &&
+      (threads || sweep_path || events_path || checkpoint_path)) {
+    panic("--sample-period cannot be used with --threads, --sweep, --events "
+          "or --checkpoint");
+  }
 
-  FILE* file = fopen(argv[1], "r");
-  if (!file) {
-    panic("Failed to open instructions file %s", argv[1]);
+  if (sweep_path) {
+    trace_t trace;
+    trace_load(argv[optind], &trace);
+    sweep_run(sweep_path, &config, &trace, jobs);
+    trace_free(&trace);
+    return 0;
   }
 
-  uint64_t total_instructions = 0;
+  checkpoint_seed_random(0xcafebabe);
+  clock_init(&config.timing);
+  page_table_init(&config.page_table);
+  tlb_init(&config.tlb);
+  cache_init(&config.cache, &config.tlb);
+  reuse_init();
+  // The reuse profile needs every reference of the trace.
+  if (reuse_profile) {
+    sample.warming = 0;
+  }
+  sample_init(&sample);
+  if (restore_path) {
+    checkpoint_simulation(&restore);
+    checkpoint_close(&restore);
+    log_dbg("Restored checkpoint %s after %" PRIu64
+            " references, resuming at reference %" PRIu64,
+            restore_path, restored_references, resume_at);
+  }
 
-  char line[256];
-  while (fgets(line, sizeof(line), file)) {
-    char instruction;
-    uint64_t address;
-    if (sscanf(line, "%c %" PRIx64, &instruction, &address) != 2) {
-      panic("Invalid instruction format: %s", line);
+  uint64_t total_instructions = restored_references;
+
+  if (threads) {
+    trace_reader_t reader;
+    trace_open(argv[optind], &reader);
+    trace_skip(&reader, resume_at);
+    total_instructions += parallel_run(&reader, reuse_profile,
+                                       config.tlb.cores, threads, window_ns);
+    trace_close(&reader);
+  } else {
+    trace_reader_t reader;
+    trace_open(argv[optind], &reader);
+    if (events_path) {
+      event_open(events_path);
     }
 
-    log_dbg("* %c %" PRIx64, instruction, address);
+    trace_record_t record;
+    uint64_t position = 0;
+    bool sampling = sample_enabled();
+    while (position < resume_at && trace_next(&reader, &record)) {
+      position++;
+    }
 
-    switch (instruction) {
-      case 'R':
-        read(address);
+    while (!checkpoint_at || total_instructions < checkpoint_at) {
+      if (sampling) {
+        uint64_t skipped =
+            trace_skip(&reader, sample_skippable_references());
+        sample_fast_forward(skipped);
+        position += skipped;
+        total_instructions += skipped;
+      }
+      if (!trace_next(&reader, &record)) {
         break;
-      case 'W':
-        write(address);
-        break;
-      default:
-        panic("Unknown instruction: %c", instruction);
+      }
+      position++;
+      if (reuse_profile) {
+        reuse_reference(record.core, record.asid, record.address, record.op);
+      }
+      total_instructions++;
+      if (sampling) {
+        sample_reference(&record);
+        continue;
+      }
+
+      log_instr("* %c %" PRIx64, record.op == OP_READ ? 'R' : 'W',
+                record.address);
+      select_core(record.core);
+      tlb_select_asid(record.asid);
+      event_emit(EVENT_INSTRUCTION, record.op, 0, record.address, 0);
+      switch (record.op) {
+        case OP_READ:
+          read(record.address);
+          break;
+        case OP_WRITE:
+          write(record.address);
+          break;
+      }
     }
+    sample_finish();
 
-    total_instructions++;
+    // Before the outstanding misses drain, so that the run can go on
+    if (checkpoint_path) {
+      save_checkpoint(checkpoint_path, &config, total_instructions, position);
+    }
+    trace_close(&reader);
+    event_close();
   }
 
-  fclose(file);
-
-  time_ns_t elapsed_time = get_time();
+  clock_drain();
+  time_ns_t elapsed_time = get_elapsed_time();
   uint64_t page_faults = get_total_page_faults();
   uint64_t page_evictions = get_total_page_evictions();
 
@@ -80,14 +459,232 @@ int main(int argc, char* argv[]) {
   float l2_hit_rate =
       (l2_hits + l2_misses) > 0 ? 100.0 * l2_hits / (l2_hits + l2_misses) : 0.0;
 
-  log("Elapsed: %" PRIu64 " ns", elapsed_time);
+  // Functional warming charges no time and counts no hits: a sampled run
+  // reports estimates of them instead (see below).
+  if (!sample_enabled()) {
+    log("Elapsed: %" PRIu64 " ns", elapsed_time);
+  }
   log("Total instructions executed: %" PRIu64, total_instructions);
   log("Total page faults: %" PRIu64, page_faults);
   log("Total page evictions: %" PRIu64, page_evictions);
-  log("Total TLB L1 hits: %" PRIu64 " (%.2f%%)", l1_hits, l1_hit_rate);
-  log("Total TLB L2 hits: %" PRIu64 " (%.2f%%)", l2_hits, l2_hit_rate);
+  if (!sample_enabled()) {
+    log("Total TLB L1 hits: %" PRIu64 " (%.2f%%)", l1_hits, l1_hit_rate);
+    log("Total TLB L2 hits: %" PRIu64 " (%.2f%%)", l2_hits, l2_hit_rate);
+  }
   log("Total TLB L1 invalidations: %" PRIu64, l1_invalidations);
   log("Total TLB L2 invalidations: %" PRIu64, l2_invalidations);
 
+  if (config.tlb.cores > 1 && !sample_enabled()) {
+    for (unsigned core = 0; core < config.tlb.cores; core++) {
+      uint64_t core_l1_hits, core_l1_misses, core_l2_hits, core_l2_misses;
+      get_core_tlb_hits(core, &core_l1_hits, &core_l1_misses, &core_l2_hits,
+                        &core_l2_misses);
+      const tlb_shootdown_stats_t* shootdowns = get_tlb_shootdown_stats(core);
+      log("Core %u: elapsed %" PRIu64 " ns, TLB L1 hits %" PRIu64
+          ", L2 hits %" PRIu64 ", shootdowns %" PRIu64 " sent, %" PRIu64
+          " received (%" PRIu64 " ns)",
+          core, get_core_time(core), core_l1_hits, core_l2_hits,
+          shootdowns->sent, shootdowns->received, shootdowns->time_ns);
+    }
+  }
+
+  uint64_t context_switches = get_total_context_switches();
+  if (context_switches) {
+    log("Context switches %s: %" PRIu64 ", %" PRIu64 " TLB entries flushed",
+        tlb_asid_mode_name(config.tlb.asid_mode), context_switches,
+        get_total_tlb_flushed_entries());
+    for (unsigned asid = 0; asid < MAX_ASIDS; asid++) {
+      tlb_asid_stats_t stats = get_asid_tlb_stats(asid);
+      uint64_t l1_lookups = stats.l1_hits + stats.l1_misses;
+      uint64_t l2_lookups = stats.l2_hits + stats.l2_misses;
+      if (!l1_lookups) {
+        continue;
+      }
+      log("ASID %u: TLB L1 hits %" PRIu64 " (%.2f%%), L2 hits %" PRIu64
+          " (%.2f%%)",
+          asid, stats.l1_hits, 100.0 * stats.l1_hits / l1_lookups,
+          stats.l2_hits,
+          l2_lookups ? 100.0 * stats.l2_hits / l2_lookups : 0.0);
+    }
+  }
+
+  if (config.tlb.prefetch.policy != TLB_PREFETCH_NONE) {
+    tlb_prefetch_stats_t prefetch = get_total_tlb_prefetch_stats();
+    uint64_t covered = prefetch.useful + prefetch.demand_walks;
+    log("TLB prefetch %s: %" PRIu64 " issued, %" PRIu64
+        " useful (%.2f%% accuracy, %.2f%% coverage, %.2f%% on time), %" PRIu64
+        " ns saved",
+        tlb_prefetch_policy_name(config.tlb.prefetch.policy), prefetch.issued,
+        prefetch.useful,
+        prefetch.issued ? 100.0 * prefetch.useful / prefetch.issued : 0.0,
+        covered ? 100.0 * prefetch.useful / covered : 0.0,
+        prefetch.useful
+            ? 100.0 * (prefetch.useful - prefetch.late) / prefetch.useful
+            : 0.0,
+        prefetch.saved_ns);
+  }
+
+  if (config.page_table.replacement != PAGE_REPLACEMENT_LOWEST) {
+    log("Page replacement %s: %" PRIu64 " dirty evictions, %" PRIu64
+        " hand moves",
+        page_replacement_name(config.page_table.replacement),
+        get_total_dirty_page_evictions(), get_total_replacement_scans());
+  }
+
+  if (config.page_table.huge_pages != HUGE_PAGES_OFF) {
+    uint64_t l1_huge_hits = get_total_tlb_l1_huge_hits();
+    uint64_t l2_huge_hits = get_total_tlb_l2_huge_hits();
+    log("Huge pages %s: %" PRIu64 " huge faults, %" PRIu64
+        " promotions, %" PRIu64 " splits",
+        huge_pages_name(config.page_table.huge_pages),
+        get_total_huge_page_faults(), get_total_huge_page_promotions(),
+        get_total_huge_page_demotions());
+    log("TLB L1 hits: %" PRIu64 " on base pages, %" PRIu64 " on huge pages",
+        l1_hits - l1_huge_hits, l1_huge_hits);
+    log("TLB L2 hits: %" PRIu64 " on base pages, %" PRIu64 " on huge pages",
+        l2_hits - l2_huge_hits, l2_huge_hits);
+  }
+
+  if (config.page_table.walk == PAGE_WALK_RADIX) {
+    log("Page walk radix: %d levels, %" PRIu64 " DRAM reads, %" PRIu64
+        " nodes (%" PRIu64 " KiB)",
+        PAGE_TABLE_LEVELS, get_total_page_walk_accesses(),
+        get_page_table_nodes(), get_page_table_bytes() / 1024);
+  }
+
+  if (config.page_table.walk_cache.entries) {
+    uint64_t lookups = get_total_page_walk_cache_lookups();
+    uint64_t misses = get_total_page_walk_cache_misses();
+    float pwc_hit_rate =
+        lookups > 0 ? 100.0 * (lookups - misses) / lookups : 0.0;
+    log("Page walk cache: %" PRIu64 " lookups, %" PRIu64
+        " misses (%.2f%% hits), %" PRIu64 " DRAM reads saved",
+        lookups, misses, pwc_hit_rate,
+        get_total_page_walk_cache_saved_reads());
+    for (unsigned level = 0; level < PAGE_TABLE_LEVELS - 1; level++) {
+      log("Page walk cache level %u hits: %" PRIu64, level,
+          get_total_page_walk_cache_hits(level));
+    }
+  }
+
+  if (swap_config_changed(&config.page_table.swap)) {
+    log("Swap %s: %" PRIu64 " slots in use at most, %" PRIu64
+        " swap-ins (%" PRIu64 " from the swap cache), %" PRIu64
+        " pages read ahead",
+        swap_placement_name(config.page_table.swap.placement),
+        get_swap_slots_peak(), get_total_swap_reads(),
+        get_total_swap_cache_hits(), get_total_swap_readahead_pages());
+    log("Disk %s: %" PRIu64 " sequential and %" PRIu64
+        " random page transfers",
+        swap_disk_name(config.page_table.swap.disk),
+        get_total_disk_sequential_pages(), get_total_disk_random_pages());
+  }
+
+  if (config.page_table.write_buffer.entries) {
+    uint64_t buffered = get_total_buffered_writes();
+    uint64_t hits = get_total_write_buffer_hits();
+    time_ns_t stalled = get_total_write_buffer_stall_time();
+    // Disk latency the faults would have paid: the writes of the buffered
+    // pages, and the reads of the pages copied back from the buffer
+    time_ns_t synchronous = (buffered + hits) * DISK_LATENCY_NS;
+    log("Write buffer: %" PRIu64 " dirty pages buffered, %" PRIu64
+        " disk writes, %" PRIu64 " cancelled, %" PRIu64
+        " faults served from the buffer, %" PRIu64 " still pending",
+        buffered, get_total_write_buffer_flushes(),
+        get_total_cancelled_writes(), hits, get_write_buffer_pending());
+    log("Write buffer latency: %" PRIu64 " ns waiting for a slot, %" PRIu64
+        " ns of fault latency hidden",
+        stalled, synchronous > stalled ? synchronous - stalled : 0);
+  }
+
+  if (cache_enabled()) {
+    for (cache_level_t level = CACHE_L1; level < CACHE_LEVELS; level++) {
+      if (!config.cache.levels[level].size) {
+        continue;
+      }
+      cache_stats_t stats = get_total_cache_stats(level);
+      uint64_t accesses = stats.hits + stats.misses;
+      log("Data cache %s: %" PRIu64 " hits, %" PRIu64
+          " misses (%.2f%% hits), %" PRIu64 " write-backs",
+          cache_level_name(level), stats.hits, stats.misses,
+          accesses ? 100.0 * stats.hits / accesses : 0.0, stats.write_backs);
+    }
+    log("Data cache DRAM: %" PRIu64 " line reads, %" PRIu64 " line writes",
+        get_total_cache_dram_reads(), get_total_cache_dram_writes());
+    if (config.cache.l1_index == CACHE_INDEX_VIRTUAL) {
+      log("Data cache L1 VIPT: %" PRIu64
+          " ns of L1 latency overlapped with the TLB lookup (saved versus "
+          "PIPT)",
+          get_total_cache_vipt_saved_time());
+    }
+  }
+
+  if (config.timing.mode != TIMING_BLOCKING) {
+    log("Timing %s: %" PRIu64 " page walks and %" PRIu64
+        " disk I/Os overlapped (%" PRIu64 " ns of latency)",
+        timing_mode_name(config.timing.mode), get_total_overlapped_walks(),
+        get_total_overlapped_ios(), get_total_overlapped_time());
+    log("Stall time: TLB %" PRIu64 " ns, memory %" PRIu64 " ns, disk %" PRIu64
+        " ns, shootdowns %" PRIu64 " ns",
+        get_total_stall_time(TIME_TLB), get_total_stall_time(TIME_MEMORY),
+        get_total_stall_time(TIME_DISK), get_total_stall_time(TIME_SHOOTDOWN));
+  }
+
+  if (sample_enabled()) {
+    uint64_t units = get_sample_units();
+    uint64_t sampled = total_instructions - restored_references;
+    log("Sampling: %" PRIu64 " units of %" PRIu64 " references every %" PRIu64
+        " (%" PRIu64 " of warm-up), %.2f%% measured, %" PRIu64
+        " references skipped and %" PRIu64
+        " batched by functional warming, %" PRIu64
+        " fast-forwarded (other hit counts and times are of the detailed "
+        "references only, and page faults and evictions of the simulated "
+        "ones)",
+        units, sample.unit, sample.period, sample.warmup,
+        sampled ? 100.0 * units * sample.unit / sampled : 0.0,
+        get_sample_skipped_references(), get_sample_batched_references(),
+        get_sample_fast_forwarded_references());
+    char interval[64];
+    sample_estimate_t time = get_sample_estimate(SAMPLE_TIME);
+    if (time.estimable) {
+      log("Sampled elapsed: %.0f ns (+/- %.2g%%, %.1f%% confidence), %.2f ns "
+          "per reference, %" PRIu64 " units needed for +/- 3%%",
+          time.value * sampled, 100.0 * time.error / time.value,
+          SAMPLE_CONFIDENCE_PERCENT, time.value,
+          get_sample_units_needed(SAMPLE_TIME, 0.03));
+    } else {
+      log("Sampled elapsed: %.0f ns (%s), %.2f ns per reference",
+          time.value * sampled,
+          format_sample_interval(interval, sizeof(interval), &time, 0.0),
+          time.value);
+    }
+    sample_estimate_t l1 = get_sample_estimate(SAMPLE_TLB_L1);
+    sample_estimate_t l2 = get_sample_estimate(SAMPLE_TLB_L2);
+    char l2_interval[64];
+    log("Sampled TLB L1 hits: %.2f%% (%s), L2 hits: %.2f%% (%s)",
+        100.0 * l1.value,
+        format_sample_interval(interval, sizeof(interval), &l1,
+                               100.0 * l1.error),
+        100.0 * l2.value,
+        format_sample_interval(l2_interval, sizeof(l2_interval), &l2,
+                               100.0 * l2.error));
+  }
+
+  if (reuse_profile) {
+    uint64_t references = get_reuse_references();
+    log("Reuse distance: %" PRIu64 " references to %" PRIu64
+        " pages, %" PRIu64 " cold misses",
+        references, get_reuse_pages(), get_reuse_cold_misses());
+    for (unsigned i = 0; i < n_mrc_sizes; i++) {
+      uint64_t misses = get_reuse_misses(mrc_sizes[i]);
+      log("LRU TLB of %" PRIu64 " entries: %" PRIu64 " misses (%.2f%% hits)",
+          mrc_sizes[i], misses,
+          references ? 100.0 * (references - misses) / references : 0.0);
+    }
+    if (reuse_path) {
+      reuse_write(reuse_path);
+    }
+  }
+
   return 0;
 }
\ No newline at end of file
@@ -1,13 +1,17 @@
 #include "memory.h"
 
+#include "cache.h"
 #include "clock.h"
 #include "constants.h"
+#include "event.h"
 #include "log.h"
 #include "page_table.h"
+#include "swap.h"
 #include "tlb.h"
 
 void log_dram_access(pa_dram_t address, op_t op) {
   address &= DRAM_ADDRESS_MASK;
+  event_emit(EVENT_DRAM, op, 0, address, 0);
   switch (op) {
     case OP_READ:
       log_clk("R DRAM[%" PRIx64 "]", address);
@@ -20,6 +24,7 @@ void log_dram_access(pa_dram_t address, op_t op) {
 
 void log_disk_access(pa_disk_t address, op_t op) {
   address &= DISK_ADDRESS_MASK;
+  event_emit(EVENT_DISK, op, 0, address, 0);
   switch (op) {
     case OP_READ:
       log_clk("R Disk[%" PRIx64 "]", address);
@@ -30,24 +35,50 @@ void log_disk_access(pa_disk_t address, op_t op) {
   }
 }
 
+void select_core(unsigned core) {
+  tlb_select_core(core);
+  clock_select_core(core);
+}
+
+// The data of a translated reference: through the data caches, or straight
+// to DRAM, logged but not charged, like the original simulator.
+void data_access(pa_dram_t physical_address, op_t op) {
+  if (cache_enabled()) {
+    cache_access(physical_address, op);
+  } else {
+    log_dram_access(physical_address, op);
+  }
+}
+
 void read(va_t address) {
   address &= VIRTUAL_ADDRESS_MASK;
   pa_dram_t physical_address = tlb_translate(address, OP_READ);
-  log_dram_access(physical_address, OP_READ);
+  page_table_reference(address);
+  data_access(physical_address, OP_READ);
 }
 
 void write(va_t address) {
   address &= VIRTUAL_ADDRESS_MASK;
   pa_dram_t physical_address = tlb_translate(address, OP_WRITE);
-  log_dram_access(physical_address, OP_WRITE);
+  page_table_reference(address);
+  data_access(physical_address, OP_WRITE);
+}
+
+void warm_reference(va_t address, op_t op) {
+  address &= VIRTUAL_ADDRESS_MASK;
+  pa_dram_t physical_address = tlb_warm(address, op);
+  page_table_warm_reference(address);
+  if (cache_enabled()) {
+    cache_warm(physical_address, op);
+  }
 }
 
 void dram_access(pa_dram_t address, op_t op) {
   log_dram_access(address, op);
-  increment_time(DRAM_LATENCY_NS);
+  increment_time(TIME_MEMORY, DRAM_LATENCY_NS);
 }
 
 void disk_access(pa_disk_t address, op_t op) {
   log_disk_access(address, op);
-  increment_time(DISK_LATENCY_NS);
+  increment_time(TIME_DISK, swap_disk_request(&address, 1));
 }
@@ -16,7 +16,20 @@ typedef uint64_t pa_disk_t;
 
 typedef enum { OP_READ, OP_WRITE } op_t;
 
+// Makes a core current: the next accesses use its clock and TLBs.
+void select_core(unsigned core);
+
 void read(va_t address);
 void write(va_t address);
+
+// Same changes to the TLBs, page tables and data caches as read() or write(),
+// without time, statistics or events (functional warming, see sample.h).
+void warm_reference(va_t address, op_t op);
 void dram_access(pa_dram_t address, op_t op);
-void disk_access(pa_disk_t address, op_t op);
\ No newline at end of file
+void disk_access(pa_disk_t address, op_t op);
+
+// Logs (and records) a DRAM access whose latency is accounted elsewhere.
+void log_dram_access(pa_dram_t address, op_t op);
+
+// Logs (and records) a disk access whose latency is accounted elsewhere.
+void log_disk_access(pa_disk_t address, op_t op);
\ No newline at end of file
@@ -6,18 +6,26 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "bitmap.h"
+#include "cache.h"
 #include "clock.h"
 #include "constants.h"
+#include "event.h"
 #include "log.h"
 #include "tlb.h"
 
 #define PAGE_TABLE_DRAM_ADDRESS (0)
 
-pa_dram_t RANDOM_PAGE_ADDRESS_BASE = 0xcafebabe;
-pa_dram_t RANDOM_PAGE_ADDRESS_IT = 0;
-
 uint64_t page_faults = 0;
 uint64_t page_evictions = 0;
+uint64_t dirty_page_evictions = 0;
+uint64_t replacement_scans = 0;
+
+// Number of references seen by page_table_reference(), used as the virtual
+// time of the working-set policy.
+uint64_t virtual_time = 0;
+
+page_table_config_t page_table_config;
 
 typedef struct {
   // This only stored the page index, not the full address.
@@ -33,128 +41,916 @@ typedef struct {
   bool dirty;
 } page_table_entry_t;
 
-page_table_entry_t page_table[TOTAL_PAGES];
-
 typedef struct {
   bool is_swapped;
   pa_disk_t disk_page_number;
+
+  // Page replacement state, only meaningful while the page is valid.
+  // Resident pages form a circular list, in mapping order, that the FIFO
+  // policy pops and the clock-based policies sweep.
+  bool referenced;
+  uint8_t age;
+  uint64_t last_use;
+  va_t resident_prev;
+  va_t resident_next;
+
+  // Bit mask of the cores that walked to this page since it was mapped, and
+  // may cache it in their TLBs.
+  uint64_t tlb_cores;
 } pte_metadata_t;
 
-pte_metadata_t pte_metadata[TOTAL_PAGES];
+// ========================================================================
+// Radix page table.
+// The virtual page number is split in PAGE_TABLE_LEVELS indices of
+// PAGE_TABLE_LEVEL_BITS bits, most significant first. Upper levels hold
+// pointers to the next level, the last one holds the entries. Nodes are only
+// allocated when a page below them is first touched, from an arena that is
+// released as a whole by page_table_init(), so memory grows with the number
+// of touched pages rather than with the size of the virtual address space.
+// Every ASID has its own root; the functions below take page keys (see
+// page_key()) as virtual page numbers.
+// ========================================================================
+
+#define PAGE_TABLE_FANOUT (1llu << PAGE_TABLE_LEVEL_BITS)
+#define PAGE_TABLE_FANOUT_MASK (PAGE_TABLE_FANOUT - 1)
+#define PAGE_TABLE_RESIDENT_WORDS ((PAGE_TABLE_FANOUT + 63) / 64)
+#define PAGE_TABLE_ARENA_CHUNK_SIZE (1llu << 20)
+
+typedef struct {
+  page_table_entry_t entry;
+  pte_metadata_t metadata;
+} page_table_slot_t;
+
+// Every node tracks which of its children (or entries, in leaves) have at
+// least one valid page below them, so the lowest resident page can be found
+// without visiting the whole tree.
+typedef struct {
+  uint64_t resident[PAGE_TABLE_RESIDENT_WORDS];
+  void* children[PAGE_TABLE_FANOUT];
+} page_table_node_t;
+
+typedef struct {
+  uint64_t resident[PAGE_TABLE_RESIDENT_WORDS];
+  page_table_slot_t slots[PAGE_TABLE_FANOUT];
+
+  // The entry above this leaf maps its pages as one huge page.
+  bool huge;
+} page_table_leaf_t;
+
+typedef struct arena_chunk_t {
+  struct arena_chunk_t* next;
+  size_t used;
+  size_t size;
+  _Alignas(16) char data[];
+} arena_chunk_t;
+
+arena_chunk_t* page_table_arena = NULL;
+void* page_table_roots[MAX_ASIDS];
+
+// Roots above this ASID were never allocated.
+unsigned page_table_asids = 0;
+uint64_t page_table_nodes = 0;
+uint64_t page_table_bytes = 0;
+uint64_t page_walk_accesses = 0;
 
-bool allocated_dram_pages[DRAM_PAGE_CAPACITY];
+uint64_t huge_page_faults = 0;
+uint64_t huge_page_promotions = 0;
+uint64_t huge_page_demotions = 0;
 
-page_table_entry_t* get_free_page_table_entry() {
-  for (va_t virtual_page_number = 0; virtual_page_number < TOTAL_PAGES;
-       virtual_page_number++) {
-    if (!page_table[virtual_page_number].valid) {
-      return &page_table[virtual_page_number];
+// Free DRAM frames (bit set = free).
+bitmap_t free_dram_frames;
+
+// Circular list of resident pages. The hand is the next page the policy
+// looks at; new pages are inserted right behind it.
+va_t resident_hand = 0;
+uint64_t resident_count = 0;
+
+void* arena_alloc(size_t size) {
+  size = (size + 15) & ~(size_t)15;
+
+  if (!page_table_arena ||
+      page_table_arena->size - page_table_arena->used < size) {
+    size_t chunk_size = size > PAGE_TABLE_ARENA_CHUNK_SIZE
+                            ? size
+                            : PAGE_TABLE_ARENA_CHUNK_SIZE;
+    arena_chunk_t* chunk = calloc(1, sizeof(arena_chunk_t) + chunk_size);
+    if (!chunk) {
+      panic("Failed to allocate page table memory");
     }
+    chunk->size = chunk_size;
+    chunk->next = page_table_arena;
+    page_table_arena = chunk;
   }
+
+  void* allocation = page_table_arena->data + page_table_arena->used;
+  page_table_arena->used += size;
+  page_table_bytes += size;
+  return allocation;
+}
+
+void arena_release() {
+  while (page_table_arena) {
+    arena_chunk_t* next = page_table_arena->next;
+    free(page_table_arena);
+    page_table_arena = next;
+  }
+  page_table_bytes = 0;
+}
+
+static inline uint64_t page_table_index(va_t virtual_page_number,
+                                        unsigned level) {
+  return ((virtual_page_number & PAGE_INDEX_MASK) >>
+          (PAGE_TABLE_LEVEL_BITS * (PAGE_TABLE_LEVELS - 1 - level))) &
+         PAGE_TABLE_FANOUT_MASK;
+}
+
+// Walks the tree down to the slot of a page, allocating missing nodes if
+// `create` is set. Returns NULL if the page was never touched otherwise.
+// `nodes`, if given, receives the node of every level on the way.
+page_table_slot_t* get_slot(va_t virtual_page_number, bool create,
+                            void* nodes[PAGE_TABLE_LEVELS]) {
+  unsigned asid = page_key_asid(virtual_page_number);
+  void** link = &page_table_roots[asid];
+
+  for (unsigned level = 0; level < PAGE_TABLE_LEVELS; level++) {
+    bool is_leaf = level == PAGE_TABLE_LEVELS - 1;
+
+    if (!*link) {
+      if (!create) {
+        return NULL;
+      }
+      if (asid >= page_table_asids) {
+        page_table_asids = asid + 1;
+      }
+      *link = arena_alloc(is_leaf ? sizeof(page_table_leaf_t)
+                                  : sizeof(page_table_node_t));
+      page_table_nodes++;
+    }
+
+    if (nodes) {
+      nodes[level] = *link;
+    }
+
+    uint64_t index = page_table_index(virtual_page_number, level);
+    if (is_leaf) {
+      return &((page_table_leaf_t*)*link)->slots[index];
+    }
+    link = &((page_table_node_t*)*link)->children[index];
+  }
+
   return NULL;
 }
 
-bool allocate_dram_page(pa_dram_t* dram_page_address) {
-  // Very inefficient (but simple) way of finding a free DRAM page.
-  for (pa_dram_t dram_page_number = 0; dram_page_number < DRAM_PAGE_CAPACITY;
-       dram_page_number++) {
-    if (dram_page_number == PAGE_TABLE_DRAM_ADDRESS) {
+static inline page_table_entry_t* get_pte(va_t virtual_page_number) {
+  return &get_slot(virtual_page_number, false, NULL)->entry;
+}
+
+static inline pte_metadata_t* get_metadata(va_t virtual_page_number) {
+  return &get_slot(virtual_page_number, false, NULL)->metadata;
+}
+
+// Marks a page as resident (or not) in the occupancy bits of its path.
+// When a node loses its last resident page, its bit in the parent is cleared.
+void set_resident(va_t virtual_page_number, bool resident) {
+  void* nodes[PAGE_TABLE_LEVELS];
+  get_slot(virtual_page_number, false, nodes);
+
+  for (int level = PAGE_TABLE_LEVELS - 1; level >= 0; level--) {
+    // Both node types start with the occupancy bits.
+    uint64_t* bits = nodes[level];
+    uint64_t index = page_table_index(virtual_page_number, level);
+
+    if (resident) {
+      bits[index / 64] |= 1llu << (index % 64);
       continue;
     }
 
-    if (!allocated_dram_pages[dram_page_number]) {
-      allocated_dram_pages[dram_page_number] = true;
-      *dram_page_address = dram_page_number << PAGE_SIZE_BITS;
+    bits[index / 64] &= ~(1llu << (index % 64));
+    for (unsigned word = 0; word < PAGE_TABLE_RESIDENT_WORDS; word++) {
+      if (bits[word]) {
+        return;
+      }
+    }
+  }
+}
+
+static inline bool has_resident_pages(const void* node) {
+  const uint64_t* bits = node;
+  for (unsigned word = 0; word < PAGE_TABLE_RESIDENT_WORDS; word++) {
+    if (bits[word]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Lowest resident page key, i.e. lowest VPN of the lowest ASID with resident
+// pages. There must be at least one.
+va_t get_lowest_resident_page() {
+  unsigned asid = 0;
+  while (!page_table_roots[asid] ||
+         !has_resident_pages(page_table_roots[asid])) {
+    asid++;
+  }
+
+  va_t virtual_page_number = 0;
+  void* node = page_table_roots[asid];
+
+  for (unsigned level = 0; level < PAGE_TABLE_LEVELS; level++) {
+    uint64_t* bits = node;
+    unsigned word = 0;
+    while (!bits[word]) {
+      word++;
+    }
+    uint64_t index = word * 64 + __builtin_ctzll(bits[word]);
+
+    virtual_page_number =
+        (virtual_page_number << PAGE_TABLE_LEVEL_BITS) | index;
+    if (level < PAGE_TABLE_LEVELS - 1) {
+      node = ((page_table_node_t*)node)->children[index];
+    }
+  }
+
+  return page_key(asid, virtual_page_number);
+}
+
+void free_dram_page(pa_dram_t dram_page_number) {
+  if (dram_page_number >= DRAM_PAGE_CAPACITY ||
+      dram_page_number == PAGE_TABLE_DRAM_ADDRESS) {
+    return;
+  }
+  bitmap_set(&free_dram_frames, dram_page_number);
+}
+
+bool allocate_dram_page(pa_dram_t* dram_page_address) {
+  // Always hands out the lowest free frame.
+  pa_dram_t dram_page_number = bitmap_find_first(&free_dram_frames);
+  if (dram_page_number == DRAM_PAGE_CAPACITY) {
+    return false;
+  }
+
+  bitmap_clear(&free_dram_frames, dram_page_number);
+  *dram_page_address = dram_page_number << PAGE_SIZE_BITS;
+  return true;
+}
+
+// Takes the lowest aligned block of HUGE_PAGE_PAGES free frames.
+bool allocate_dram_block(pa_dram_t* first_dram_page_number) {
+  uint64_t first = bitmap_find_block(&free_dram_frames, HUGE_PAGE_PAGES);
+  if (first == DRAM_PAGE_CAPACITY) {
+    return false;
+  }
+
+  for (uint64_t page = 0; page < HUGE_PAGE_PAGES; page++) {
+    bitmap_clear(&free_dram_frames, first + page);
+  }
+  *first_dram_page_number = first;
+  return true;
+}
+
+// Disk address that keeps an evicted page next to the closest swapped page of
+// its cluster of the address space: the slot right after that page's if it is
+// below, right before if it is above, so that pages swapped out in any order
+// end up in address order. 0 if no page of the cluster is swapped.
+pa_disk_t get_swap_hint(va_t virtual_page_number) {
+  va_t first = virtual_page_number & ~(va_t)(SWAP_CLUSTER_PAGES - 1);
+  for (va_t distance = 1; distance < SWAP_CLUSTER_PAGES; distance++) {
+    va_t neighbours[2] = {virtual_page_number - distance,
+                          virtual_page_number + distance};
+    for (unsigned i = 0; i < 2; i++) {
+      va_t neighbour = neighbours[i];
+      if (neighbour < first || neighbour >= first + SWAP_CLUSTER_PAGES) {
+        continue;
+      }
+      page_table_slot_t* slot = get_slot(neighbour, false, NULL);
+      if (slot && slot->metadata.is_swapped) {
+        pa_disk_t disk_page_number = slot->metadata.disk_page_number;
+        return (i == 0 ? disk_page_number + 1 : disk_page_number - 1)
+               << PAGE_SIZE_BITS;
+      }
+    }
+  }
+  return 0;
+}
+
+// ========================================================================
+// Page replacement policies.
+// Every policy is told when a page becomes resident, and picks (and forgets)
+// the page to evict. Reference bits are kept up to date by
+// page_table_reference() for all of them, but only some read them.
+// ========================================================================
+
+typedef struct {
+  void (*on_map)(va_t virtual_page_number);
+  va_t (*select_victim)();
+  bool reads_references;
+} page_replacement_policy_t;
+
+void resident_list_insert(va_t virtual_page_number) {
+  pte_metadata_t* metadata = get_metadata(virtual_page_number);
+
+  if (resident_count == 0) {
+    metadata->resident_prev = virtual_page_number;
+    metadata->resident_next = virtual_page_number;
+    resident_hand = virtual_page_number;
+  } else {
+    va_t prev = get_metadata(resident_hand)->resident_prev;
+    metadata->resident_prev = prev;
+    metadata->resident_next = resident_hand;
+    get_metadata(prev)->resident_next = virtual_page_number;
+    get_metadata(resident_hand)->resident_prev = virtual_page_number;
+  }
+  resident_count++;
+}
+
+void resident_list_remove(va_t virtual_page_number) {
+  pte_metadata_t* metadata = get_metadata(virtual_page_number);
+
+  if (resident_hand == virtual_page_number) {
+    resident_hand = metadata->resident_next;
+  }
+  get_metadata(metadata->resident_prev)->resident_next = metadata->resident_next;
+  get_metadata(metadata->resident_next)->resident_prev = metadata->resident_prev;
+  resident_count--;
+}
+
+va_t advance_hand() {
+  replacement_scans++;
+  va_t current = resident_hand;
+  resident_hand = get_metadata(current)->resident_next;
+  return current;
+}
+
+// Lowest resident VPN, the original behaviour of the simulator.
+void lowest_on_map(va_t virtual_page_number) { (void)virtual_page_number; }
+
+va_t lowest_select_victim() { return get_lowest_resident_page(); }
+
+// First in, first out: the hand always points to the oldest page.
+va_t fifo_select_victim() {
+  va_t victim = resident_hand;
+  resident_list_remove(victim);
+  return victim;
+}
+
+// Second chance: referenced pages get their bit cleared and are skipped once.
+va_t clock_select_victim() {
+  while (get_metadata(resident_hand)->referenced) {
+    get_metadata(advance_hand())->referenced = false;
+  }
+
+  va_t victim = resident_hand;
+  resident_list_remove(victim);
+  return victim;
+}
+
+// LRU approximation by aging: every time the hand passes a page, its 8-bit
+// age is shifted right and the reference bit enters as the most significant
+// bit. The first page whose age drops to 0 (not referenced in its last 8
+// sweeps) is evicted, so a victim is found in at most 8 revolutions.
+va_t aging_select_victim() {
+  for (;;) {
+    pte_metadata_t* metadata = get_metadata(resident_hand);
+    metadata->age = (metadata->age >> 1) | (metadata->referenced ? 0x80 : 0);
+    metadata->referenced = false;
+
+    if (metadata->age == 0) {
+      va_t victim = resident_hand;
+      resident_list_remove(victim);
+      return victim;
+    }
+    advance_hand();
+  }
+}
+
+// WSClock: pages referenced since the last pass are in the working set.
+// Otherwise, pages unused for more than tau references are out of it, and
+// clean ones are evicted first. The hand looks at no more than
+// WSCLOCK_SCAN_LIMIT pages per fault: if no clean page is out of the working
+// set by then, the first dirty one is evicted, else the first unreferenced
+// page, else the page under the hand.
+#define WSCLOCK_SCAN_LIMIT 1024
+
+va_t wsclock_select_victim() {
+  bool found_dirty = false;
+  va_t first_dirty = resident_hand;
+  bool found_unreferenced = false;
+  va_t first_unreferenced = resident_hand;
+
+  uint64_t scan = resident_count < WSCLOCK_SCAN_LIMIT ? resident_count
+                                                      : WSCLOCK_SCAN_LIMIT;
+  for (uint64_t i = 0; i < scan; i++) {
+    va_t current = resident_hand;
+    pte_metadata_t* metadata = get_metadata(current);
+
+    if (metadata->referenced) {
+      metadata->referenced = false;
+      metadata->last_use = virtual_time;
+    } else if (virtual_time - metadata->last_use >
+               page_table_config.wsclock_tau) {
+      if (!get_pte(current)->dirty) {
+        resident_list_remove(current);
+        return current;
+      }
+      if (!found_dirty) {
+        found_dirty = true;
+        first_dirty = current;
+      }
+    } else if (!found_unreferenced) {
+      found_unreferenced = true;
+      first_unreferenced = current;
+    }
+
+    advance_hand();
+  }
+
+  va_t victim = found_dirty          ? first_dirty
+                : found_unreferenced ? first_unreferenced
+                                     : resident_hand;
+  resident_list_remove(victim);
+  return victim;
+}
+
+const page_replacement_policy_t page_replacement_policies[] = {
+    [PAGE_REPLACEMENT_LOWEST] = {lowest_on_map, lowest_select_victim, false},
+    [PAGE_REPLACEMENT_FIFO] = {resident_list_insert, fifo_select_victim,
+                               false},
+    [PAGE_REPLACEMENT_CLOCK] = {resident_list_insert, clock_select_victim,
+                                true},
+    [PAGE_REPLACEMENT_AGING] = {resident_list_insert, aging_select_victim,
+                                true},
+    [PAGE_REPLACEMENT_WSCLOCK] = {resident_list_insert, wsclock_select_victim,
+                                  true},
+};
+
+const char* page_replacement_name(page_replacement_t replacement) {
+  switch (replacement) {
+    case PAGE_REPLACEMENT_LOWEST:
+      return "lowest";
+    case PAGE_REPLACEMENT_FIFO:
+      return "fifo";
+    case PAGE_REPLACEMENT_CLOCK:
+      return "clock";
+    case PAGE_REPLACEMENT_AGING:
+      return "aging";
+    case PAGE_REPLACEMENT_WSCLOCK:
+      return "wsclock";
+  }
+  return "?";
+}
+
+const char* huge_pages_name(huge_pages_t huge_pages) {
+  switch (huge_pages) {
+    case HUGE_PAGES_OFF:
+      return "off";
+    case HUGE_PAGES_ALWAYS:
+      return "always";
+    case HUGE_PAGES_PROMOTE:
+      return "promote";
+  }
+  return "?";
+}
+
+const char* page_walk_name(page_walk_t walk) {
+  switch (walk) {
+    case PAGE_WALK_FLAT:
+      return "flat";
+    case PAGE_WALK_RADIX:
+      return "radix";
+  }
+  return "?";
+}
+
+// ========================================================================
+// Huge pages.
+// A huge page is a leaf whose HUGE_PAGE_PAGES slots are all valid and map an
+// aligned block of contiguous frames. The pages keep their own slots, so the
+// replacement policies still handle them one by one: the leaf flag only
+// shortens the walk and lets the TLBs map the region with a single entry.
+// ========================================================================
+
+static inline va_t huge_page_first_page(va_t virtual_page_number) {
+  return virtual_page_number & ~(HUGE_PAGE_PAGES - 1);
+}
+
+page_table_leaf_t* get_leaf(va_t virtual_page_number, bool create) {
+  void* nodes[PAGE_TABLE_LEVELS];
+  if (!get_slot(virtual_page_number, create, nodes)) {
+    return NULL;
+  }
+  return nodes[PAGE_TABLE_LEVELS - 1];
+}
+
+uint64_t count_resident_pages(const page_table_leaf_t* leaf) {
+  uint64_t count = 0;
+  for (unsigned word = 0; word < PAGE_TABLE_RESIDENT_WORDS; word++) {
+    count += __builtin_popcountll(leaf->resident[word]);
+  }
+  return count;
+}
+
+bool has_swapped_pages(const page_table_leaf_t* leaf) {
+  for (uint64_t page = 0; page < HUGE_PAGE_PAGES; page++) {
+    if (leaf->slots[page].metadata.is_swapped) {
       return true;
     }
   }
   return false;
 }
 
-pa_disk_t allocate_disk_page() {
-  // Let's assume there is always a free disk page available, and ignore all the
-  // complexity behind the actual process of finding an available disk page (for
-  // simulation purposes). We simulate this by generating a random disk page
-  // address.
-  pa_disk_t disk_page_address = RANDOM_PAGE_ADDRESS_BASE;
-  disk_page_address <<= 32;
-  disk_page_address |= RANDOM_PAGE_ADDRESS_IT;
-  disk_page_address &= DISK_ADDRESS_MASK;
+// Makes a page resident in the given frame.
+void map_page(va_t virtual_page_number, page_table_slot_t* slot,
+              pa_dram_t dram_page_number) {
+  cache_flush_page(dram_page_number);
+  page_table_entry_t* entry = &slot->entry;
+  entry->dram_page_number = dram_page_number;
+  entry->valid = true;
+  entry->dirty = false;
+
+  pte_metadata_t* metadata = &slot->metadata;
+  metadata->referenced = true;
+  metadata->age = 0;
+  metadata->last_use = virtual_time;
+  set_resident(virtual_page_number, true);
+  page_replacement_policies[page_table_config.replacement].on_map(
+      virtual_page_number);
+}
+
+// The walk cache may hold the entry above the leaf, which now maps something
+// else.
+void set_huge(page_table_leaf_t* leaf, va_t virtual_page_number, bool huge) {
+  leaf->huge = huge;
+  page_walk_cache_invalidate(virtual_page_number, PAGE_TABLE_LEVELS - 2);
+}
+
+// Maps the whole region of a faulting page as a huge page, if none of its
+// pages is resident or swapped and DRAM has a free aligned block.
+bool fault_huge_page(va_t virtual_page_number) {
+  page_table_leaf_t* leaf = get_leaf(virtual_page_number, false);
+  if (leaf && (count_resident_pages(leaf) || has_swapped_pages(leaf))) {
+    return false;
+  }
+
+  pa_dram_t first_dram_page_number;
+  if (!allocate_dram_block(&first_dram_page_number)) {
+    return false;
+  }
+
+  va_t first_page = huge_page_first_page(virtual_page_number);
+  leaf = get_leaf(virtual_page_number, true);
+  for (uint64_t page = 0; page < HUGE_PAGE_PAGES; page++) {
+    map_page(first_page + page, &leaf->slots[page],
+             first_dram_page_number + page);
+  }
+  set_huge(leaf, virtual_page_number, true);
+  dram_access(PAGE_TABLE_DRAM_ADDRESS, OP_WRITE);
+
+  huge_page_faults++;
+  log_dbg("***** Mapped huge page %" PRIx64 " *****",
+          first_page >> HUGE_PAGE_ORDER);
+  return true;
+}
+
+// Promotes the region of a page that just became resident once enough of its
+// pages are resident: they are copied into a free aligned block, and the rest
+// of the region is mapped next to them.
+void promote_huge_page(va_t virtual_page_number) {
+  page_table_leaf_t* leaf = get_leaf(virtual_page_number, false);
+  if (leaf->huge ||
+      count_resident_pages(leaf) < page_table_config.huge_promote_threshold ||
+      has_swapped_pages(leaf)) {
+    return;
+  }
+
+  pa_dram_t first_dram_page_number;
+  if (!allocate_dram_block(&first_dram_page_number)) {
+    return;
+  }
+
+  va_t first_page = huge_page_first_page(virtual_page_number);
+  for (uint64_t page = 0; page < HUGE_PAGE_PAGES; page++) {
+    page_table_slot_t* slot = &leaf->slots[page];
+    pa_dram_t dram_page_number = first_dram_page_number + page;
+
+    if (!slot->entry.valid) {
+      map_page(first_page + page, slot, dram_page_number);
+      continue;
+    }
+
+    // The TLBs still point to the old frame.
+    tlb_shootdown(first_page + page, slot->metadata.tlb_cores);
+    slot->metadata.tlb_cores = 0;
+    dram_access(slot->entry.dram_page_number << PAGE_SIZE_BITS, OP_READ);
+    dram_access(dram_page_number << PAGE_SIZE_BITS, OP_WRITE);
+    cache_flush_page(dram_page_number);
+    free_dram_page(slot->entry.dram_page_number);
+    slot->entry.dram_page_number = dram_page_number;
+  }
+  set_huge(leaf, virtual_page_number, true);
+  dram_access(PAGE_TABLE_DRAM_ADDRESS, OP_WRITE);
+
+  huge_page_promotions++;
+  log_dbg("***** Promoted huge page %" PRIx64 " *****",
+          first_page >> HUGE_PAGE_ORDER);
+}
+
+// Splits a huge page back into base pages, which stay resident.
+void demote_huge_page(va_t virtual_page_number, page_table_leaf_t* leaf) {
+  uint64_t tlb_cores = 0;
+  for (uint64_t page = 0; page < HUGE_PAGE_PAGES; page++) {
+    tlb_cores |= leaf->slots[page].metadata.tlb_cores;
+    leaf->slots[page].metadata.tlb_cores = 0;
+  }
 
-  RANDOM_PAGE_ADDRESS_IT += PAGE_SIZE_BYTES;
+  set_huge(leaf, virtual_page_number, false);
+  tlb_shootdown_huge(virtual_page_number >> HUGE_PAGE_ORDER, tlb_cores);
 
-  return disk_page_address;
+  huge_page_demotions++;
+  log_dbg("***** Split huge page %" PRIx64 " *****",
+          virtual_page_number >> HUGE_PAGE_ORDER);
 }
 
 pa_dram_t randomly_evict_page_from_dram() {
   page_evictions++;
 
-  va_t evicted_virtual_page_number = PAGE_TABLE_DRAM_ADDRESS;
-  while (!page_table[evicted_virtual_page_number].valid) {
-    evicted_virtual_page_number++;
+  va_t evicted_virtual_page_number =
+      page_replacement_policies[page_table_config.replacement].select_victim();
+  page_table_leaf_t* leaf = get_leaf(evicted_virtual_page_number, false);
+  if (leaf->huge) {
+    demote_huge_page(evicted_virtual_page_number, leaf);
   }
 
-  if (page_table[evicted_virtual_page_number].dirty) {
+  page_table_slot_t* slot = get_slot(evicted_virtual_page_number, false, NULL);
+
+  // Dirty lines go back to the frame before it is written out
+  cache_flush_page(slot->entry.dram_page_number);
+
+  bool is_dirty = slot->entry.dirty;
+  if (is_dirty) {
+    dirty_page_evictions++;
     log_dbg("***** Evicting dirty page %" PRIx64 " to disk *****",
             evicted_virtual_page_number);
 
-    pa_disk_t disk_page_address = allocate_disk_page();
-    pte_metadata[evicted_virtual_page_number].is_swapped = true;
-    pte_metadata[evicted_virtual_page_number].disk_page_number =
-        disk_page_address >> PAGE_SIZE_BITS;
+    pa_disk_t hint = 0;
+    if (page_table_config.swap.placement == SWAP_PLACEMENT_CLUSTER) {
+      hint = get_swap_hint(evicted_virtual_page_number);
+    }
+    pa_disk_t disk_page_address = swap_alloc(evicted_virtual_page_number, hint);
+    slot->metadata.is_swapped = true;
+    slot->metadata.disk_page_number = disk_page_address >> PAGE_SIZE_BITS;
 
-    disk_access(disk_page_address, OP_WRITE);
+    if (write_buffer_enabled()) {
+      write_buffer_add(evicted_virtual_page_number, disk_page_address);
+    } else {
+      disk_access(disk_page_address, OP_WRITE);
+    }
   } else {
     log_dbg("***** Evicting page %" PRIx64 " *****",
             evicted_virtual_page_number);
   }
 
-  page_table[evicted_virtual_page_number].valid = false;
-  page_table[evicted_virtual_page_number].dirty = false;
+  pa_dram_t dram_page_number = slot->entry.dram_page_number;
+  slot->entry.valid = false;
+  slot->entry.dirty = false;
+  set_resident(evicted_virtual_page_number, false);
 
-  allocated_dram_pages[evicted_virtual_page_number] = false;
+  // The original policy hands the faulting page the frame numbered after the
+  // evicted VPN, and frees that frame. It is kept as is so that the reference
+  // outputs stay valid, but only while that number is a frame: keys of wide
+  // VPNs or of ASIDs other than 0 would alias a frame another page holds. The
+  // other policies, and those keys, reuse the evicted page's frame.
+  if (page_table_config.replacement == PAGE_REPLACEMENT_LOWEST &&
+      evicted_virtual_page_number < DRAM_PAGE_CAPACITY) {
+    dram_page_number = evicted_virtual_page_number;
+    free_dram_page(dram_page_number);
+  }
 
-  tlb_invalidate(evicted_virtual_page_number);
+  event_emit(EVENT_EVICTION, is_dirty ? OP_WRITE : OP_READ, 0,
+             evicted_virtual_page_number, dram_page_number);
+
+  tlb_shootdown(evicted_virtual_page_number, slot->metadata.tlb_cores);
+  slot->metadata.tlb_cores = 0;
   dram_access(PAGE_TABLE_DRAM_ADDRESS, OP_READ);
 
-  return evicted_virtual_page_number << PAGE_SIZE_BITS;
+  return dram_page_number << PAGE_SIZE_BITS;
 }
 
 void page_fault_handler(va_t virtual_page_number) {
   log_dbg("***** Page fault! *****");
   page_faults++;
 
+  if (page_table_config.huge_pages == HUGE_PAGES_ALWAYS &&
+      fault_huge_page(virtual_page_number)) {
+    event_emit(EVENT_PAGE_FAULT, OP_READ, 0, virtual_page_number,
+               get_pte(virtual_page_number)->dram_page_number);
+    return;
+  }
+
   pa_dram_t page_dram_address;
   if (!allocate_dram_page(&page_dram_address)) {
     page_dram_address = randomly_evict_page_from_dram();
   }
 
-  page_table_entry_t* entry = &page_table[virtual_page_number];
-  entry->dram_page_number = page_dram_address >> PAGE_SIZE_BITS;
-  entry->valid = true;
-  entry->dirty = false;
+  page_table_slot_t* slot = get_slot(virtual_page_number, true, NULL);
+  map_page(virtual_page_number, slot, page_dram_address >> PAGE_SIZE_BITS);
+  event_emit(EVENT_PAGE_FAULT, OP_READ, 0, virtual_page_number,
+             page_dram_address >> PAGE_SIZE_BITS);
   dram_access(PAGE_TABLE_DRAM_ADDRESS, OP_WRITE);
 
-  if (pte_metadata[virtual_page_number].is_swapped) {
-    log_dbg("***** Page %" PRIx64 " is swapped, loading from disk *****",
-            virtual_page_number);
-    pa_disk_t disk_address = pte_metadata[virtual_page_number].disk_page_number
-                             << PAGE_SIZE_BITS;
-    disk_access(disk_address, OP_READ);
+  pte_metadata_t* metadata = &slot->metadata;
+  if (metadata->is_swapped) {
+    pa_disk_t disk_address = metadata->disk_page_number << PAGE_SIZE_BITS;
+    if (write_buffer_take(virtual_page_number)) {
+      // Still in the write buffer: copied from there, no disk read
+      log_dbg("***** Page %" PRIx64 " is swapped, loading from the write "
+              "buffer *****",
+              virtual_page_number);
+    } else {
+      log_dbg("***** Page %" PRIx64 " is swapped, loading from disk *****",
+              virtual_page_number);
+      swap_read(disk_address);
+    }
     dram_access(page_dram_address, OP_WRITE);
-    pte_metadata[virtual_page_number].is_swapped = false;
+    swap_free(disk_address);
+    metadata->is_swapped = false;
+  }
+
+  if (page_table_config.huge_pages == HUGE_PAGES_PROMOTE) {
+    promote_huge_page(virtual_page_number);
   }
 }
 
-void page_table_init() {
-  memset(page_table, 0, sizeof(page_table));
-  memset(pte_metadata, 0, sizeof(pte_metadata));
-  memset(allocated_dram_pages, 0, sizeof(allocated_dram_pages));
+void page_table_init(const page_table_config_t* config) {
+  page_table_config = *config;
+
+  arena_release();
+  memset(page_table_roots, 0, sizeof(page_table_roots));
+  page_table_asids = 0;
+  page_table_nodes = 0;
+  page_walk_accesses = 0;
+
+  huge_page_faults = 0;
+  huge_page_promotions = 0;
+  huge_page_demotions = 0;
+  if (config->huge_pages != HUGE_PAGES_OFF && PAGE_TABLE_LEVELS < 2) {
+    panic("Huge pages need at least 2 page table levels");
+  }
+
+  if (config->walk_cache.entries && config->walk != PAGE_WALK_RADIX) {
+    panic("The page walk cache needs --page-walk radix");
+  }
+  page_walk_cache_init(&config->walk_cache);
+  write_buffer_init(&config->write_buffer);
+  swap_init(&config->swap);
+
+  bitmap_init(&free_dram_frames, DRAM_PAGE_CAPACITY);
+  for (pa_dram_t dram_page_number = 0; dram_page_number < DRAM_PAGE_CAPACITY;
+       dram_page_number++) {
+    free_dram_page(dram_page_number);
+  }
+
+  resident_hand = 0;
+  resident_count = 0;
+
   page_faults = 0;
   page_evictions = 0;
+  dirty_page_evictions = 0;
+  replacement_scans = 0;
+  virtual_time = 0;
 }
 
-pa_dram_t page_table_translate(va_t virtual_address, op_t op) {
+// Saves or restores the node `*link` of `level` and the nodes below it. Only
+// the children that exist, and the leaf slots that were ever touched, are
+// written.
+void checkpoint_page_table_node(checkpoint_t* checkpoint, void** link,
+                                unsigned level) {
+  bool is_leaf = level == PAGE_TABLE_LEVELS - 1;
+  if (!checkpoint->saving) {
+    *link = arena_alloc(is_leaf ? sizeof(page_table_leaf_t)
+                                : sizeof(page_table_node_t));
+  }
+
+  uint64_t present[PAGE_TABLE_RESIDENT_WORDS] = {0};
+  if (is_leaf) {
+    page_table_leaf_t* leaf = *link;
+    static const page_table_slot_t untouched;
+    for (uint64_t i = 0; checkpoint->saving && i < PAGE_TABLE_FANOUT; i++) {
+      if (memcmp(&leaf->slots[i], &untouched, sizeof(untouched)) != 0) {
+        present[i / 64] |= 1llu << (i % 64);
+      }
+    }
+    CHECKPOINT_VALUE(checkpoint, leaf->resident);
+    CHECKPOINT_VALUE(checkpoint, leaf->huge);
+    CHECKPOINT_VALUE(checkpoint, present);
+    for (uint64_t i = 0; i < PAGE_TABLE_FANOUT; i++) {
+      if (present[i / 64] & (1llu << (i % 64))) {
+        CHECKPOINT_VALUE(checkpoint, leaf->slots[i]);
+      }
+    }
+    return;
+  }
+
+  page_table_node_t* node = *link;
+  for (uint64_t i = 0; checkpoint->saving && i < PAGE_TABLE_FANOUT; i++) {
+    if (node->children[i]) {
+      present[i / 64] |= 1llu << (i % 64);
+    }
+  }
+  CHECKPOINT_VALUE(checkpoint, node->resident);
+  CHECKPOINT_VALUE(checkpoint, present);
+  for (uint64_t i = 0; i < PAGE_TABLE_FANOUT; i++) {
+    if (present[i / 64] & (1llu << (i % 64))) {
+      checkpoint_page_table_node(checkpoint, &node->children[i], level + 1);
+    }
+  }
+}
+
+void page_table_checkpoint(checkpoint_t* checkpoint) {
+  CHECKPOINT_VALUE(checkpoint, page_table_asids);
+  for (unsigned asid = 0; asid < page_table_asids; asid++) {
+    bool present = page_table_roots[asid] != NULL;
+    CHECKPOINT_VALUE(checkpoint, present);
+    if (present) {
+      checkpoint_page_table_node(checkpoint, &page_table_roots[asid], 0);
+    }
+  }
+  CHECKPOINT_VALUE(checkpoint, page_table_nodes);
+  CHECKPOINT_VALUE(checkpoint, page_table_bytes);
+  CHECKPOINT_VALUE(checkpoint, page_walk_accesses);
+
+  CHECKPOINT_VALUE(checkpoint, huge_page_faults);
+  CHECKPOINT_VALUE(checkpoint, huge_page_promotions);
+  CHECKPOINT_VALUE(checkpoint, huge_page_demotions);
+
+  bitmap_checkpoint(&free_dram_frames, checkpoint);
+  CHECKPOINT_VALUE(checkpoint, resident_hand);
+  CHECKPOINT_VALUE(checkpoint, resident_count);
+
+  CHECKPOINT_VALUE(checkpoint, page_faults);
+  CHECKPOINT_VALUE(checkpoint, page_evictions);
+  CHECKPOINT_VALUE(checkpoint, dirty_page_evictions);
+  CHECKPOINT_VALUE(checkpoint, replacement_scans);
+  CHECKPOINT_VALUE(checkpoint, virtual_time);
+
+  page_walk_cache_checkpoint(checkpoint);
+  write_buffer_checkpoint(checkpoint);
+  swap_checkpoint(checkpoint);
+}
+
+// Charges the DRAM reads of a radix walk: one per level, down to the leaf or
+// to the first level whose next node was never allocated. Levels whose entry
+// is in the page walk cache are skipped. When warming, only the page walk
+// cache is updated. Returns the number of levels skipped.
+unsigned charge_page_walk(va_t virtual_page_number, bool warm) {
+  void* node = page_table_roots[page_key_asid(virtual_page_number)];
+  unsigned first_level = 0;
+  if (page_walk_cache_enabled()) {
+    first_level = warm ? page_walk_cache_warm(virtual_page_number)
+                       : page_walk_cache_lookup(virtual_page_number);
+  }
+
+  for (unsigned level = 0; level < PAGE_TABLE_LEVELS; level++) {
+    if (level >= first_level && !warm) {
+      page_walk_accesses++;
+      dram_access(PAGE_TABLE_DRAM_ADDRESS, OP_READ);
+    }
+
+    if (!node || level == PAGE_TABLE_LEVELS - 1) {
+      break;
+    }
+    node = ((page_table_node_t*)node)
+               ->children[page_table_index(virtual_page_number, level)];
+    if (node && level == PAGE_TABLE_LEVELS - 2 &&
+        ((page_table_leaf_t*)node)->huge) {
+      // This entry maps a huge page: there is no leaf to read.
+      break;
+    }
+  }
+  return first_level;
+}
+
+// Caches the upper-level entries of a walk that were not skipped, once its
+// page fault, if any, has built the path: the next walk of the region hits.
+// Nodes are only freed by page_table_init(), which also empties the cache, so
+// cached entries never go stale.
+void fill_page_walk_cache(va_t virtual_page_number, unsigned first_level) {
+  void* node = page_table_roots[page_key_asid(virtual_page_number)];
+  for (unsigned level = 0; node && level < PAGE_TABLE_LEVELS - 1; level++) {
+    node = ((page_table_node_t*)node)
+               ->children[page_table_index(virtual_page_number, level)];
+    if (!node || (level == PAGE_TABLE_LEVELS - 2 &&
+                  ((page_table_leaf_t*)node)->huge)) {
+      return;
+    }
+    if (level >= first_level) {
+      page_walk_cache_fill(virtual_page_number, level);
+    }
+  }
+}
+
+// Walks the page table to the entry of an address, handling its page fault
+// if it is not resident. When warming, the walk itself is not charged.
+pa_dram_t walk_page_table(va_t virtual_address, op_t op, bool warm) {
   virtual_address &= VIRTUAL_ADDRESS_MASK;
 
   va_t virtual_page_number =
@@ -162,14 +958,30 @@ pa_dram_t page_table_translate(va_t virtual_address, op_t op) {
   va_t virtual_page_offset = virtual_address & PAGE_OFFSET_MASK;
   assert(virtual_page_number < TOTAL_PAGES && "Page index out of bounds");
   assert(virtual_page_offset < PAGE_SIZE_BYTES && "Page offset out of bounds");
+  virtual_page_number = page_key(get_current_asid(), virtual_page_number);
 
-  page_table_entry_t* entry = &page_table[virtual_page_number];
-  if (!entry->valid) {
+  bool radix_walk = page_table_config.walk == PAGE_WALK_RADIX;
+  unsigned first_level = 0;
+  if (radix_walk) {
+    first_level = charge_page_walk(virtual_page_number, warm);
+  }
+
+  page_table_slot_t* slot = get_slot(virtual_page_number, false, NULL);
+  if (!slot || !slot->entry.valid) {
     page_fault_handler(virtual_page_number);
-  } else {
+    slot = get_slot(virtual_page_number, false, NULL);
+  } else if (!radix_walk && !warm) {
+    // A flat table is a single DRAM read.
+    page_walk_accesses++;
     dram_access(PAGE_TABLE_DRAM_ADDRESS, OP_READ);
   }
+  if (radix_walk && page_walk_cache_enabled()) {
+    fill_page_walk_cache(virtual_page_number, first_level);
+  }
 
+  slot->metadata.tlb_cores |= 1llu << get_current_core();
+
+  page_table_entry_t* entry = &slot->entry;
   if (op == OP_WRITE) {
     entry->dirty = true;
   }
@@ -182,9 +994,126 @@ pa_dram_t page_table_translate(va_t virtual_address, op_t op) {
   return translated_address;
 }
 
+pa_dram_t page_table_translate(va_t virtual_address, op_t op) {
+  return walk_page_table(virtual_address, op, false);
+}
+
+pa_dram_t page_table_warm(va_t virtual_address, op_t op) {
+  return walk_page_table(virtual_address, op, true);
+}
+
 void write_back_tlb_entry(pa_dram_t physical_address) {
   dram_access(physical_address, OP_WRITE);
 }
 
+bool page_table_is_huge(va_t virtual_address) {
+  va_t virtual_page_number = page_key(
+      get_current_asid(),
+      ((virtual_address & VIRTUAL_ADDRESS_MASK) >> PAGE_SIZE_BITS) &
+          PAGE_INDEX_MASK);
+  page_table_leaf_t* leaf = get_leaf(virtual_page_number, false);
+  return leaf && leaf->huge;
+}
+
+void page_table_reference(va_t virtual_address) {
+  va_t virtual_page_number = page_key(
+      get_current_asid(),
+      ((virtual_address & VIRTUAL_ADDRESS_MASK) >> PAGE_SIZE_BITS) &
+          PAGE_INDEX_MASK);
+  page_table_slot_t* slot = get_slot(virtual_page_number, false, NULL);
+  if (slot) {
+    slot->metadata.referenced = true;
+  }
+  virtual_time++;
+}
+
+void page_table_repeat_references(uint64_t references) {
+  virtual_time += references;
+}
+
+void page_table_warm_reference(va_t virtual_address) {
+  if (page_replacement_policies[page_table_config.replacement]
+          .reads_references) {
+    page_table_reference(virtual_address);
+  } else {
+    virtual_time++;
+  }
+}
+
+void page_table_warm_references(va_t virtual_address, uint64_t references) {
+  if (references == 0) {
+    return;
+  }
+  page_table_warm_reference(virtual_address);
+  virtual_time += references - 1;
+}
+
+bool page_table_probe(va_t virtual_address, pa_dram_t* physical_address) {
+  va_t virtual_page_number = page_key(
+      get_current_asid(),
+      ((virtual_address & VIRTUAL_ADDRESS_MASK) >> PAGE_SIZE_BITS) &
+          PAGE_INDEX_MASK);
+  page_table_leaf_t* leaf = get_leaf(virtual_page_number, false);
+  if (!leaf || leaf->huge) {
+    return false;
+  }
+
+  page_table_slot_t* slot =
+      &leaf->slots[page_table_index(virtual_page_number, PAGE_TABLE_LEVELS - 1)];
+  if (!slot->entry.valid) {
+    return false;
+  }
+
+  // The prefetching core may now cache it.
+  slot->metadata.tlb_cores |= 1llu << get_current_core();
+  *physical_address = slot->entry.dram_page_number << PAGE_SIZE_BITS;
+  return true;
+}
+
+time_ns_t page_table_walk_ns(va_t virtual_address) {
+  if (page_table_config.walk != PAGE_WALK_RADIX) {
+    return DRAM_LATENCY_NS;
+  }
+
+  va_t virtual_page_number = page_key(
+      get_current_asid(),
+      ((virtual_address & VIRTUAL_ADDRESS_MASK) >> PAGE_SIZE_BITS) &
+          PAGE_INDEX_MASK);
+
+  // A huge page is mapped one level up: there is no leaf to read.
+  unsigned levels = PAGE_TABLE_LEVELS;
+  page_table_leaf_t* leaf = get_leaf(virtual_page_number, false);
+  if (leaf && leaf->huge) {
+    levels--;
+  }
+
+  time_ns_t walk_ns = 0;
+  if (page_walk_cache_enabled()) {
+    walk_ns += page_table_config.walk_cache.latency_ns;
+    unsigned skipped = page_walk_cache_probe(virtual_page_number);
+    levels -= skipped < levels ? skipped : levels;
+  }
+  return walk_ns + levels * DRAM_LATENCY_NS;
+}
+
+void page_table_use_prefetch(va_t virtual_address, op_t op) {
+  va_t virtual_page_number = page_key(
+      get_current_asid(),
+      ((virtual_address & VIRTUAL_ADDRESS_MASK) >> PAGE_SIZE_BITS) &
+          PAGE_INDEX_MASK);
+  page_table_slot_t* slot = get_slot(virtual_page_number, false, NULL);
+  if (slot && op == OP_WRITE) {
+    slot->entry.dirty = true;
+  }
+}
+
 uint64_t get_total_page_faults() { return page_faults; }
-uint64_t get_total_page_evictions() { return page_evictions; }
\ No newline at end of file
+uint64_t get_total_page_evictions() { return page_evictions; }
+uint64_t get_total_dirty_page_evictions() { return dirty_page_evictions; }
+uint64_t get_total_replacement_scans() { return replacement_scans; }
+uint64_t get_total_page_walk_accesses() { return page_walk_accesses; }
+uint64_t get_total_huge_page_faults() { return huge_page_faults; }
+uint64_t get_total_huge_page_promotions() { return huge_page_promotions; }
+uint64_t get_total_huge_page_demotions() { return huge_page_demotions; }
+uint64_t get_page_table_nodes() { return page_table_nodes; }
+uint64_t get_page_table_bytes() { return page_table_bytes; }
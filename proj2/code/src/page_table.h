@@ -1,10 +1,143 @@
 #pragma once
 
+#include <stdbool.h>
+
+#include "checkpoint.h"
+#include "constants.h"
 #include "memory.h"
+#include "page_walk_cache.h"
+#include "swap.h"
+#include "write_buffer.h"
+
+// Policy used to pick the page evicted from DRAM when no frame is free.
+// lowest: lowest resident VPN (the original simulator behaviour).
+// fifo: oldest mapped page.
+// clock: second chance over the pages in mapping order.
+// aging: 8-bit aging counters, refreshed by a clock hand (LRU approximation).
+// wsclock: working-set clock, evicting pages unused for more than wsclock_tau
+//          references, clean ones first.
+typedef enum {
+  PAGE_REPLACEMENT_LOWEST,
+  PAGE_REPLACEMENT_FIFO,
+  PAGE_REPLACEMENT_CLOCK,
+  PAGE_REPLACEMENT_AGING,
+  PAGE_REPLACEMENT_WSCLOCK,
+} page_replacement_t;
+
+// Cost model of a page walk.
+// flat: a single DRAM read, as if the table were one flat array (the original
+//       simulator behaviour).
+// radix: one DRAM read per level of the radix table (PAGE_TABLE_LEVELS), like
+//        an x86-64 page walk.
+typedef enum { PAGE_WALK_FLAT, PAGE_WALK_RADIX } page_walk_t;
+
+// Policy used to map huge pages (see HUGE_PAGE_ORDER), similar to Linux
+// transparent huge pages.
+// off: only base pages.
+// always: the first fault in an aligned region where no page is resident or
+//         swapped maps the whole region as a huge page, if DRAM has a free
+//         aligned block for it.
+// promote: once huge_promote_threshold pages of a region are resident (and
+//          none is swapped), they are copied into a free aligned block and the
+//          rest of the region is mapped with them (like khugepaged).
+// A huge page is split back into base pages before one of them is evicted.
+typedef enum { HUGE_PAGES_OFF, HUGE_PAGES_ALWAYS, HUGE_PAGES_PROMOTE } huge_pages_t;
+
+typedef struct {
+  page_replacement_t replacement;
+  uint64_t wsclock_tau;
+  page_walk_t walk;
+  page_walk_cache_config_t walk_cache;
+  huge_pages_t huge_pages;
+  uint64_t huge_promote_threshold;
+  write_buffer_config_t write_buffer;
+  swap_config_t swap;
+} page_table_config_t;
+
+#define PAGE_TABLE_DEFAULT_CONFIG                                    \
+  ((page_table_config_t){PAGE_REPLACEMENT_LOWEST, 4096, PAGE_WALK_FLAT, \
+                         PAGE_WALK_CACHE_DEFAULT_CONFIG, HUGE_PAGES_OFF, \
+                         HUGE_PAGE_PAGES / 2, WRITE_BUFFER_DEFAULT_CONFIG, \
+                         SWAP_DEFAULT_CONFIG})
+
+// Every address space (ASID) has its own page table. Pages are identified
+// across address spaces by page keys, the ASID above the virtual page number:
+// keys of ASID 0 are plain VPNs. The TLBs, the page walk cache and the
+// replacement policies work on keys.
+_Static_assert(VIRTUAL_ADDRESS_BITS - PAGE_SIZE_BITS + ASID_BITS <= 64,
+               "Page keys do not fit in 64 bits");
+
+static inline va_t page_key(unsigned asid, va_t virtual_page_number) {
+  return ((va_t)asid << (VIRTUAL_ADDRESS_BITS - PAGE_SIZE_BITS)) |
+         virtual_page_number;
+}
+
+static inline unsigned page_key_asid(va_t page_key) {
+  return page_key >> (VIRTUAL_ADDRESS_BITS - PAGE_SIZE_BITS);
+}
+
+const char* page_replacement_name(page_replacement_t replacement);
+const char* page_walk_name(page_walk_t walk);
+const char* huge_pages_name(huge_pages_t huge_pages);
+
+// Translations, references and huge page queries are for the address space
+// of the current core (see tlb_select_asid()).
+void page_table_init(const page_table_config_t* config);
 
-void page_table_init();
+// Saves or restores the page tables, the DRAM frames, the replacement state
+// and the swap area. Restoring needs page_table_init() with the same
+// configuration first.
+void page_table_checkpoint(checkpoint_t* checkpoint);
 pa_dram_t page_table_translate(va_t virtual_address, op_t op);
+
+// Same page faults, evictions and swapping as page_table_translate(), for
+// functional warming (see sample.h): the walk is not charged, nor counted.
+// Faults are handled as usual, and cost nothing only with the clock frozen.
+pa_dram_t page_table_warm(va_t virtual_address, op_t op);
+
 void write_back_tlb_entry(pa_dram_t physical_address);
 
+// Is the (valid) page of this address mapped by a huge page?
+bool page_table_is_huge(va_t virtual_address);
+
+// Records a reference to a virtual address, for the replacement policies.
+void page_table_reference(va_t virtual_address);
+
+// Records more references to the page page_table_reference() just saw on the
+// current core. Only the virtual time moves.
+void page_table_repeat_references(uint64_t references);
+
+// Same as page_table_reference(), for functional warming (see sample.h): the
+// reference bit is left alone when the replacement policy never reads it.
+void page_table_warm_reference(va_t virtual_address);
+
+// Same as `references` calls to page_table_warm_reference() for the same
+// address, for batched warming (see tlb_warm_hit()).
+void page_table_warm_references(va_t virtual_address, uint64_t references);
+
+// For TLB prefetches: looks up the translation of a resident base page
+// without charging anything or touching the replacement state. Returns false
+// if the page is not resident, or is part of a huge page.
+bool page_table_probe(va_t virtual_address, pa_dram_t* physical_address);
+
+// Time a demand walk of an address would take now: the page walk cache
+// lookup and the DRAM reads of the levels it does not skip, one level fewer
+// for a huge page. Changes nothing.
+time_ns_t page_table_walk_ns(va_t virtual_address);
+
+// Applies the page table side of a walk to a prefetched translation, when a
+// demand access uses it.
+void page_table_use_prefetch(va_t virtual_address, op_t op);
+
 uint64_t get_total_page_faults();
 uint64_t get_total_page_evictions();
+uint64_t get_total_dirty_page_evictions();
+uint64_t get_total_replacement_scans();
+uint64_t get_total_page_walk_accesses();
+uint64_t get_total_huge_page_faults();
+uint64_t get_total_huge_page_promotions();
+uint64_t get_total_huge_page_demotions();
+
+// Radix table nodes allocated so far, and the memory they use.
+uint64_t get_page_table_nodes();
+uint64_t get_page_table_bytes();
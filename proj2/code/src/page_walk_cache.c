@@ -0,0 +1,206 @@
+#include "page_walk_cache.h"
+
+#include <stdlib.h>
+
+#include "log.h"
+
+typedef struct {
+  bool valid;
+  uint8_t level;
+  va_t tag;
+  uint64_t last_use;
+} page_walk_cache_entry_t;
+
+page_walk_cache_config_t page_walk_cache_config;
+page_walk_cache_entry_t* page_walk_cache_entries = NULL;
+uint64_t page_walk_cache_ways = 0;
+uint64_t page_walk_cache_set_bits = 0;
+uint64_t page_walk_cache_use = 0;
+
+uint64_t page_walk_cache_lookups = 0;
+uint64_t page_walk_cache_hits[PAGE_TABLE_LEVELS] = {0};
+uint64_t page_walk_cache_misses = 0;
+uint64_t page_walk_cache_saved_reads = 0;
+
+void page_walk_cache_init(const page_walk_cache_config_t* config) {
+  page_walk_cache_config = *config;
+
+  free(page_walk_cache_entries);
+  page_walk_cache_entries = NULL;
+  page_walk_cache_use = 0;
+  page_walk_cache_lookups = 0;
+  page_walk_cache_misses = 0;
+  page_walk_cache_saved_reads = 0;
+  for (unsigned level = 0; level < PAGE_TABLE_LEVELS; level++) {
+    page_walk_cache_hits[level] = 0;
+  }
+
+  if (config->entries == 0) {
+    return;
+  }
+
+  page_walk_cache_ways = config->ways ? config->ways : config->entries;
+  if (page_walk_cache_ways > config->entries ||
+      config->entries % page_walk_cache_ways != 0) {
+    panic("Invalid page walk cache geometry: %" PRIu64 " entries, %" PRIu64
+          " ways",
+          config->entries, config->ways);
+  }
+  uint64_t sets = config->entries / page_walk_cache_ways;
+  if ((sets & (sets - 1)) != 0) {
+    panic("Page walk cache sets must be a power of two (got %" PRIu64 ")",
+          sets);
+  }
+  page_walk_cache_set_bits = __builtin_ctzll(sets);
+
+  page_walk_cache_entries =
+      calloc(config->entries, sizeof(page_walk_cache_entry_t));
+  if (!page_walk_cache_entries) {
+    panic("Failed to allocate page walk cache");
+  }
+}
+
+bool page_walk_cache_enabled() { return page_walk_cache_entries != NULL; }
+
+void page_walk_cache_checkpoint(checkpoint_t* checkpoint) {
+  if (page_walk_cache_enabled()) {
+    checkpoint_data(checkpoint, page_walk_cache_entries,
+                    page_walk_cache_config.entries *
+                        sizeof(page_walk_cache_entry_t));
+  }
+  CHECKPOINT_VALUE(checkpoint, page_walk_cache_use);
+  CHECKPOINT_VALUE(checkpoint, page_walk_cache_lookups);
+  CHECKPOINT_VALUE(checkpoint, page_walk_cache_hits);
+  CHECKPOINT_VALUE(checkpoint, page_walk_cache_misses);
+  CHECKPOINT_VALUE(checkpoint, page_walk_cache_saved_reads);
+}
+
+// Virtual page number bits that select the entry of `level`.
+static inline va_t page_walk_cache_tag(va_t virtual_page_number,
+                                       unsigned level) {
+  return virtual_page_number >>
+         (PAGE_TABLE_LEVEL_BITS * (PAGE_TABLE_LEVELS - 1 - level));
+}
+
+// First way of the set of (level, tag), spread with a Fibonacci hash so that
+// the entries of the different levels do not all share the same sets.
+page_walk_cache_entry_t* get_page_walk_cache_set(unsigned level, va_t tag) {
+  if (page_walk_cache_set_bits == 0) {
+    return page_walk_cache_entries;
+  }
+  uint64_t hash = (tag * PAGE_TABLE_LEVELS + level) * 0x9e3779b97f4a7c15llu;
+  uint64_t set = hash >> (64 - page_walk_cache_set_bits);
+  return &page_walk_cache_entries[set * page_walk_cache_ways];
+}
+
+page_walk_cache_entry_t* find_page_walk_cache_entry(unsigned level, va_t tag) {
+  page_walk_cache_entry_t* set = get_page_walk_cache_set(level, tag);
+  for (uint64_t way = 0; way < page_walk_cache_ways; way++) {
+    if (set[way].valid && set[way].level == level && set[way].tag == tag) {
+      return &set[way];
+    }
+  }
+  return NULL;
+}
+
+// Deepest cached entry of a walk, or NULL. Sets `skipped` to the levels the
+// walk can skip.
+page_walk_cache_entry_t* find_deepest_page_walk_cache_entry(
+    va_t virtual_page_number, unsigned* skipped) {
+  // The leaf level is cached by the TLBs, not here.
+  for (unsigned level = PAGE_TABLE_LEVELS - 1; level-- > 0;) {
+    page_walk_cache_entry_t* entry = find_page_walk_cache_entry(
+        level, page_walk_cache_tag(virtual_page_number, level));
+    if (entry) {
+      *skipped = level + 1;
+      return entry;
+    }
+  }
+  *skipped = 0;
+  return NULL;
+}
+
+// Deepest cached entry of a walk, made the most recently used. Returns the
+// levels the walk can skip.
+unsigned touch_page_walk_cache(va_t virtual_page_number) {
+  unsigned skipped;
+  page_walk_cache_entry_t* entry =
+      find_deepest_page_walk_cache_entry(virtual_page_number, &skipped);
+  if (entry) {
+    entry->last_use = ++page_walk_cache_use;
+  }
+  return skipped;
+}
+
+unsigned page_walk_cache_lookup(va_t virtual_page_number) {
+  page_walk_cache_lookups++;
+  increment_time(TIME_MEMORY, page_walk_cache_config.latency_ns);
+
+  unsigned skipped = touch_page_walk_cache(virtual_page_number);
+  if (skipped) {
+    page_walk_cache_hits[skipped - 1]++;
+    page_walk_cache_saved_reads += skipped;
+    log_dbg("Page walk cache hit (VPN=%" PRIx64 " level=%u)",
+            virtual_page_number, skipped - 1);
+    return skipped;
+  }
+
+  page_walk_cache_misses++;
+  log_dbg("Page walk cache miss (VPN=%" PRIx64 ")", virtual_page_number);
+  return 0;
+}
+
+unsigned page_walk_cache_warm(va_t virtual_page_number) {
+  return touch_page_walk_cache(virtual_page_number);
+}
+
+unsigned page_walk_cache_probe(va_t virtual_page_number) {
+  unsigned skipped;
+  find_deepest_page_walk_cache_entry(virtual_page_number, &skipped);
+  return skipped;
+}
+
+void page_walk_cache_fill(va_t virtual_page_number, unsigned level) {
+  va_t tag = page_walk_cache_tag(virtual_page_number, level);
+  if (find_page_walk_cache_entry(level, tag)) {
+    return;
+  }
+
+  // Free way, else the least recently used one.
+  page_walk_cache_entry_t* set = get_page_walk_cache_set(level, tag);
+  page_walk_cache_entry_t* victim = &set[0];
+  for (uint64_t way = 0; way < page_walk_cache_ways; way++) {
+    if (!set[way].valid) {
+      victim = &set[way];
+      break;
+    }
+    if (set[way].last_use < victim->last_use) {
+      victim = &set[way];
+    }
+  }
+
+  victim->valid = true;
+  victim->level = level;
+  victim->tag = tag;
+  victim->last_use = ++page_walk_cache_use;
+}
+
+void page_walk_cache_invalidate(va_t virtual_page_number, unsigned level) {
+  if (!page_walk_cache_enabled()) {
+    return;
+  }
+  page_walk_cache_entry_t* entry = find_page_walk_cache_entry(
+      level, page_walk_cache_tag(virtual_page_number, level));
+  if (entry) {
+    entry->valid = false;
+  }
+}
+
+uint64_t get_total_page_walk_cache_lookups() { return page_walk_cache_lookups; }
+uint64_t get_total_page_walk_cache_hits(unsigned level) {
+  return level < PAGE_TABLE_LEVELS ? page_walk_cache_hits[level] : 0;
+}
+uint64_t get_total_page_walk_cache_misses() { return page_walk_cache_misses; }
+uint64_t get_total_page_walk_cache_saved_reads() {
+  return page_walk_cache_saved_reads;
+}
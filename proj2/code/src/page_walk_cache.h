@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "checkpoint.h"
+#include "clock.h"
+#include "constants.h"
+#include "memory.h"
+
+// Paging-structure cache (x86 PML4/PDPT/PD entry caches), only used by radix
+// page walks. It holds upper-level entries of the radix table, tagged by level
+// and by the virtual page number bits that select them, so a walk that hits
+// on the entry of level L starts reading DRAM at level L + 1.
+// entries == 0 disables it. ways == 0 is fully associative.
+typedef struct {
+  uint64_t entries;
+  uint64_t ways;
+  time_ns_t latency_ns;
+} page_walk_cache_config_t;
+
+#define PAGE_WALK_CACHE_DEFAULT_CONFIG ((page_walk_cache_config_t){0, 4, 1})
+
+// (Re)initializes an empty cache. Panics on an invalid geometry.
+void page_walk_cache_init(const page_walk_cache_config_t* config);
+bool page_walk_cache_enabled();
+void page_walk_cache_checkpoint(checkpoint_t* checkpoint);
+
+// Looks up every upper level of a walk at once, charging the cache latency.
+// Returns the number of levels the walk can skip: 0 on a miss, L + 1 on a hit
+// on the entry of level L (the deepest hit wins).
+unsigned page_walk_cache_lookup(va_t virtual_page_number);
+
+// Same as page_walk_cache_lookup(), for functional warming (see sample.h):
+// without time or statistics.
+unsigned page_walk_cache_warm(va_t virtual_page_number);
+
+// Levels page_walk_cache_lookup() would skip now, without changing anything.
+unsigned page_walk_cache_probe(va_t virtual_page_number);
+
+// Caches the entry of `level` that the walk of virtual_page_number just read.
+void page_walk_cache_fill(va_t virtual_page_number, unsigned level);
+
+// Drops the cached entry of `level` for virtual_page_number, if any, when the
+// page table changes what that entry maps.
+void page_walk_cache_invalidate(va_t virtual_page_number, unsigned level);
+
+uint64_t get_total_page_walk_cache_lookups();
+// Hits whose deepest cached entry is at `level` (0 = root).
+uint64_t get_total_page_walk_cache_hits(unsigned level);
+uint64_t get_total_page_walk_cache_misses();
+// DRAM reads avoided by the hits.
+uint64_t get_total_page_walk_cache_saved_reads();
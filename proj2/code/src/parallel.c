@@ -0,0 +1,317 @@
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "cache.h"
+#include "constants.h"
+#include "log.h"
+#include "memory.h"
+#include "page_table.h"
+#include "reuse.h"
+#include "tlb.h"
+
+// Record of a core: its core is implicit.
+typedef struct {
+  va_t address;
+  unsigned asid;
+  op_t op;
+} parallel_record_t;
+
+// Run of consecutive hits to the same page, up to hit `end` (excluded) of the
+// window.
+typedef struct {
+  va_t address;
+  uint64_t end;
+} parallel_run_t;
+
+typedef struct {
+  // Records of the core, in trace order, and the next one.
+  parallel_record_t* records;
+  uint64_t count;
+  uint64_t capacity;
+  uint64_t next;
+
+  // Hits of the window, referenced in the page table at its end: the time
+  // every one started at, and their runs by page. Then the next hit and run
+  // to reference.
+  time_ns_t* hit_times;
+  uint64_t n_hits;
+  parallel_run_t* runs;
+  uint64_t n_runs;
+  uint64_t next_hit;
+  uint64_t next_run;
+
+  // The next record missed in the TLBs and waits for the end of the window.
+  bool pending;
+} parallel_core_t;
+
+parallel_core_t parallel_cores[MAX_CORES];
+unsigned parallel_core_count = 0;
+unsigned parallel_thread_count = 0;
+
+// Written by the main thread between barriers only.
+time_ns_t parallel_window_end = 0;
+bool parallel_done = false;
+pthread_barrier_t parallel_barrier;
+
+// Runs a core until the end of the window, or its first TLB miss or context
+// switch. Only touches the TLBs and clock of the core.
+void run_core(unsigned core_id) {
+  parallel_core_t* core = &parallel_cores[core_id];
+  select_core(core_id);
+
+  while (core->next < core->count && get_time() < parallel_window_end) {
+    const parallel_record_t* record = &core->records[core->next];
+    time_ns_t time = get_time();
+    pa_dram_t physical_address;
+    if (record->asid != get_current_asid() ||
+        !tlb_translate_local(record->address, record->op, &physical_address)) {
+      core->pending = true;
+      return;
+    }
+    if (cache_enabled()) {
+      cache_access(physical_address, record->op);
+    }
+    va_t page = record->address >> PAGE_SIZE_BITS;
+    if (!core->n_runs ||
+        core->runs[core->n_runs - 1].address >> PAGE_SIZE_BITS != page) {
+      core->runs[core->n_runs++] = (parallel_run_t){record->address, 0};
+    }
+    core->hit_times[core->n_hits++] = time;
+    core->runs[core->n_runs - 1].end = core->n_hits;
+    core->next++;
+  }
+}
+
+// Cores are dealt to threads round-robin.
+void run_thread(unsigned thread) {
+  for (unsigned core = thread; core < parallel_core_count;
+       core += parallel_thread_count) {
+    run_core(core);
+  }
+}
+
+void* run_worker(void* arg) {
+  unsigned thread = (unsigned)(uintptr_t)arg;
+  for (;;) {
+    pthread_barrier_wait(&parallel_barrier);
+    if (parallel_done) {
+      return NULL;
+    }
+    run_thread(thread);
+    pthread_barrier_wait(&parallel_barrier);
+  }
+}
+
+// References in the page table the hits of a core up to hit `end`
+// (excluded): one reference per run of hits to the same page, the others
+// only move the virtual time. The hits between two misses commute, so only
+// their order with the misses matters.
+void commit_hits(unsigned core_id, uint64_t end) {
+  parallel_core_t* core = &parallel_cores[core_id];
+  if (core->next_hit == end) {
+    return;
+  }
+  select_core(core_id);
+  while (core->next_hit < end) {
+    const parallel_run_t* run = &core->runs[core->next_run];
+    uint64_t run_end = run->end < end ? run->end : end;
+    page_table_reference(run->address);
+    page_table_repeat_references(run_end - core->next_hit - 1);
+    core->next_hit = run_end;
+    if (run_end == run->end) {
+      core->next_run++;
+    }
+  }
+}
+
+// First hit of a core that comes after a miss of core `miss_id` at `time`:
+// the hits of the missing core come before its miss, the others in
+// simulated-time order, ties by core.
+uint64_t hits_before(unsigned core_id, unsigned miss_id, time_ns_t time) {
+  const parallel_core_t* core = &parallel_cores[core_id];
+  if (core_id == miss_id) {
+    return core->n_hits;
+  }
+  uint64_t low = core->next_hit;
+  uint64_t high = core->n_hits;
+  while (low < high) {
+    uint64_t middle = low + (high - low) / 2;
+    time_ns_t hit_time = core->hit_times[middle];
+    if (hit_time < time || (hit_time == time && core_id < miss_id)) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+// Applies the shared updates of the window, on the main thread while the
+// workers wait at the barrier: the pending misses of the cores, in
+// simulated-time order, ties by core, each after the hits of every core that
+// came before it.
+void commit_window() {
+  for (;;) {
+    parallel_core_t* first = NULL;
+    unsigned first_id = 0;
+    time_ns_t first_time = 0;
+    for (unsigned core_id = 0; core_id < parallel_core_count; core_id++) {
+      time_ns_t time = get_core_time(core_id);
+      if (parallel_cores[core_id].pending && (!first || time < first_time)) {
+        first = &parallel_cores[core_id];
+        first_id = core_id;
+        first_time = time;
+      }
+    }
+    if (!first) {
+      break;
+    }
+
+    for (unsigned core_id = 0; core_id < parallel_core_count; core_id++) {
+      commit_hits(core_id, hits_before(core_id, first_id, first_time));
+    }
+
+    select_core(first_id);
+    const parallel_record_t* record = &first->records[first->next];
+    tlb_select_asid(record->asid);
+    switch (record->op) {
+      case OP_READ:
+        read(record->address);
+        break;
+      case OP_WRITE:
+        write(record->address);
+        break;
+    }
+    first->next++;
+    first->pending = false;
+  }
+
+  for (unsigned core_id = 0; core_id < parallel_core_count; core_id++) {
+    parallel_core_t* core = &parallel_cores[core_id];
+    commit_hits(core_id, core->n_hits);
+    core->n_hits = 0;
+    core->n_runs = 0;
+    core->next_hit = 0;
+    core->next_run = 0;
+  }
+}
+
+// Reads the rest of the trace, split by core, in one pass. Returns the number
+// of records read.
+uint64_t split_trace(trace_reader_t* reader, bool reuse_profile,
+                     unsigned cores) {
+  for (unsigned core = 0; core < cores; core++) {
+    parallel_cores[core] = (parallel_core_t){0};
+  }
+  uint64_t count = 0;
+  trace_record_t record;
+  while (trace_next(reader, &record)) {
+    if (record.core >= cores) {
+      panic("Instruction for core %u, but there are only %u cores",
+            record.core, cores);
+    }
+    if (reuse_profile) {
+      reuse_reference(record.core, record.asid, record.address, record.op);
+    }
+    parallel_core_t* core = &parallel_cores[record.core];
+    if (core->count == core->capacity) {
+      core->capacity = core->capacity ? 2 * core->capacity : 1024;
+      core->records =
+          realloc(core->records, core->capacity * sizeof(parallel_record_t));
+      if (!core->records) {
+        panic("Failed to allocate the instructions of core %u", record.core);
+      }
+    }
+    core->records[core->count++] =
+        (parallel_record_t){record.address, record.asid, record.op};
+    count++;
+  }
+
+  // A window holds at most every record of a core.
+  for (unsigned core = 0; core < cores; core++) {
+    parallel_core_t* parallel_core = &parallel_cores[core];
+    size_t size = (parallel_core->count ? parallel_core->count : 1);
+    parallel_core->hit_times = malloc(size * sizeof(time_ns_t));
+    parallel_core->runs = malloc(size * sizeof(parallel_run_t));
+    if (!parallel_core->hit_times || !parallel_core->runs) {
+      panic("Failed to allocate the instructions of core %u", core);
+    }
+  }
+  return count;
+}
+
+uint64_t parallel_run(trace_reader_t* reader, bool reuse_profile,
+                      unsigned cores, unsigned threads, time_ns_t window_ns) {
+  if (threads == 0 || window_ns == 0) {
+    panic("Invalid parallel run: %u threads, %" PRIu64 " ns windows", threads,
+          window_ns);
+  }
+  if (threads > cores) {
+    threads = cores;
+  }
+
+  // Lookahead: a miss at or after the start of a window reaches the TLBs of
+  // the other cores a shootdown latency later at the earliest, so windows no
+  // longer than that never let a core run past an invalidation it has not
+  // seen. With no latency, windows of 1 ns run the cores in lockstep.
+  time_ns_t lookahead = get_tlb_shootdown_latency();
+  if (window_ns > lookahead) {
+    window_ns = lookahead ? lookahead : 1;
+  }
+
+  log_set_categories("none");
+  uint64_t count = split_trace(reader, reuse_profile, cores);
+  parallel_core_count = cores;
+  parallel_thread_count = threads;
+  parallel_done = false;
+
+  pthread_t workers[MAX_CORES];
+  if (pthread_barrier_init(&parallel_barrier, NULL, threads) != 0) {
+    panic("Failed to create the barrier of the parallel engine");
+  }
+  for (unsigned thread = 1; thread < threads; thread++) {
+    if (pthread_create(&workers[thread], NULL, run_worker,
+                       (void*)(uintptr_t)thread) != 0) {
+      panic("Failed to create parallel thread %u", thread);
+    }
+  }
+
+  for (;;) {
+    bool active = false;
+    time_ns_t window_start = 0;
+    for (unsigned core = 0; core < cores; core++) {
+      if (parallel_cores[core].next < parallel_cores[core].count &&
+          (!active || get_core_time(core) < window_start)) {
+        active = true;
+        window_start = get_core_time(core);
+      }
+    }
+    if (!active) {
+      break;
+    }
+
+    parallel_window_end = window_start + window_ns;
+    pthread_barrier_wait(&parallel_barrier);
+    run_thread(0);
+    pthread_barrier_wait(&parallel_barrier);
+    commit_window();
+  }
+
+  parallel_done = true;
+  pthread_barrier_wait(&parallel_barrier);
+  for (unsigned thread = 1; thread < threads; thread++) {
+    pthread_join(workers[thread], NULL);
+  }
+  pthread_barrier_destroy(&parallel_barrier);
+
+  for (unsigned core = 0; core < cores; core++) {
+    free(parallel_cores[core].records);
+    free(parallel_cores[core].hit_times);
+    free(parallel_cores[core].runs);
+  }
+  select_core(0);
+  return count;
+}
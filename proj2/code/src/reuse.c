@@ -0,0 +1,306 @@
+#include "reuse.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "log.h"
+#include "page_table.h"
+
+// Times a core's Fenwick tree starts with. When a core runs out of times, the
+// pages it marked are renumbered 1, 2, ... in order, and the tree doubles if
+// they fill more than half of it, so it stays within twice the pages.
+#define REUSE_MIN_TIMES (1llu << 16)
+
+// Page of a core, in an open-addressing hash table (linear probing).
+typedef struct {
+  bool used;
+  unsigned core;
+  va_t page;
+
+  // Time of the last reference, on the clock of the core (1, 2, ...).
+  uint64_t last;
+  uint64_t accesses;
+  uint64_t writes;
+} reuse_page_t;
+
+typedef struct {
+  // Fenwick tree over times 1..capacity, with a 1 at the last reference of
+  // every page (tree[0] is unused).
+  uint64_t* tree;
+  uint64_t capacity;
+  uint64_t now;
+  uint64_t pages;
+} reuse_core_t;
+
+reuse_page_t* reuse_pages = NULL;
+uint64_t reuse_pages_capacity = 0;
+uint64_t reuse_pages_count = 0;
+
+reuse_core_t reuse_cores[MAX_CORES];
+
+// References of every reuse distance.
+uint64_t* reuse_histogram = NULL;
+uint64_t reuse_histogram_size = 0;
+
+uint64_t reuse_references = 0;
+uint64_t reuse_cold_misses = 0;
+
+void reuse_init() {
+  free(reuse_pages);
+  reuse_pages = NULL;
+  reuse_pages_capacity = 0;
+  reuse_pages_count = 0;
+
+  for (unsigned core = 0; core < MAX_CORES; core++) {
+    free(reuse_cores[core].tree);
+  }
+  memset(reuse_cores, 0, sizeof(reuse_cores));
+
+  free(reuse_histogram);
+  reuse_histogram = NULL;
+  reuse_histogram_size = 0;
+
+  reuse_references = 0;
+  reuse_cold_misses = 0;
+}
+
+static inline uint64_t reuse_hash(unsigned core, va_t page) {
+  // splitmix64 finalizer
+  uint64_t x = page ^ ((uint64_t)core << 58);
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9llu;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebllu;
+  return x ^ (x >> 31);
+}
+
+reuse_page_t* find_reuse_page_in(reuse_page_t* pages, uint64_t capacity,
+                                 unsigned core, va_t page) {
+  uint64_t i = reuse_hash(core, page) & (capacity - 1);
+  while (pages[i].used && (pages[i].core != core || pages[i].page != page)) {
+    i = (i + 1) & (capacity - 1);
+  }
+  return &pages[i];
+}
+
+// Entry of a page, added (unused) if the core never referenced it.
+reuse_page_t* get_reuse_page(unsigned core, va_t page) {
+  // Keep the table at most half full
+  if (2 * (reuse_pages_count + 1) > reuse_pages_capacity) {
+    uint64_t capacity = reuse_pages_capacity ? 2 * reuse_pages_capacity : 1024;
+    reuse_page_t* pages = calloc(capacity, sizeof(reuse_page_t));
+    if (!pages) {
+      panic("Failed to allocate reuse profile");
+    }
+    for (uint64_t i = 0; i < reuse_pages_capacity; i++) {
+      if (reuse_pages[i].used) {
+        *find_reuse_page_in(pages, capacity, reuse_pages[i].core,
+                            reuse_pages[i].page) = reuse_pages[i];
+      }
+    }
+    free(reuse_pages);
+    reuse_pages = pages;
+    reuse_pages_capacity = capacity;
+  }
+
+  reuse_page_t* entry =
+      find_reuse_page_in(reuse_pages, reuse_pages_capacity, core, page);
+  if (!entry->used) {
+    entry->used = true;
+    entry->core = core;
+    entry->page = page;
+    reuse_pages_count++;
+  }
+  return entry;
+}
+
+static inline void fenwick_add(reuse_core_t* core, uint64_t time,
+                               int64_t delta) {
+  for (; time <= core->capacity; time += time & -time) {
+    core->tree[time] += delta;
+  }
+}
+
+// Marks at times 1..time.
+static inline uint64_t fenwick_prefix(const reuse_core_t* core, uint64_t time) {
+  uint64_t sum = 0;
+  for (; time > 0; time -= time & -time) {
+    sum += core->tree[time];
+  }
+  return sum;
+}
+
+int compare_reuse_last(const void* a, const void* b) {
+  const reuse_page_t* x = *(const reuse_page_t* const*)a;
+  const reuse_page_t* y = *(const reuse_page_t* const*)b;
+  return (x->last > y->last) - (x->last < y->last);
+}
+
+// Renumbers the last references of a core's pages 1..pages, keeping their
+// order, so that the core has free times again.
+void compact_reuse_core(unsigned core_id) {
+  reuse_core_t* core = &reuse_cores[core_id];
+
+  reuse_page_t** pages = malloc((core->pages + 1) * sizeof(reuse_page_t*));
+  if (!pages) {
+    panic("Failed to allocate reuse profile");
+  }
+  uint64_t n = 0;
+  for (uint64_t i = 0; i < reuse_pages_capacity; i++) {
+    if (reuse_pages[i].used && reuse_pages[i].core == core_id &&
+        reuse_pages[i].accesses) {
+      pages[n++] = &reuse_pages[i];
+    }
+  }
+  qsort(pages, n, sizeof(reuse_page_t*), compare_reuse_last);
+  for (uint64_t i = 0; i < n; i++) {
+    pages[i]->last = i + 1;
+  }
+  free(pages);
+
+  uint64_t capacity = core->capacity ? core->capacity : REUSE_MIN_TIMES;
+  while (2 * n > capacity) {
+    capacity *= 2;
+  }
+  if (capacity != core->capacity) {
+    free(core->tree);
+    core->tree = malloc((capacity + 1) * sizeof(uint64_t));
+    if (!core->tree) {
+      panic("Failed to allocate reuse profile");
+    }
+    core->capacity = capacity;
+  }
+
+  // Linear-time build of a tree with a 1 at times 1..n
+  for (uint64_t time = 0; time <= capacity; time++) {
+    core->tree[time] = time >= 1 && time <= n;
+  }
+  for (uint64_t time = 1; time <= capacity; time++) {
+    uint64_t parent = time + (time & -time);
+    if (parent <= capacity) {
+      core->tree[parent] += core->tree[time];
+    }
+  }
+  core->now = n;
+}
+
+void reuse_histogram_add(uint64_t distance) {
+  if (distance >= reuse_histogram_size) {
+    uint64_t size = reuse_histogram_size ? reuse_histogram_size : 1024;
+    while (distance >= size) {
+      size *= 2;
+    }
+    reuse_histogram = realloc(reuse_histogram, size * sizeof(uint64_t));
+    if (!reuse_histogram) {
+      panic("Failed to allocate reuse profile");
+    }
+    memset(reuse_histogram + reuse_histogram_size, 0,
+           (size - reuse_histogram_size) * sizeof(uint64_t));
+    reuse_histogram_size = size;
+  }
+  reuse_histogram[distance]++;
+}
+
+void reuse_reference(unsigned core_id, unsigned asid, va_t address, op_t op) {
+  reuse_core_t* core = &reuse_cores[core_id];
+  if (core->now == core->capacity) {
+    compact_reuse_core(core_id);
+  }
+
+  reuse_page_t* entry =
+      get_reuse_page(core_id, page_key(asid, address >> PAGE_SIZE_BITS));
+  uint64_t now = ++core->now;
+  if (entry->accesses) {
+    // Every mark after the page's own is a distinct page referenced since
+    reuse_histogram_add(core->pages - fenwick_prefix(core, entry->last));
+    fenwick_add(core, entry->last, -1);
+  } else {
+    reuse_cold_misses++;
+    core->pages++;
+  }
+  fenwick_add(core, now, 1);
+
+  entry->last = now;
+  entry->accesses++;
+  if (op == OP_WRITE) {
+    entry->writes++;
+  }
+  reuse_references++;
+}
+
+uint64_t get_reuse_references() { return reuse_references; }
+uint64_t get_reuse_cold_misses() { return reuse_cold_misses; }
+uint64_t get_reuse_pages() { return reuse_pages_count; }
+
+uint64_t get_reuse_misses(uint64_t entries) {
+  uint64_t hits = 0;
+  for (uint64_t distance = 0;
+       distance < entries && distance < reuse_histogram_size; distance++) {
+    hits += reuse_histogram[distance];
+  }
+  return reuse_references - hits;
+}
+
+int compare_reuse_page(const void* a, const void* b) {
+  const reuse_page_t* x = *(const reuse_page_t* const*)a;
+  const reuse_page_t* y = *(const reuse_page_t* const*)b;
+  if (x->core != y->core) {
+    return x->core < y->core ? -1 : 1;
+  }
+  return (x->page > y->page) - (x->page < y->page);
+}
+
+void reuse_write(const char* path) {
+  FILE* file = fopen(path, "w");
+  if (!file) {
+    panic("Failed to open %s", path);
+  }
+
+  fprintf(file, "# %" PRIu64 " references, %" PRIu64 " pages, %" PRIu64
+                " cold misses\n",
+          reuse_references, reuse_pages_count, reuse_cold_misses);
+
+  fprintf(file, "# reuse distance, references\n");
+  for (uint64_t distance = 0; distance < reuse_histogram_size; distance++) {
+    if (reuse_histogram[distance]) {
+      fprintf(file, "%" PRIu64 " %" PRIu64 "\n", distance,
+              reuse_histogram[distance]);
+    }
+  }
+
+  // A TLB of distance + 1 entries is the smallest to hit at that distance
+  fprintf(file, "# TLB entries per core (fully associative LRU), misses, "
+                "miss ratio\n");
+  uint64_t misses = reuse_references;
+  for (uint64_t distance = 0; distance < reuse_histogram_size; distance++) {
+    if (reuse_histogram[distance]) {
+      misses -= reuse_histogram[distance];
+      fprintf(file, "%" PRIu64 " %" PRIu64 " %.6f\n", distance + 1, misses,
+              reuse_references ? (double)misses / reuse_references : 0.0);
+    }
+  }
+
+  fprintf(file, "# core, ASID, virtual page, accesses, writes\n");
+  reuse_page_t** pages = malloc((reuse_pages_count + 1) * sizeof(reuse_page_t*));
+  if (!pages) {
+    panic("Failed to allocate reuse profile");
+  }
+  uint64_t n = 0;
+  for (uint64_t i = 0; i < reuse_pages_capacity; i++) {
+    if (reuse_pages[i].used) {
+      pages[n++] = &reuse_pages[i];
+    }
+  }
+  qsort(pages, n, sizeof(reuse_page_t*), compare_reuse_page);
+  va_t vpn_mask = ((va_t)1 << (VIRTUAL_ADDRESS_BITS - PAGE_SIZE_BITS)) - 1;
+  for (uint64_t i = 0; i < n; i++) {
+    fprintf(file, "%u %u %" PRIx64 " %" PRIu64 " %" PRIu64 "\n",
+            pages[i]->core, page_key_asid(pages[i]->page),
+            pages[i]->page & vpn_mask, pages[i]->accesses, pages[i]->writes);
+  }
+  free(pages);
+
+  if (fclose(file) != 0) {
+    panic("Failed to write %s", path);
+  }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "memory.h"
+
+// Reuse-distance profiler of the references of a trace.
+// The reuse distance of a reference is the number of distinct pages the core
+// referenced since its previous reference to the same page (Olken's
+// algorithm: a Fenwick tree over the reference times of every core, with one
+// mark at the last reference of each page). A fully associative LRU TLB of N
+// entries per core hits exactly the references of distance < N, so the
+// histogram gives the miss ratio of every TLB size at once (Mattson's stack
+// algorithm). Pages are base pages, identified by page key (ASID and VPN).
+// References to a page never seen before by the core are cold misses.
+
+// (Re)starts an empty profile.
+void reuse_init();
+void reuse_reference(unsigned core, unsigned asid, va_t address, op_t op);
+
+uint64_t get_reuse_references();
+uint64_t get_reuse_cold_misses();
+
+// Pages referenced, counting a page once per core that referenced it.
+uint64_t get_reuse_pages();
+
+// Misses of a fully associative LRU TLB of `entries` entries per core.
+uint64_t get_reuse_misses(uint64_t entries);
+
+// Writes the reuse-distance histogram, the miss ratio curve at every size
+// where it changes, and the accesses of every page (heatmap) to `path`, as
+// text. Panics on error.
+void reuse_write(const char* path);
@@ -0,0 +1,398 @@
+#include "sample.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "clock.h"
+#include "event.h"
+#include "log.h"
+#include "page_table.h"
+#include "tlb.h"
+
+// Sums over the units of the numerator and denominator of a metric, and of
+// their squares and product, for the variance of the ratio estimator.
+typedef struct {
+  double y;
+  double x;
+  double yy;
+  double xx;
+  double xy;
+} sample_sums_t;
+
+sample_config_t sample_config;
+sample_sums_t sample_sums[SAMPLE_METRICS];
+uint64_t sample_units = 0;
+uint64_t sample_skipped = 0;
+uint64_t sample_batched = 0;
+uint64_t sample_fast_forwarded = 0;
+
+// References of the trace seen so far, and of the current period.
+uint64_t sample_position = 0;
+uint64_t sample_offset = 0;
+
+// Offset of the unit in the current period, drawn when the period starts.
+uint64_t sample_unit_start = 0;
+bool sample_unit_drawn = false;
+
+// Warming references are batched (see tlb_warm_hit()) when there are no data
+// caches, whose lines the batches do not follow, up to this offset of the
+// current period (0 outside of warming).
+bool sample_batching = false;
+uint64_t sample_batch_end = 0;
+
+// Page of the last batched reference, whether its run of references wrote
+// it, and the references of the run after the first (they only move the
+// virtual time, at the next flush).
+va_t sample_batch_page = 0;
+bool sample_batch_written = false;
+uint64_t sample_batch_repeats = 0;
+bool sample_has_batch_page = false;
+
+// Metrics when the current unit started.
+double sample_start[SAMPLE_METRICS][2];
+
+// Cores the trace referenced so far.
+uint64_t sample_cores = 0;
+
+// Log categories of the detailed references; functional warming logs none,
+// and runs with the clocks frozen.
+bool sample_log_enabled[LOG_CATEGORIES];
+bool sample_warming = false;
+
+// Last reference simulated, and whether its run of references to the same
+// block (page or line) wrote it already.
+bool sample_has_previous = false;
+trace_record_t sample_previous;
+bool sample_previous_written = false;
+unsigned sample_block_bits = PAGE_SIZE_BITS;
+
+void sample_init(const sample_config_t* config) {
+  if (config->period &&
+      (config->unit < 1 || config->unit + config->warmup > config->period)) {
+    panic("Invalid sampling: units of %" PRIu64 " references after %" PRIu64
+          " of warm-up, every %" PRIu64
+          " references (expected at least one reference per unit, and units "
+          "and warm-up within the period)",
+          config->unit, config->warmup, config->period);
+  }
+
+  sample_config = *config;
+  memset(sample_sums, 0, sizeof(sample_sums));
+  sample_units = 0;
+  sample_skipped = 0;
+  sample_batched = 0;
+  sample_fast_forwarded = 0;
+  sample_position = 0;
+  sample_offset = 0;
+  sample_unit_start = 0;
+  sample_unit_drawn = false;
+  sample_batching = !cache_enabled();
+  sample_batch_end = 0;
+  sample_has_batch_page = false;
+  sample_batch_repeats = 0;
+  sample_cores = 0;
+  memcpy(sample_log_enabled, log_enabled, sizeof(sample_log_enabled));
+  sample_warming = false;
+  sample_has_previous = false;
+  sample_block_bits = cache_first_line_bits();
+}
+
+bool sample_enabled() { return sample_config.period != 0; }
+
+// Mean time of the cores the trace referenced. The clocks only move during
+// the detailed references, so a unit that runs on a single core must not be
+// compared with the others: the cores of a detailed run move together, and
+// its elapsed time is close to the mean.
+double get_sample_time() {
+  double time = 0;
+  unsigned cores = 0;
+  for (unsigned core = 0; core < MAX_CORES; core++) {
+    if (sample_cores & (1ULL << core)) {
+      time += get_core_time(core);
+      cores++;
+    }
+  }
+  return cores ? time / cores : 0;
+}
+
+// Numerator and denominator of every metric, since the start of the run.
+void get_sample_counts(double counts[SAMPLE_METRICS][2]) {
+  uint64_t l1_hits = get_total_tlb_l1_hits();
+  uint64_t l2_hits = get_total_tlb_l2_hits();
+  counts[SAMPLE_TIME][0] = get_sample_time();
+  counts[SAMPLE_TIME][1] = sample_position;
+  counts[SAMPLE_TLB_L1][0] = l1_hits;
+  counts[SAMPLE_TLB_L1][1] = l1_hits + get_total_tlb_l1_misses();
+  counts[SAMPLE_TLB_L2][0] = l2_hits;
+  counts[SAMPLE_TLB_L2][1] = l2_hits + get_total_tlb_l2_misses();
+}
+
+void end_sample_unit() {
+  double counts[SAMPLE_METRICS][2];
+  get_sample_counts(counts);
+  for (sample_metric_t metric = 0; metric < SAMPLE_METRICS; metric++) {
+    double y = counts[metric][0] - sample_start[metric][0];
+    double x = counts[metric][1] - sample_start[metric][1];
+    sample_sums_t* sums = &sample_sums[metric];
+    sums->y += y;
+    sums->x += x;
+    sums->yy += y * y;
+    sums->xx += x * x;
+    sums->xy += x * y;
+  }
+  sample_units++;
+}
+
+void set_sample_warming(bool warming) {
+  if (warming == sample_warming) {
+    return;
+  }
+  sample_warming = warming;
+  clock_freeze(warming);
+  for (log_category_t category = 0; category < LOG_CATEGORIES; category++) {
+    log_enabled[category] = !warming && sample_log_enabled[category];
+  }
+}
+
+// Moves to the next reference of the trace.
+static inline void next_sample_reference() {
+  sample_position++;
+  if (++sample_offset == sample_config.period) {
+    sample_offset = 0;
+    sample_unit_drawn = false;
+    sample_batch_end = 0;
+  }
+}
+
+// Makes the changes of the batched references.
+static void flush_sample_batch() {
+  tlb_warm_flush();
+  page_table_repeat_references(sample_batch_repeats);
+  sample_batch_repeats = 0;
+  sample_has_batch_page = false;
+}
+
+// Batches a warming reference on the core and address space of the previous
+// reference, if its page allows: a repeat of the last batched page that does
+// not newly write it is only counted. Returns false, without side effects,
+// otherwise. The reference after a batched one is not checked for a repeat of
+// it by sample_reference().
+static inline bool batch_sample_reference(const trace_record_t* record) {
+  if (sample_offset >= sample_batch_end ||
+      record->core != sample_previous.core ||
+      record->asid != sample_previous.asid) {
+    return false;
+  }
+
+  va_t page = (record->address & VIRTUAL_ADDRESS_MASK) >> PAGE_SIZE_BITS;
+  bool repeat = sample_has_batch_page && page == sample_batch_page;
+  if (repeat && (record->op == OP_READ || sample_batch_written)) {
+    sample_batch_repeats++;
+    return true;
+  }
+  if (!tlb_warm_hit(record->address, record->op)) {
+    return false;
+  }
+  sample_batch_written =
+      (repeat && sample_batch_written) || record->op == OP_WRITE;
+  sample_batch_page = page;
+  sample_has_batch_page = true;
+  return true;
+}
+
+// Places the unit of a new period at a random offset, after its warm-up.
+// Units at the same offset of every period would all measure the same
+// phase of a periodic workload (a loop nest whose iterations span a whole
+// number of periods), and agree with each other however far they are from
+// the mean. Drawn from rand(), whose state checkpoints include.
+static uint64_t draw_sample_unit_start() {
+  uint64_t span = sample_config.period - sample_config.unit -
+                  sample_config.warmup + 1;
+  uint64_t random = ((uint64_t)rand() << 31) ^ (uint64_t)rand();
+  return sample_config.warmup + random % span;
+}
+
+// Offset of the unit in the current period, drawn on first use.
+static uint64_t get_sample_unit_start() {
+  if (!sample_unit_drawn) {
+    sample_unit_start = draw_sample_unit_start();
+    sample_unit_drawn = true;
+  }
+  return sample_unit_start;
+}
+
+uint64_t sample_skippable_references() {
+  if (!sample_config.warming) {
+    return 0;
+  }
+  uint64_t unit_start = get_sample_unit_start();
+  uint64_t lead = sample_config.warmup + sample_config.warming;
+  uint64_t warming_start = unit_start > lead ? unit_start - lead : 0;
+  if (sample_offset < warming_start) {
+    return warming_start - sample_offset;
+  }
+  if (sample_offset >= unit_start + sample_config.unit) {
+    return sample_config.period - sample_offset;
+  }
+  return 0;
+}
+
+void sample_fast_forward(uint64_t references) {
+  if (!references) {
+    return;
+  }
+  if (sample_batching) {
+    flush_sample_batch();
+  }
+  // The next reference does not follow the last one simulated.
+  sample_has_previous = false;
+  sample_fast_forwarded += references;
+  sample_position += references;
+  sample_offset += references;
+  if (sample_offset == sample_config.period) {
+    sample_offset = 0;
+    sample_unit_drawn = false;
+  }
+  sample_batch_end = 0;
+}
+
+void sample_reference(const trace_record_t* record) {
+  if (batch_sample_reference(record)) {
+    sample_batched++;
+    sample_has_previous = false;
+    next_sample_reference();
+    return;
+  }
+  if (sample_batching) {
+    flush_sample_batch();
+  }
+
+  va_t address = record->address & VIRTUAL_ADDRESS_MASK;
+  bool repeat = sample_has_previous && record->core == sample_previous.core &&
+                record->asid == sample_previous.asid &&
+                (address >> sample_block_bits) ==
+                    (sample_previous.address >> sample_block_bits);
+  bool written = (repeat && sample_previous_written) || record->op == OP_WRITE;
+
+  sample_cores |= 1ULL << record->core;
+  uint64_t offset = sample_offset;
+  uint64_t unit_start = get_sample_unit_start();
+  uint64_t unit_end = unit_start + sample_config.unit;
+  bool before_unit = offset < unit_start - sample_config.warmup;
+  set_sample_warming(before_unit || offset >= unit_end);
+  if (sample_batching && sample_warming) {
+    sample_batch_end = before_unit ? unit_start - sample_config.warmup
+                                   : sample_config.period;
+  } else {
+    sample_batch_end = 0;
+  }
+
+  if (sample_warming && repeat &&
+      (record->op == OP_READ || sample_previous_written)) {
+    page_table_repeat_references(1);
+    sample_skipped++;
+    next_sample_reference();
+    return;
+  }
+
+  if (offset == unit_start) {
+    get_sample_counts(sample_start);
+  }
+
+  if (sample_warming) {
+    // The core and address space of the previous reference are still the
+    // current ones.
+    if (!sample_has_previous || record->core != sample_previous.core ||
+        record->asid != sample_previous.asid) {
+      select_core(record->core);
+      tlb_select_asid(record->asid);
+    }
+    warm_reference(record->address, record->op);
+  } else {
+    log_instr("* %c %" PRIx64, record->op == OP_READ ? 'R' : 'W',
+              record->address);
+    select_core(record->core);
+    tlb_select_asid(record->asid);
+    event_emit(EVENT_INSTRUCTION, record->op, 0, record->address, 0);
+    switch (record->op) {
+      case OP_READ:
+        read(record->address);
+        break;
+      case OP_WRITE:
+        write(record->address);
+        break;
+    }
+  }
+
+  sample_has_previous = true;
+  sample_previous = *record;
+  sample_previous.address = address;
+  sample_previous_written = written;
+
+  next_sample_reference();
+  if (offset == unit_end - 1) {
+    end_sample_unit();
+  }
+}
+
+void sample_finish() {
+  if (sample_batching) {
+    flush_sample_batch();
+  }
+  set_sample_warming(false);
+}
+
+uint64_t get_sample_units() { return sample_units; }
+uint64_t get_sample_skipped_references() { return sample_skipped; }
+uint64_t get_sample_batched_references() { return sample_batched; }
+uint64_t get_sample_fast_forwarded_references() {
+  return sample_fast_forwarded;
+}
+
+// Standard deviation of y - R x over the units, for ratio R. 0 with fewer
+// than two units, or units that all agree (up to rounding).
+static double sample_residual_deviation(const sample_sums_t* sums,
+                                        double ratio) {
+  if (sample_units < 2) {
+    return 0.0;
+  }
+  double variance =
+      (sums->yy - 2 * ratio * sums->xy + ratio * ratio * sums->xx) /
+      (sample_units - 1);
+  // The sums of squares cancel out: what is left of them is rounding
+  double scale = (sums->yy + ratio * ratio * sums->xx) / (sample_units - 1);
+  return variance > scale * 1e-12 ? sqrt(variance) : 0.0;
+}
+
+sample_estimate_t get_sample_estimate(sample_metric_t metric) {
+  const sample_sums_t* sums = &sample_sums[metric];
+  sample_estimate_t estimate = {0.0, 0.0, false};
+  if (sums->x == 0) {
+    return estimate;
+  }
+  estimate.value = sums->y / sums->x;
+  double deviation = sample_residual_deviation(sums, estimate.value);
+  if (deviation == 0) {
+    return estimate;
+  }
+  double mean_x = sums->x / sample_units;
+  estimate.error =
+      SAMPLE_CONFIDENCE_Z * deviation / (mean_x * sqrt(sample_units));
+  estimate.estimable = true;
+  return estimate;
+}
+
+uint64_t get_sample_units_needed(sample_metric_t metric,
+                                 double relative_error) {
+  const sample_sums_t* sums = &sample_sums[metric];
+  if (sums->y == 0) {
+    return 0;
+  }
+  double ratio = sums->y / sums->x;
+  double mean_x = sums->x / sample_units;
+  double coefficient =
+      sample_residual_deviation(sums, ratio) / (mean_x * ratio);
+  return ceil(pow(SAMPLE_CONFIDENCE_Z * coefficient / relative_error, 2));
+}
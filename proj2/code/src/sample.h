@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "trace.h"
+
+// Statistical sampling of the references of a trace, like SMARTS. The trace
+// is cut in periods of `period` references, each holding a sampling unit of
+// `unit` references measured in detail, at a random offset, after `warmup`
+// references simulated in detail but not measured (they warm up the
+// short-lived state: outstanding misses, the write buffer, the clocks).
+//
+// Only the `warming` references before the warm-up of each unit keep the
+// long-lived state warm (functional warming), as in SMARTS with a bounded
+// warming window: the others are fast-forwarded, read from the trace without
+// being simulated (see trace_skip()). With `warming` 0, every reference
+// outside of the units and their warm-up is warming. Warming updates the page
+// tables, the DRAM frames, swap, the TLBs, the data caches
+// and the replacement state. They go through warm_reference(), which makes
+// the same changes to that state as a detailed reference but charges no time
+// (the clocks are frozen), counts no hits or misses and logs nothing. A
+// reference that repeats the page (or first-level data cache line) of the
+// reference right before it, on the same core and address space, is skipped
+// altogether: it would hit the most recently used TLB entry and line, and
+// change nothing (unless it is the first write of the run). Without data
+// caches, a reference to a page that the L1 TLB held at its last warming
+// reference is not even translated: it is batched with the others (see
+// tlb_warm_hit()) until the next reference that is not. The state the
+// units start from is then close to the one of a detailed run: the window
+// refills the TLBs, the data caches and the recency of the DRAM frames, but
+// the pages first touched by fast-forwarded references fault in the window or
+// the unit instead, so page faults and evictions are counted for the
+// simulated references only. With `warming` 0, the state is the one of a
+// detailed run, and they are counted exactly; only latencies and hit counts
+// of the warming references are missing.
+//
+// Every reference is still read, so a sampled run cannot take less time than
+// reading the trace; fast-forwarding a built-in kernel only moves its loop
+// indices.
+//
+// The units estimate the time per reference and the TLB hit ratios of a
+// detailed run of the whole trace, with confidence intervals of
+// SAMPLE_CONFIDENCE_Z standard errors. The intervals are not estimable when
+// the units do not vary, or are fewer than two.
+typedef struct {
+  uint64_t period;
+  uint64_t unit;
+  uint64_t warmup;
+  uint64_t warming;
+} sample_config_t;
+
+// Sampling is off with period 0.
+#define SAMPLE_DEFAULT_CONFIG ((sample_config_t){0, 1000, 2000, 20000})
+
+// 99.7% confidence, as recommended by SMARTS.
+#define SAMPLE_CONFIDENCE_Z 3.0
+#define SAMPLE_CONFIDENCE_PERCENT 99.7
+
+typedef enum {
+  SAMPLE_TIME,    // elapsed time per reference
+  SAMPLE_TLB_L1,  // TLB L1 hits per L1 lookup
+  SAMPLE_TLB_L2,  // TLB L2 hits per L2 lookup
+  SAMPLE_METRICS,
+} sample_metric_t;
+
+typedef struct {
+  double value;
+  // Half width of the confidence interval, if estimable.
+  double error;
+  bool estimable;
+} sample_estimate_t;
+
+// Panics on an invalid configuration.
+void sample_init(const sample_config_t* config);
+bool sample_enabled();
+
+// References from the current one that are neither warming nor part of a
+// unit or its warm-up, and can be fast-forwarded; 0 if the current one must
+// be simulated.
+uint64_t sample_skippable_references();
+
+// Moves past `references` fast-forwarded references, at most
+// sample_skippable_references().
+void sample_fast_forward(uint64_t references);
+
+// Simulates the next reference of the trace, in detail or by functional
+// warming.
+void sample_reference(const trace_record_t* record);
+
+// Turns logging back on after the last reference, if it was warming.
+void sample_finish();
+
+// Complete units so far, references skipped or batched by functional
+// warming, and references fast-forwarded.
+uint64_t get_sample_units();
+uint64_t get_sample_skipped_references();
+uint64_t get_sample_batched_references();
+uint64_t get_sample_fast_forwarded_references();
+
+// Ratio estimate of a metric over the units.
+sample_estimate_t get_sample_estimate(sample_metric_t metric);
+
+// Units that would give a confidence interval of +/- `relative_error` times
+// the estimate, judging from the variance of the units so far.
+uint64_t get_sample_units_needed(sample_metric_t metric,
+                                 double relative_error);
@@ -0,0 +1,273 @@
+#include "swap.h"
+
+#include <stdlib.h>
+
+#include "bitmap.h"
+#include "constants.h"
+#include "log.h"
+
+// Slot 0 is where the original simulator wrote its first swapped page, so
+// that next fit hands out the same addresses.
+#define SWAP_BASE_ADDRESS ((((pa_disk_t)0xcafebabe) << 32) & DISK_ADDRESS_MASK)
+
+swap_config_t swap_config;
+
+// Free slots (bit set = free), and the slot next fit starts from.
+bitmap_t free_swap_slots;
+uint64_t swap_cursor = 0;
+uint64_t swap_slots_used = 0;
+uint64_t swap_slots_peak = 0;
+
+// Slots read ahead, in a FIFO ring. Freed slots are replaced by
+// swap_config.slots, which matches no slot.
+uint64_t* swap_cache = NULL;
+uint64_t swap_cache_head = 0;
+uint64_t swap_cache_count = 0;
+
+// Addresses of the pages of a swap-in request.
+pa_disk_t* swap_request = NULL;
+
+// Address right after the last page the disk transferred.
+bool disk_head_valid = false;
+pa_disk_t disk_head = 0;
+
+uint64_t swap_reads = 0;
+uint64_t swap_cache_hits = 0;
+uint64_t swap_readahead_pages = 0;
+uint64_t disk_sequential_pages = 0;
+uint64_t disk_random_pages = 0;
+
+const char* swap_placement_name(swap_placement_t placement) {
+  switch (placement) {
+    case SWAP_PLACEMENT_NEXT:
+      return "next";
+    case SWAP_PLACEMENT_CLUSTER:
+      return "cluster";
+    case SWAP_PLACEMENT_RANDOM:
+      return "random";
+  }
+  return "?";
+}
+
+const char* swap_disk_name(swap_disk_t disk) {
+  switch (disk) {
+    case SWAP_DISK_FLAT:
+      return "flat";
+    case SWAP_DISK_SEEK:
+      return "seek";
+  }
+  return "?";
+}
+
+void swap_init(const swap_config_t* config) {
+  uint64_t max_slots =
+      DISK_PAGE_CAPACITY - (SWAP_BASE_ADDRESS >> PAGE_SIZE_BITS);
+  if (config->slots == 0 || config->slots % SWAP_CLUSTER_PAGES != 0 ||
+      config->slots > max_slots) {
+    panic("Invalid number of swap slots: %" PRIu64
+          " (expected a multiple of %d, up to %" PRIu64 ")",
+          config->slots, SWAP_CLUSTER_PAGES, max_slots);
+  }
+  if (config->readahead && config->cache_entries == 0) {
+    panic("Swap readahead needs a swap cache");
+  }
+
+  swap_config = *config;
+
+  bitmap_init(&free_swap_slots, config->slots);
+  for (uint64_t slot = 0; slot < config->slots; slot++) {
+    bitmap_set(&free_swap_slots, slot);
+  }
+  swap_cursor = 0;
+  swap_slots_used = 0;
+  swap_slots_peak = 0;
+
+  free(swap_cache);
+  free(swap_request);
+  swap_cache = malloc((config->cache_entries + 1) * sizeof(uint64_t));
+  swap_request = malloc((config->readahead + 1) * sizeof(pa_disk_t));
+  if (!swap_cache || !swap_request) {
+    panic("Failed to allocate swap cache");
+  }
+  swap_cache_head = 0;
+  swap_cache_count = 0;
+
+  disk_head_valid = false;
+  disk_head = 0;
+
+  swap_reads = 0;
+  swap_cache_hits = 0;
+  swap_readahead_pages = 0;
+  disk_sequential_pages = 0;
+  disk_random_pages = 0;
+}
+
+void swap_checkpoint(checkpoint_t* checkpoint) {
+  bitmap_checkpoint(&free_swap_slots, checkpoint);
+  CHECKPOINT_VALUE(checkpoint, swap_cursor);
+  CHECKPOINT_VALUE(checkpoint, swap_slots_used);
+  CHECKPOINT_VALUE(checkpoint, swap_slots_peak);
+
+  checkpoint_data(checkpoint, swap_cache,
+                  (swap_config.cache_entries + 1) * sizeof(uint64_t));
+  CHECKPOINT_VALUE(checkpoint, swap_cache_head);
+  CHECKPOINT_VALUE(checkpoint, swap_cache_count);
+
+  CHECKPOINT_VALUE(checkpoint, disk_head_valid);
+  CHECKPOINT_VALUE(checkpoint, disk_head);
+
+  CHECKPOINT_VALUE(checkpoint, swap_reads);
+  CHECKPOINT_VALUE(checkpoint, swap_cache_hits);
+  CHECKPOINT_VALUE(checkpoint, swap_readahead_pages);
+  CHECKPOINT_VALUE(checkpoint, disk_sequential_pages);
+  CHECKPOINT_VALUE(checkpoint, disk_random_pages);
+}
+
+static inline pa_disk_t swap_slot_address(uint64_t slot) {
+  return SWAP_BASE_ADDRESS + (slot << PAGE_SIZE_BITS);
+}
+
+// Slot of a disk address, or swap_config.slots if it is not in swap.
+static inline uint64_t swap_address_slot(pa_disk_t address) {
+  if (address < SWAP_BASE_ADDRESS) {
+    return swap_config.slots;
+  }
+  uint64_t slot = (address - SWAP_BASE_ADDRESS) >> PAGE_SIZE_BITS;
+  return slot < swap_config.slots ? slot : swap_config.slots;
+}
+
+static inline bool swap_slot_free(uint64_t slot) {
+  return slot < swap_config.slots && bitmap_test(&free_swap_slots, slot);
+}
+
+// First free slot from `start` on, wrapping around, or swap_config.slots.
+uint64_t find_next_free_slot(uint64_t start) {
+  for (uint64_t i = 0; i < swap_config.slots; i++) {
+    uint64_t slot = (start + i) % swap_config.slots;
+    if (bitmap_test(&free_swap_slots, slot)) {
+      return slot;
+    }
+  }
+  return swap_config.slots;
+}
+
+pa_disk_t swap_alloc(va_t page, pa_disk_t hint) {
+  uint64_t slot = swap_config.slots;
+
+  switch (swap_config.placement) {
+    case SWAP_PLACEMENT_NEXT:
+      break;
+    case SWAP_PLACEMENT_CLUSTER:
+      if (hint && swap_slot_free(swap_address_slot(hint))) {
+        slot = swap_address_slot(hint);
+        break;
+      }
+      slot = bitmap_find_block(&free_swap_slots, SWAP_CLUSTER_PAGES);
+      if (slot != swap_config.slots) {
+        slot += page % SWAP_CLUSTER_PAGES;
+      }
+      break;
+    case SWAP_PLACEMENT_RANDOM:
+      slot = find_next_free_slot(rand() % swap_config.slots);
+      break;
+  }
+
+  if (slot == swap_config.slots) {
+    slot = find_next_free_slot(swap_cursor);
+  }
+  if (slot == swap_config.slots) {
+    panic("Out of swap space (%" PRIu64 " slots)", swap_config.slots);
+  }
+
+  bitmap_clear(&free_swap_slots, slot);
+  swap_cursor = (slot + 1) % swap_config.slots;
+  swap_slots_used++;
+  if (swap_slots_used > swap_slots_peak) {
+    swap_slots_peak = swap_slots_used;
+  }
+  return swap_slot_address(slot);
+}
+
+// Removes a slot from the swap cache. Returns false if it was not there.
+bool swap_cache_remove(uint64_t slot) {
+  for (uint64_t i = 0; i < swap_cache_count; i++) {
+    uint64_t* cached = &swap_cache[(swap_cache_head + i) %
+                                   swap_config.cache_entries];
+    if (*cached == slot) {
+      *cached = swap_config.slots;
+      return true;
+    }
+  }
+  return false;
+}
+
+void swap_cache_insert(uint64_t slot) {
+  if (swap_cache_count == swap_config.cache_entries) {
+    swap_cache_head = (swap_cache_head + 1) % swap_config.cache_entries;
+    swap_cache_count--;
+  }
+  swap_cache[(swap_cache_head + swap_cache_count) % swap_config.cache_entries] =
+      slot;
+  swap_cache_count++;
+}
+
+void swap_free(pa_disk_t address) {
+  uint64_t slot = swap_address_slot(address);
+  if (slot == swap_config.slots || swap_slot_free(slot)) {
+    return;
+  }
+  bitmap_set(&free_swap_slots, slot);
+  swap_slots_used--;
+  swap_cache_remove(slot);
+}
+
+void swap_read(pa_disk_t address) {
+  swap_reads++;
+  uint64_t slot = swap_address_slot(address);
+  if (slot != swap_config.slots && swap_cache_remove(slot)) {
+    swap_cache_hits++;
+    log_dbg("***** Page was read ahead, no disk read *****");
+    return;
+  }
+
+  // The page, then the slots in use right after it
+  uint64_t pages = 0;
+  swap_request[pages++] = address;
+  log_disk_access(address, OP_READ);
+
+  for (uint64_t next = slot + 1;
+       pages <= swap_config.readahead && next < swap_config.slots &&
+       !swap_slot_free(next);
+       next++) {
+    swap_cache_remove(next);
+    swap_cache_insert(next);
+    swap_request[pages++] = swap_slot_address(next);
+    log_disk_access(swap_slot_address(next), OP_READ);
+    swap_readahead_pages++;
+  }
+
+  increment_time(TIME_DISK, swap_disk_request(swap_request, pages));
+}
+
+time_ns_t swap_disk_request(const pa_disk_t* addresses, uint64_t pages) {
+  time_ns_t time = 0;
+  for (uint64_t page = 0; page < pages; page++) {
+    if (disk_head_valid && addresses[page] == disk_head) {
+      disk_sequential_pages++;
+      time += DISK_SEQUENTIAL_LATENCY_NS;
+    } else {
+      disk_random_pages++;
+      time += DISK_LATENCY_NS;
+    }
+    disk_head_valid = true;
+    disk_head = addresses[page] + PAGE_SIZE_BYTES;
+  }
+  return swap_config.disk == SWAP_DISK_FLAT ? DISK_LATENCY_NS : time;
+}
+
+uint64_t get_swap_slots_peak() { return swap_slots_peak; }
+uint64_t get_total_swap_reads() { return swap_reads; }
+uint64_t get_total_swap_cache_hits() { return swap_cache_hits; }
+uint64_t get_total_swap_readahead_pages() { return swap_readahead_pages; }
+uint64_t get_total_disk_sequential_pages() { return disk_sequential_pages; }
+uint64_t get_total_disk_random_pages() { return disk_random_pages; }
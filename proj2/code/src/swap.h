@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "checkpoint.h"
+#include "clock.h"
+#include "memory.h"
+
+// Where an evicted dirty page is written in the swap area, a range of `slots`
+// page-sized slots on disk.
+// next: the first free slot after the last one handed out (next fit), so
+//       pages evicted one after the other are written one after the other.
+// cluster: next to the slots of the swapped pages around it in the address
+//          space; a page with no such neighbour starts a cluster, an aligned
+//          block of SWAP_CLUSTER_PAGES free slots where it takes the slot of
+//          its offset, and its neighbours will follow.
+// random: a random free slot.
+typedef enum {
+  SWAP_PLACEMENT_NEXT,
+  SWAP_PLACEMENT_CLUSTER,
+  SWAP_PLACEMENT_RANDOM,
+} swap_placement_t;
+
+// Cost model of the disk.
+// flat: DISK_LATENCY_NS per request, whatever its pages and position (the
+//       original simulator behaviour).
+// seek: DISK_LATENCY_NS per page, except DISK_SEQUENTIAL_LATENCY_NS for a page
+//       that follows the previous page transferred, where the head already is.
+typedef enum { SWAP_DISK_FLAT, SWAP_DISK_SEEK } swap_disk_t;
+
+// A swap-in from disk also reads the `readahead` slots that follow, as long
+// as they are in use, in the same request. They are kept in a swap cache of
+// `cache_entries` slots (FIFO), so a later fault on them does not read the
+// disk.
+typedef struct {
+  swap_placement_t placement;
+  swap_disk_t disk;
+  uint64_t slots;
+  uint64_t readahead;
+  uint64_t cache_entries;
+} swap_config_t;
+
+#define SWAP_DEFAULT_CONFIG \
+  ((swap_config_t){SWAP_PLACEMENT_NEXT, SWAP_DISK_FLAT, 1llu << 20, 0, 256})
+
+// Slots of a cluster; a multiple of 64 (see bitmap_find_block()).
+#define SWAP_CLUSTER_PAGES 64
+
+// True if the placement, disk model or readahead is not the default one.
+static inline bool swap_config_changed(const swap_config_t* config) {
+  return config->placement != SWAP_PLACEMENT_NEXT ||
+         config->disk != SWAP_DISK_FLAT || config->readahead != 0;
+}
+
+const char* swap_placement_name(swap_placement_t placement);
+const char* swap_disk_name(swap_disk_t disk);
+
+// (Re)initializes an empty swap area and cache. Panics on an invalid
+// configuration.
+void swap_init(const swap_config_t* config);
+void swap_checkpoint(checkpoint_t* checkpoint);
+
+// Allocates the slot of evicted page `page` (a page key) and returns its disk
+// address. `hint`, if not 0, is the address that would keep the page next to
+// its swapped neighbours (cluster placement only). Panics if swap is full.
+pa_disk_t swap_alloc(va_t page, pa_disk_t hint);
+void swap_free(pa_disk_t address);
+
+// Reads a swapped page back, from the swap cache or from disk, with
+// readahead, charging the current core.
+void swap_read(pa_disk_t address);
+
+// Time the disk takes to transfer the pages of one request, in order, and
+// moves the head past the last one.
+time_ns_t swap_disk_request(const pa_disk_t* addresses, uint64_t pages);
+
+uint64_t get_swap_slots_peak();
+uint64_t get_total_swap_reads();
+uint64_t get_total_swap_cache_hits();
+uint64_t get_total_swap_readahead_pages();
+uint64_t get_total_disk_sequential_pages();
+uint64_t get_total_disk_random_pages();
@@ -0,0 +1,218 @@
+#include "sweep.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "clock.h"
+#include "job.h"
+#include "log.h"
+#include "memory.h"
+#include "page_table.h"
+#include "tlb.h"
+
+#define SWEEP_NAME_SIZE 32
+
+typedef struct {
+  char name[SWEEP_NAME_SIZE];
+  sim_config_t config;
+} sweep_config_t;
+
+typedef struct {
+  bool ok;
+  time_ns_t elapsed;
+  uint64_t page_faults;
+  uint64_t page_evictions;
+  uint64_t dirty_page_evictions;
+  uint64_t l1_hits;
+  uint64_t l1_misses;
+  uint64_t l2_hits;
+  uint64_t l2_misses;
+  uint64_t pwc_lookups;
+  uint64_t pwc_misses;
+} sweep_result_t;
+
+typedef struct {
+  const sim_config_t* config;
+  const trace_t* trace;
+} sweep_job_arg_t;
+
+uint64_t load_sweep_configs(const char* path, const sim_config_t* base_config,
+                            sweep_config_t** configs) {
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    panic("Failed to open sweep file %s", path);
+  }
+
+  uint64_t count = 0;
+  uint64_t capacity = 0;
+  *configs = NULL;
+
+  char line[1024];
+  while (fgets(line, sizeof(line), file)) {
+    char* comment = strchr(line, '#');
+    if (comment) {
+      *comment = '\0';
+    }
+
+    char* token = strtok(line, " \t\r\n");
+    if (!token) {
+      continue;
+    }
+
+    if (count == capacity) {
+      capacity = capacity ? 2 * capacity : 16;
+      *configs = realloc(*configs, capacity * sizeof(sweep_config_t));
+      if (!*configs) {
+        panic("Failed to allocate sweep configurations");
+      }
+    }
+
+    sweep_config_t* sweep_config = &(*configs)[count];
+    sweep_config->config = *base_config;
+    snprintf(sweep_config->name, SWEEP_NAME_SIZE, "config-%" PRIu64, count);
+
+    if (!strchr(token, '=')) {
+      snprintf(sweep_config->name, SWEEP_NAME_SIZE, "%s", token);
+      token = strtok(NULL, " \t\r\n");
+    }
+
+    for (; token; token = strtok(NULL, " \t\r\n")) {
+      char* value = strchr(token, '=');
+      if (!value) {
+        panic("Invalid sweep option %s in %s (expected name=value)", token,
+              sweep_config->name);
+      }
+      *value++ = '\0';
+
+      if (!config_set_option(&sweep_config->config, token, value)) {
+        panic("Unknown sweep option %s in %s", token, sweep_config->name);
+      }
+    }
+
+    count++;
+  }
+
+  fclose(file);
+  return count;
+}
+
+void simulate(const sim_config_t* config, const trace_t* trace,
+              sweep_result_t* result) {
+  srand(0xcafebabe);
+  clock_init(&config->timing);
+  page_table_init(&config->page_table);
+  tlb_init(&config->tlb);
+  cache_init(&config->cache, &config->tlb);
+
+  for (uint64_t i = 0; i < trace->count; i++) {
+    select_core(trace->records[i].core);
+    tlb_select_asid(trace->records[i].asid);
+    switch (trace->records[i].op) {
+      case OP_READ:
+        read(trace->records[i].address);
+        break;
+      case OP_WRITE:
+        write(trace->records[i].address);
+        break;
+    }
+  }
+
+  clock_drain();
+  result->ok = true;
+  result->elapsed = get_elapsed_time();
+  result->page_faults = get_total_page_faults();
+  result->page_evictions = get_total_page_evictions();
+  result->dirty_page_evictions = get_total_dirty_page_evictions();
+  result->l1_hits = get_total_tlb_l1_hits();
+  result->l1_misses = get_total_tlb_l1_misses();
+  result->l2_hits = get_total_tlb_l2_hits();
+  result->l2_misses = get_total_tlb_l2_misses();
+  result->pwc_lookups = get_total_page_walk_cache_lookups();
+  result->pwc_misses = get_total_page_walk_cache_misses();
+}
+
+void run_job(void* arg, void* result) {
+  sweep_job_arg_t* job_arg = arg;
+  simulate(job_arg->config, job_arg->trace, result);
+}
+
+float hit_rate(uint64_t hits, uint64_t misses) {
+  return (hits + misses) > 0 ? 100.0 * hits / (hits + misses) : 0.0;
+}
+
+void print_results(const sweep_config_t* configs,
+                   const sweep_result_t* results, uint64_t count) {
+  log("%-20s %-18s %-18s %-8s %14s %10s %10s %10s %8s %8s %8s", "Config",
+      "TLB L1", "TLB L2", "Paging", "Elapsed (ns)", "Faults", "Evictions",
+      "Dirty", "L1 hit", "L2 hit", "PWC hit");
+
+  for (uint64_t i = 0; i < count; i++) {
+    const tlb_config_t* tlb = &configs[i].config.tlb;
+    char l1[32], l2[32];
+    snprintf(l1, sizeof(l1), "%" PRIu64 "x%" PRIu64 " %s", tlb->l1.entries,
+             tlb->l1.ways ? tlb->l1.ways : tlb->l1.entries,
+             tlb_replacement_name(tlb->l1.replacement));
+    snprintf(l2, sizeof(l2), "%" PRIu64 "x%" PRIu64 " %s", tlb->l2.entries,
+             tlb->l2.ways ? tlb->l2.ways : tlb->l2.entries,
+             tlb_replacement_name(tlb->l2.replacement));
+
+    const char* paging =
+        page_replacement_name(configs[i].config.page_table.replacement);
+
+    const sweep_result_t* result = &results[i];
+    if (!result->ok) {
+      log("%-20s %-18s %-18s %-8s %14s", configs[i].name, l1, l2, paging,
+          "FAILED");
+      continue;
+    }
+
+    log("%-20s %-18s %-18s %-8s %14" PRIu64 " %10" PRIu64 " %10" PRIu64
+        " %10" PRIu64 " %7.2f%% %7.2f%% %7.2f%%",
+        configs[i].name, l1, l2, paging, result->elapsed, result->page_faults,
+        result->page_evictions, result->dirty_page_evictions,
+        hit_rate(result->l1_hits, result->l1_misses),
+        hit_rate(result->l2_hits, result->l2_misses),
+        hit_rate(result->pwc_lookups - result->pwc_misses, result->pwc_misses));
+  }
+}
+
+void sweep_run(const char* sweep_path, const sim_config_t* base_config,
+               const trace_t* trace, unsigned jobs) {
+  sweep_config_t* configs;
+  uint64_t count = load_sweep_configs(sweep_path, base_config, &configs);
+  if (count == 0) {
+    panic("No configurations in sweep file %s", sweep_path);
+  }
+  if (jobs == 0) {
+    jobs = 1;
+  }
+
+  sweep_result_t* results = calloc(count, sizeof(sweep_result_t));
+  job_t* running = calloc(jobs, sizeof(job_t));
+  if (!results || !running) {
+    panic("Failed to allocate sweep results");
+  }
+
+  // Each configuration runs in its own child process, on a copy-on-write
+  // snapshot of the decoded trace. Jobs are started and collected in order,
+  // so at most `jobs` children run at the same time.
+  uint64_t next = 0;
+  for (uint64_t done = 0; done < count; done++) {
+    while (next < count && next - done < jobs) {
+      sweep_job_arg_t arg = {&configs[next].config, trace};
+      running[next % jobs] = job_start(run_job, &arg, sizeof(sweep_result_t));
+      next++;
+    }
+    if (!job_finish(&running[done % jobs], &results[done])) {
+      results[done].ok = false;
+    }
+  }
+
+  print_results(configs, results, count);
+
+  free(running);
+  free(results);
+  free(configs);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "config.h"
+#include "trace.h"
+
+// Design-space sweep.
+// Every non-empty line of the sweep file describes one configuration, as an
+// optional name followed by name=value options applied on top of the base
+// configuration, e.g.:
+//
+//   small-2way l1-entries=16 l1-ways=2 l2-entries=256 l2-replacement=fifo
+//
+// The already decoded trace is replayed once per configuration, each in its
+// own forked process (at most `jobs` at a time), and a results table is
+// printed to stdout.
+void sweep_run(const char* sweep_path, const sim_config_t* base_config,
+               const trace_t* trace, unsigned jobs);
@@ -6,6 +6,7 @@
 
 #include "clock.h"
 #include "constants.h"
+#include "event.h"
 #include "log.h"
 #include "memory.h"
 #include "page_table.h"
@@ -13,83 +14,779 @@
 #define DRAM_PAGES (uint64_t)(1llu << (DRAM_ADDRESS_BITS - PAGE_SIZE_BITS))
 #define PHYSICAL_PAGE_NUMBER_MASK (DRAM_PAGES - 1)
 
+// Sets with at most this many ways are searched directly; larger sets (e.g.
+// fully associative levels) are searched through a VPN hash index.
+#define TLB_SCAN_MAX_WAYS 8
+#define TLB_NO_SLOT UINT32_MAX
+
 typedef struct {
   bool valid;
   bool dirty;
-  uint64_t last_access;
+
+  // Maps a huge page: virtual_page_number is then the huge page number, and
+  // physical_page_number the first frame of its block.
+  bool huge;
   va_t virtual_page_number;
   pa_dram_t physical_page_number;
+
+  // The translation is usable from ready_ns on, once the miss that filled it
+  // (waited for as ready_cause) or its prefetch is over. Prefetched entries
+  // have not been used yet.
+  bool prefetched;
+  time_ns_t ready_ns;
+  time_cause_t ready_cause;
+
+  // Next slot in the same hash bucket, or TLB_NO_SLOT.
+  uint32_t hash_next;
+
+  // Neighbours in the recency list (valid entries) or in the free list
+  // (invalid entries) of the set, or TLB_NO_SLOT.
+  uint32_t list_prev;
+  uint32_t list_next;
 } tlb_entry_t;
 
-tlb_entry_t tlb_l1[TLB_L1_SIZE];
-tlb_entry_t tlb_l2[TLB_L2_SIZE];
+// Intrusive doubly-linked list of TLB slots.
+typedef struct {
+  uint32_t head;
+  uint32_t tail;
+} tlb_list_t;
+
+typedef struct {
+  // Valid entries, from most recently used (head) to least recently used
+  // (tail), and invalid entries available for reuse.
+  tlb_list_t recency;
+  tlb_list_t free;
+} tlb_set_t;
+
+typedef struct {
+  // Slots of set s are entries[s * ways, (s + 1) * ways).
+  tlb_entry_t* entries;
+  tlb_set_t* sets;
+  uint64_t size;
+  uint64_t ways;
+  uint64_t set_mask;
+  time_ns_t latency_ns;
+  tlb_replacement_t replacement;
+
+  // VPN -> slot index, chained through tlb_entry_t::hash_next.
+  // NULL when sets are small enough to be scanned.
+  uint32_t* buckets;
+  unsigned hash_bits;
+} tlb_level_t;
+
+// TLBs and statistics of one simulated core.
+typedef struct {
+  tlb_level_t l1_level;
+  tlb_level_t l2_level;
+
+  // Arrays holding the huge page entries of each level: the separate huge
+  // page levels, or the base page levels themselves when unified.
+  tlb_level_t l1_huge_level;
+  tlb_level_t l2_huge_level;
+  tlb_level_t* l1_huge;
+  tlb_level_t* l2_huge;
+
+  // Huge page entries are only looked up once one was inserted.
+  bool has_huge_entries;
+
+  // Prefetch buffer (fully associative, FIFO) when prefetching into a
+  // buffer, and prefetcher training state.
+  tlb_level_t prefetch_level;
+  tlb_prefetcher_t prefetcher;
+  tlb_prefetch_stats_t prefetch;
+
+  uint64_t l1_hits;
+  uint64_t l1_misses;
+  uint64_t l1_invalidations;
+
+  uint64_t l2_hits;
+  uint64_t l2_misses;
+  uint64_t l2_invalidations;
+
+  uint64_t l1_huge_hits;
+  uint64_t l2_huge_hits;
+
+  tlb_shootdown_stats_t shootdowns;
+
+  // Address space the core runs, and lookups per ASID (MAX_ASIDS entries).
+  unsigned asid;
+  tlb_asid_stats_t* asid_stats;
+  uint64_t context_switches;
+  uint64_t flushed_entries;
+} tlb_core_t;
+
+tlb_core_t tlb_cores[MAX_CORES];
+unsigned tlb_core_count = 1;
+
+// Core whose TLBs are used by tlb_translate() and tlb_invalidate(), per host
+// thread.
+__thread tlb_core_t* tlb_core = &tlb_cores[0];
+
+time_ns_t tlb_shootdown_latency_ns = 0;
+time_ns_t tlb_shootdown_handler_ns = 0;
+tlb_asid_mode_t tlb_asid_mode = TLB_ASID_TAGGED;
+tlb_prefetch_config_t tlb_prefetch_config;
+
+// Slots of the table of batched warming references (see tlb_warm_hit()),
+// direct-mapped by a hash of the VPN.
+#define TLB_WARM_SLOT_BITS 8
+#define TLB_WARM_SLOTS (1u << TLB_WARM_SLOT_BITS)
+
+// A page of the current core that the L1 TLB held at its last tlb_warm(),
+// and the references batched to it since the last tlb_warm_flush().
+typedef struct {
+  tlb_core_t* core;
+  va_t virtual_page_number;
+  va_t virtual_address;
+
+  // L1 entry that held it, as it was then (entries are checked before use,
+  // since they may have been evicted or refilled since).
+  tlb_entry_t* entry;
+  va_t entry_page_number;
+  bool entry_huge;
+
+  uint64_t references;
+  uint64_t last_use;
+} tlb_warm_slot_t;
+
+tlb_warm_slot_t tlb_warm_slots[TLB_WARM_SLOTS];
+
+// Slots with batched references, and the order of the references.
+uint32_t tlb_warm_pending[TLB_WARM_SLOTS];
+unsigned tlb_warm_pending_count = 0;
+uint64_t tlb_warm_clock = 0;
+
+static inline bool tlb_prefetch_buffer_enabled() {
+  return tlb_prefetch_config.policy != TLB_PREFETCH_NONE && tlb_prefetch_config.target == TLB_PREFETCH_BUFFER;
+}
+
+#define TLB_TOTAL(field)                                        \
+  uint64_t total = 0;                                           \
+  for (unsigned core = 0; core < tlb_core_count; core++)        \
+    total += tlb_cores[core].field;                             \
+  return total;
+
+uint64_t get_total_tlb_l1_hits() { TLB_TOTAL(l1_hits) }
+uint64_t get_total_tlb_l1_misses() { TLB_TOTAL(l1_misses) }
+uint64_t get_total_tlb_l1_invalidations() { TLB_TOTAL(l1_invalidations) }
+
+uint64_t get_total_tlb_l2_hits() { TLB_TOTAL(l2_hits) }
+uint64_t get_total_tlb_l2_misses() { TLB_TOTAL(l2_misses) }
+uint64_t get_total_tlb_l2_invalidations() { TLB_TOTAL(l2_invalidations) }
+
+uint64_t get_total_tlb_l1_huge_hits() { TLB_TOTAL(l1_huge_hits) }
+uint64_t get_total_tlb_l2_huge_hits() { TLB_TOTAL(l2_huge_hits) }
+
+uint64_t get_total_context_switches() { TLB_TOTAL(context_switches) }
+uint64_t get_total_tlb_flushed_entries() { TLB_TOTAL(flushed_entries) }
+
+tlb_prefetch_stats_t get_total_tlb_prefetch_stats() {
+  tlb_prefetch_stats_t total = {0};
+  for (unsigned core = 0; core < tlb_core_count; core++) {
+    const tlb_prefetch_stats_t* stats = &tlb_cores[core].prefetch;
+    total.issued += stats -> issued;
+    total.useful += stats -> useful;
+    total.late += stats -> late;
+    total.demand_walks += stats -> demand_walks;
+    total.saved_ns += stats -> saved_ns;
+  }
+  return total;
+}
+
+const char* tlb_replacement_name(tlb_replacement_t replacement) {
+  switch (replacement) {
+    case TLB_REPLACEMENT_LRU:
+      return "lru";
+    case TLB_REPLACEMENT_FIFO:
+      return "fifo";
+    case TLB_REPLACEMENT_RANDOM:
+      return "random";
+  }
+  return "?";
+}
+
+const char* tlb_huge_name(tlb_huge_t huge) {
+  switch (huge) {
+    case TLB_HUGE_SEPARATE:
+      return "separate";
+    case TLB_HUGE_UNIFIED:
+      return "unified";
+  }
+  return "?";
+}
+
+const char* tlb_asid_mode_name(tlb_asid_mode_t asid_mode) {
+  switch (asid_mode) {
+    case TLB_ASID_TAGGED:
+      return "tagged";
+    case TLB_ASID_FLUSH:
+      return "flush";
+  }
+  return "?";
+}
+
+
+/**
+ * @brief Returns the array holding the entries of a page size in a level.
+ *
+ * @param is_L1 True for the L1 TLB, False for the L2 TLB
+ * @param huge True for huge page entries, False for base page entries
+ * @return Pointer to the TLB level holding those entries
+ */
+static inline tlb_level_t* get_level(bool is_L1, bool huge) {
+  if (huge)
+    return is_L1 ? tlb_core -> l1_huge : tlb_core -> l2_huge;
+
+  return is_L1 ? &tlb_core -> l1_level : &tlb_core -> l2_level;
+}
+
+
+/**
+ * @brief Removes a slot from an intrusive list.
+ *
+ * @param level TLB level owning the slot
+ * @param list List the slot currently belongs to
+ * @param entry Entry to unlink
+ */
+void tlb_list_unlink(tlb_level_t* level, tlb_list_t* list, tlb_entry_t* entry) {
+  if (entry -> list_prev != TLB_NO_SLOT)
+    level -> entries[entry -> list_prev].list_next = entry -> list_next;
+  else
+    list -> head = entry -> list_next;
+
+  if (entry -> list_next != TLB_NO_SLOT)
+    level -> entries[entry -> list_next].list_prev = entry -> list_prev;
+  else
+    list -> tail = entry -> list_prev;
+
+  entry -> list_prev = TLB_NO_SLOT;
+  entry -> list_next = TLB_NO_SLOT;
+}
+
+
+/**
+ * @brief Inserts a slot at the head of an intrusive list.
+ *
+ * @param level TLB level owning the slot
+ * @param list List to insert into
+ * @param entry Entry to link (must not belong to any list)
+ */
+void tlb_list_push_front(tlb_level_t* level, tlb_list_t* list, tlb_entry_t* entry) {
+  uint32_t slot = (uint32_t)(entry - level -> entries);
+
+  entry -> list_prev = TLB_NO_SLOT;
+  entry -> list_next = list -> head;
+
+  if (list -> head != TLB_NO_SLOT)
+    level -> entries[list -> head].list_prev = slot;
+  else
+    list -> tail = slot;
+
+  list -> head = slot;
+}
+
+
+/**
+ * @brief Inserts a slot at the tail of an intrusive list.
+ *
+ * @param level TLB level owning the slot
+ * @param list List to insert into
+ * @param entry Entry to link (must not belong to any list)
+ */
+void tlb_list_push_back(tlb_level_t* level, tlb_list_t* list, tlb_entry_t* entry) {
+  uint32_t slot = (uint32_t)(entry - level -> entries);
+
+  entry -> list_prev = list -> tail;
+  entry -> list_next = TLB_NO_SLOT;
+
+  if (list -> tail != TLB_NO_SLOT)
+    level -> entries[list -> tail].list_next = slot;
+  else
+    list -> head = slot;
 
-uint64_t tlb_l1_hits = 0;
-uint64_t tlb_l1_misses = 0;
-uint64_t tlb_l1_invalidations = 0;
+  list -> tail = slot;
+}
+
+
+/**
+ * @brief Returns the set a VPN maps to.
+ *
+ * @param level TLB level
+ * @param virtual_page_number VPN to place
+ * @return Pointer to the set of the VPN
+ */
+static inline tlb_set_t* get_set(tlb_level_t* level, va_t virtual_page_number) {
+  return &level -> sets[virtual_page_number & level -> set_mask];
+}
+
+
+/**
+ * @brief Allocates a TLB level with the given geometry, all slots invalid and
+ * in the free list of their set by index.
+ *
+ * @param level TLB level to (re)allocate
+ * @param config Geometry of the level
+ * @param name Level name, for error messages
+ */
+void tlb_level_init(tlb_level_t* level, const tlb_level_config_t* config, const char* name) {
+  uint64_t ways = config -> ways ? config -> ways : config -> entries;
+
+  if (config -> entries == 0 || config -> entries >= TLB_NO_SLOT || ways > config -> entries ||
+      config -> entries % ways != 0) {
+    panic("Invalid TLB %s geometry: %" PRIu64 " entries, %" PRIu64 " ways", name, config -> entries, ways);
+  }
+
+  uint64_t n_sets = config -> entries / ways;
+  if (n_sets & (n_sets - 1)) {
+    panic("Invalid TLB %s geometry: %" PRIu64 " sets is not a power of two", name, n_sets);
+  }
+
+  free(level -> entries);
+  free(level -> sets);
+  free(level -> buckets);
+
+  level -> size = config -> entries;
+  level -> ways = ways;
+  level -> set_mask = n_sets - 1;
+  level -> latency_ns = config -> latency_ns;
+  level -> replacement = config -> replacement;
+  level -> entries = calloc(level -> size, sizeof(tlb_entry_t));
+  level -> sets = calloc(n_sets, sizeof(tlb_set_t));
+  level -> buckets = NULL;
+  level -> hash_bits = 0;
+
+  if (ways > TLB_SCAN_MAX_WAYS) {
+    // Twice as many buckets as entries so chains stay short
+    while ((1llu << level -> hash_bits) < 2 * level -> size)
+      level -> hash_bits++;
+
+    level -> buckets = malloc(((size_t)1 << level -> hash_bits) * sizeof(uint32_t));
+    if (level -> buckets)
+      memset(level -> buckets, 0xff, ((size_t)1 << level -> hash_bits) * sizeof(uint32_t));
+  }
+
+  if (!level -> entries || !level -> sets || (ways > TLB_SCAN_MAX_WAYS && !level -> buckets)) {
+    panic("Failed to allocate TLB %s", name);
+  }
+
+  for (uint64_t set = 0; set < n_sets; set++) {
+    tlb_set_t* tlb_set = &level -> sets[set];
+    tlb_set -> recency.head = tlb_set -> recency.tail = TLB_NO_SLOT;
+    tlb_set -> free.head = tlb_set -> free.tail = TLB_NO_SLOT;
+
+    for (uint64_t way = 0; way < ways; way++) {
+      tlb_entry_t* entry = &level -> entries[set * ways + way];
+      entry -> hash_next = TLB_NO_SLOT;
+      tlb_list_push_back(level, &tlb_set -> free, entry);
+    }
+  }
+}
+
+
+/**
+ * @brief Initializes the TLB entries (L1 and L2) of one core and resets its
+ * statistics.
+ *
+ * @param core Core to initialize
+ * @param config Geometry and latency of both levels
+ */
+void tlb_core_init(tlb_core_t* core, const tlb_config_t* config) {
+  tlb_level_init(&core -> l1_level, &config -> l1, "L1");
+  tlb_level_init(&core -> l2_level, &config -> l2, "L2");
+
+  if (config -> huge == TLB_HUGE_SEPARATE) {
+    tlb_level_config_t l1_huge = config -> l1;
+    l1_huge.entries = config -> l1.huge_entries;
+    l1_huge.ways = config -> l1.huge_ways;
+    tlb_level_config_t l2_huge = config -> l2;
+    l2_huge.entries = config -> l2.huge_entries;
+    l2_huge.ways = config -> l2.huge_ways;
+
+    tlb_level_init(&core -> l1_huge_level, &l1_huge, "L1 huge");
+    tlb_level_init(&core -> l2_huge_level, &l2_huge, "L2 huge");
+    core -> l1_huge = &core -> l1_huge_level;
+    core -> l2_huge = &core -> l2_huge_level;
+  }
+  else {
+    core -> l1_huge = &core -> l1_level;
+    core -> l2_huge = &core -> l2_level;
+  }
+
+  if (config -> prefetch.policy != TLB_PREFETCH_NONE && config -> prefetch.target == TLB_PREFETCH_BUFFER) {
+    tlb_level_config_t buffer = {config -> prefetch.buffer_entries, 0, 0, TLB_REPLACEMENT_FIFO, 0, 0};
+    tlb_level_init(&core -> prefetch_level, &buffer, "prefetch buffer");
+  }
+  tlb_prefetcher_init(&core -> prefetcher, &config -> prefetch);
+  memset(&core -> prefetch, 0, sizeof(core -> prefetch));
+
+  core -> has_huge_entries = false;
+  core -> l1_huge_hits = 0;
+  core -> l2_huge_hits = 0;
+  core -> l1_hits = 0;
+  core -> l1_misses = 0;
+  core -> l1_invalidations = 0;
+  core -> l2_hits = 0;
+  core -> l2_misses = 0;
+  core -> l2_invalidations = 0;
+  memset(&core -> shootdowns, 0, sizeof(core -> shootdowns));
+
+  free(core -> asid_stats);
+  core -> asid_stats = calloc(MAX_ASIDS, sizeof(tlb_asid_stats_t));
+  if (!core -> asid_stats) {
+    panic("Failed to allocate TLB statistics");
+  }
+  core -> asid = 0;
+  core -> context_switches = 0;
+  core -> flushed_entries = 0;
+}
+
+
+/**
+ * @brief Initializes the TLBs of every core and resets statistics. Core 0
+ * becomes the current core.
+ *
+ * @param config Geometry and latency of both levels, and number of cores
+ */
+void tlb_init(const tlb_config_t* config) {
+  if (config -> cores == 0 || config -> cores > MAX_CORES) {
+    panic("Invalid number of cores: %u (expected 1 to %d)", config -> cores, MAX_CORES);
+  }
+
+  tlb_core_count = config -> cores;
+  tlb_shootdown_latency_ns = config -> shootdown_latency_ns;
+  tlb_shootdown_handler_ns = config -> shootdown_handler_ns;
+  tlb_asid_mode = config -> asid_mode;
+  tlb_prefetch_config = config -> prefetch;
+
+  for (unsigned core = 0; core < tlb_core_count; core++)
+    tlb_core_init(&tlb_cores[core], config);
 
-uint64_t tlb_l2_hits = 0;
-uint64_t tlb_l2_misses = 0;
-uint64_t tlb_l2_invalidations = 0;
+  tlb_core = &tlb_cores[0];
+
+  memset(tlb_warm_slots, 0, sizeof(tlb_warm_slots));
+  tlb_warm_pending_count = 0;
+  tlb_warm_clock = 0;
+}
 
-uint64_t get_total_tlb_l1_hits() { return tlb_l1_hits; }
-uint64_t get_total_tlb_l1_misses() { return tlb_l1_misses; }
-uint64_t get_total_tlb_l1_invalidations() { return tlb_l1_invalidations; }
 
-uint64_t get_total_tlb_l2_hits() { return tlb_l2_hits; }
-uint64_t get_total_tlb_l2_misses() { return tlb_l2_misses; }
-uint64_t get_total_tlb_l2_invalidations() { return tlb_l2_invalidations; }
+/**
+ * @brief Saves or restores the entries of a TLB level, with its recency lists
+ * and hash index.
+ *
+ * @param level Level, initialized with the geometry it is restored with
+ * @param checkpoint Checkpoint being saved or restored
+ */
+void tlb_level_checkpoint(tlb_level_t* level, checkpoint_t* checkpoint) {
+  checkpoint_data(checkpoint, level -> entries, level -> size * sizeof(tlb_entry_t));
+  checkpoint_data(checkpoint, level -> sets, (level -> set_mask + 1) * sizeof(tlb_set_t));
+  if (level -> buckets)
+    checkpoint_data(checkpoint, level -> buckets, ((size_t)1 << level -> hash_bits) * sizeof(uint32_t));
+}
 
 
 /**
- * @brief Initializes all TLB entries (L1 and L2) and resets statistics.
+ * @brief Saves or restores the TLBs, prefetcher and statistics of every core.
+ *
+ * @param checkpoint Checkpoint being saved or restored
  */
-void tlb_init() {
-  memset(tlb_l1, 0, sizeof(tlb_l1));
-  memset(tlb_l2, 0, sizeof(tlb_l2));
-  tlb_l1_hits = 0;
-  tlb_l1_misses = 0;
-  tlb_l1_invalidations = 0;
-  tlb_l2_hits = 0;
-  tlb_l2_misses = 0;
-  tlb_l2_invalidations = 0;
+void tlb_checkpoint(checkpoint_t* checkpoint) {
+  for (unsigned i = 0; i < tlb_core_count; i++) {
+    tlb_core_t* core = &tlb_cores[i];
+
+    tlb_level_checkpoint(&core -> l1_level, checkpoint);
+    tlb_level_checkpoint(&core -> l2_level, checkpoint);
+    if (core -> l1_huge == &core -> l1_huge_level) {
+      tlb_level_checkpoint(&core -> l1_huge_level, checkpoint);
+      tlb_level_checkpoint(&core -> l2_huge_level, checkpoint);
+    }
+    CHECKPOINT_VALUE(checkpoint, core -> has_huge_entries);
+
+    if (tlb_prefetch_buffer_enabled())
+      tlb_level_checkpoint(&core -> prefetch_level, checkpoint);
+    tlb_prefetcher_checkpoint(&core -> prefetcher, &tlb_prefetch_config, checkpoint);
+    CHECKPOINT_VALUE(checkpoint, core -> prefetch);
+
+    CHECKPOINT_VALUE(checkpoint, core -> l1_hits);
+    CHECKPOINT_VALUE(checkpoint, core -> l1_misses);
+    CHECKPOINT_VALUE(checkpoint, core -> l1_invalidations);
+    CHECKPOINT_VALUE(checkpoint, core -> l2_hits);
+    CHECKPOINT_VALUE(checkpoint, core -> l2_misses);
+    CHECKPOINT_VALUE(checkpoint, core -> l2_invalidations);
+    CHECKPOINT_VALUE(checkpoint, core -> l1_huge_hits);
+    CHECKPOINT_VALUE(checkpoint, core -> l2_huge_hits);
+    CHECKPOINT_VALUE(checkpoint, core -> shootdowns);
+
+    CHECKPOINT_VALUE(checkpoint, core -> asid);
+    checkpoint_data(checkpoint, core -> asid_stats, MAX_ASIDS * sizeof(tlb_asid_stats_t));
+    CHECKPOINT_VALUE(checkpoint, core -> context_switches);
+    CHECKPOINT_VALUE(checkpoint, core -> flushed_entries);
+  }
+}
+
+
+/**
+ * @brief Makes a core the current one: its TLBs serve the next translations.
+ *
+ * @param core Core number, below the configured number of cores
+ */
+void tlb_select_core(unsigned core) {
+  if (core >= tlb_core_count) {
+    panic("Instruction for core %u, but there are only %u cores", core, tlb_core_count);
+  }
+
+  tlb_core = &tlb_cores[core];
+}
+
+
+/**
+ * @brief Returns the TLB lookups of an address space, on every core.
+ *
+ * @param asid ASID of the address space
+ * @return Hits and misses of both levels
+ */
+tlb_asid_stats_t get_asid_tlb_stats(unsigned asid) {
+  tlb_asid_stats_t total = {0};
+
+  for (unsigned core = 0; core < tlb_core_count; core++) {
+    const tlb_asid_stats_t* stats = &tlb_cores[core].asid_stats[asid];
+    total.l1_hits += stats -> l1_hits;
+    total.l1_misses += stats -> l1_misses;
+    total.l2_hits += stats -> l2_hits;
+    total.l2_misses += stats -> l2_misses;
+  }
+
+  return total;
+}
+
+
+/**
+ * @brief Returns the shootdown statistics of a core.
+ *
+ * @param core Core number
+ * @return Pointer to the statistics of the core
+ */
+const tlb_shootdown_stats_t* get_tlb_shootdown_stats(unsigned core) {
+  return &tlb_cores[core].shootdowns;
+}
+
+
+/**
+ * @brief Returns the time a shootdown takes to reach the other cores.
+ *
+ * @return Shootdown latency, in ns
+ */
+time_ns_t get_tlb_shootdown_latency() {
+  return tlb_shootdown_latency_ns;
+}
+
+
+/**
+ * @brief Returns the TLB hits and misses of a core.
+ *
+ * @param core Core number
+ * @param l1_hits Output L1 hits
+ * @param l1_misses Output L1 misses
+ * @param l2_hits Output L2 hits
+ * @param l2_misses Output L2 misses
+ */
+void get_core_tlb_hits(unsigned core, uint64_t* l1_hits, uint64_t* l1_misses, uint64_t* l2_hits, uint64_t* l2_misses) {
+  *l1_hits = tlb_cores[core].l1_hits;
+  *l1_misses = tlb_cores[core].l1_misses;
+  *l2_hits = tlb_cores[core].l2_hits;
+  *l2_misses = tlb_cores[core].l2_misses;
+}
+
+
+/**
+ * @brief Computes the hash bucket of a VPN (Fibonacci hashing).
+ *
+ * @param level TLB level owning the hash index
+ * @param virtual_page_number VPN to hash
+ * @return Bucket index in [0, 2^hash_bits)
+ */
+static inline uint64_t tlb_hash(const tlb_level_t* level, va_t virtual_page_number) {
+  return (virtual_page_number * 0x9e3779b97f4a7c15llu) >> (64 - level -> hash_bits);
+}
+
+
+/**
+ * @brief Links a slot into the hash index of its TLB level, if it has one.
+ *
+ * @param level TLB level owning the slot
+ * @param entry Entry to index (its VPN must already be set)
+ */
+void tlb_index_insert(tlb_level_t* level, tlb_entry_t* entry) {
+  if (!level -> buckets)
+    return;
+
+  uint64_t bucket = tlb_hash(level, entry -> virtual_page_number);
+  entry -> hash_next = level -> buckets[bucket];
+  level -> buckets[bucket] = (uint32_t)(entry - level -> entries);
+}
+
+
+/**
+ * @brief Unlinks a slot from the hash index of its TLB level, if it has one.
+ *
+ * @param level TLB level owning the slot
+ * @param entry Entry to remove (must currently be indexed)
+ */
+void tlb_index_remove(tlb_level_t* level, tlb_entry_t* entry) {
+  if (!level -> buckets)
+    return;
+
+  uint32_t slot = (uint32_t)(entry - level -> entries);
+  uint32_t* link = &level -> buckets[tlb_hash(level, entry -> virtual_page_number)];
+
+  while (*link != slot)
+    link = &level -> entries[*link].hash_next;
+
+  *link = entry -> hash_next;
+  entry -> hash_next = TLB_NO_SLOT;
+}
+
+
+/**
+ * @brief Marks a valid entry as the most recently used of its level.
+ *
+ * Only LRU levels reorder on hits: FIFO levels keep insertion order, and
+ * random levels do not use the order at all.
+ *
+ * @param level TLB level owning the entry
+ * @param entry Valid entry that was just accessed
+ */
+void touch_tlb_entry(tlb_level_t* level, tlb_entry_t* entry) {
+  if (level -> replacement != TLB_REPLACEMENT_LRU)
+    return;
+
+  tlb_set_t* set = get_set(level, entry -> virtual_page_number);
+  tlb_list_unlink(level, &set -> recency, entry);
+  tlb_list_push_front(level, &set -> recency, entry);
+}
+
+
+/**
+ * @brief Picks the slot that the next insertion of a VPN into a level will use.
+ *
+ * A free slot of the VPN's set is preferred; otherwise the tail of its recency
+ * list, which is the Least Recently Used (LRU) entry for LRU levels and the
+ * oldest insertion for FIFO levels, or a random way for random levels.
+ *
+ * @param level TLB level to pick from
+ * @param virtual_page_number VPN that will be inserted
+ * @return Pointer to an invalid entry, or to the LRU valid entry
+ */
+tlb_entry_t* get_victim_entry(tlb_level_t* level, va_t virtual_page_number) {
+  tlb_set_t* set = get_set(level, virtual_page_number);
+
+  if (set -> free.head != TLB_NO_SLOT)
+    return &level -> entries[set -> free.head];
+
+  if (level -> replacement == TLB_REPLACEMENT_RANDOM)
+    return &level -> entries[(virtual_page_number & level -> set_mask) * level -> ways + (uint64_t)rand() % level -> ways];
+
+  return &level -> entries[set -> recency.tail];
 }
 
 
 /**
  * @brief Sets the fields of a TLB entry with the given translation data.
  *
+ * Keeps the hash index and the lists of the level in sync: the previous
+ * translation held by the slot (if any) is unlinked, and the slot becomes the
+ * most recently used entry of the level.
+ *
+ * @param level TLB level owning the entry
  * @param entry Pointer to the TLB entry to update
  * @param virtual_page_number Virtual page number of the translation
  * @param physical_page_number Physical page number of the translation
- * @param last_access Last access counter for LRU tracking
  * @param is_dirty True if the entry corresponds to a write, False otherwise
+ * @param huge True if the translation maps a huge page
  */
-void set_tlb_entry(tlb_entry_t* entry, va_t virtual_page_number, pa_dram_t physical_page_number, uint64_t last_access, bool is_dirty) {
+void set_tlb_entry(tlb_level_t* level, tlb_entry_t* entry, va_t virtual_page_number, pa_dram_t physical_page_number,
+                   bool is_dirty, bool huge) {
+  if (entry -> valid) {
+    tlb_index_remove(level, entry);
+    tlb_list_unlink(level, &get_set(level, entry -> virtual_page_number) -> recency, entry);
+  }
+  else {
+    tlb_list_unlink(level, &get_set(level, virtual_page_number) -> free, entry);
+  }
+
   entry -> valid = true;
   entry -> dirty = is_dirty;
-  entry -> last_access = last_access;
+  entry -> prefetched = false;
+  entry -> ready_ns = 0;
+  entry -> ready_cause = TIME_MEMORY;
+  entry -> huge = huge;
   entry -> virtual_page_number = virtual_page_number;
   entry -> physical_page_number = physical_page_number;
+
+  tlb_index_insert(level, entry);
+  tlb_list_push_front(level, &get_set(level, virtual_page_number) -> recency, entry);
+}
+
+
+/**
+ * @brief Invalidates a TLB entry, removes it from the hash index and returns
+ * its slot to the free list.
+ *
+ * @param level TLB level owning the entry
+ * @param entry Pointer to the valid TLB entry to invalidate
+ */
+void clear_tlb_entry(tlb_level_t* level, tlb_entry_t* entry) {
+  tlb_set_t* set = get_set(level, entry -> virtual_page_number);
+
+  tlb_index_remove(level, entry);
+  tlb_list_unlink(level, &set -> recency, entry);
+
+  entry -> valid = false;
+  entry -> dirty = false;
+
+  tlb_list_push_front(level, &set -> free, entry);
 }
 
 
 /**
  * @brief Searches for a valid entry in the TLB with the given virtual page number (VPN).
  *
- * @param tlb Array of TLB entries
- * @param size Number of entries in the TLB
- * @param virtual_page_number Virtual page number to search
+ * Only the set of the VPN is visited: small sets are scanned, larger ones are
+ * looked up through the hash index, so the lookup is O(1) on average
+ * regardless of the number of entries of the level.
+ *
+ * @param level TLB level to search
+ * @param virtual_page_number Virtual page number (or huge page number) to search
+ * @param huge True to search for a huge page entry
  * @return Pointer to the TLB entry if found, NULL otherwise
  */
-tlb_entry_t* get_entry(tlb_entry_t tlb[], uint64_t size, va_t virtual_page_number) {
+tlb_entry_t* get_entry(tlb_level_t* level, va_t virtual_page_number, bool huge) {
+
+  if (!level -> buckets) {
+    tlb_entry_t* set = &level -> entries[(virtual_page_number & level -> set_mask) * level -> ways];
 
-  for (size_t i = 0; i < size; i++)
+    for (uint64_t way = 0; way < level -> ways; way++)
+    {
+      if (set[way].valid && set[way].virtual_page_number == virtual_page_number && set[way].huge == huge) {
+
+        return &set[way];
+      }
+    }
+
+    return NULL;
+  }
+
+  uint32_t slot = level -> buckets[tlb_hash(level, virtual_page_number)];
+
+  while (slot != TLB_NO_SLOT)
   {
-    if (tlb[i].valid && tlb[i].virtual_page_number == virtual_page_number) {
+    tlb_entry_t* entry = &level -> entries[slot];
 
-      return &tlb[i];
+    if (entry -> virtual_page_number == virtual_page_number && entry -> huge == huge) {
+
+      return entry;
     }
+
+    slot = entry -> hash_next;
   }
 
   return NULL;
@@ -97,133 +794,425 @@ tlb_entry_t* get_entry(tlb_entry_t tlb[], uint64_t size, va_t virtual_page_numbe
 
 
 /**
- * @brief Invalidates an entry in both L1 and L2 TLBs for the given VPN.
+ * @brief Invalidates the entry of a page in both L1 and L2 TLBs.
  *
  * - If found in L1:
  *   - Marks the entry as invalid
- *   - Increments @c tlb_l1_invalidations
+ *   - Increments @c l1_invalidations
  *   - If dirty, schedules a write-back
  *
  * - If found in L2:
  *   - Marks the entry as invalid
- *   - Increments @c tlb_l2_invalidations
+ *   - Increments @c l2_invalidations
  *   - If dirty and not already written back from L1, schedules a write-back
  *
- * @param virtual_page_number VPN of the entry to invalidate
+ * - Drops a prefetched, unused translation of the page from the prefetch buffer
+ *
+ * @param virtual_page_number VPN (or huge page number) of the entry to invalidate
+ * @param huge True to invalidate a huge page entry
  */
-void tlb_invalidate(va_t virtual_page_number) {
+void invalidate_tlb_entries(va_t virtual_page_number, bool huge) {
 
   bool is_dirty = false;
-  pa_dram_t replaced_entry;
+  pa_dram_t replaced_entry = 0;
+  const char* page = huge ? "huge page" : "page";
 
   // Invalidate from cache L1
-  increment_time(TLB_L1_LATENCY_NS);
-  tlb_entry_t* l1_entry = get_entry(tlb_l1, TLB_L1_SIZE, virtual_page_number);
-  
+  increment_time(TIME_TLB, tlb_core -> l1_level.latency_ns);
+  tlb_level_t* l1_level = get_level(true, huge);
+  tlb_entry_t* l1_entry = get_entry(l1_level, virtual_page_number, huge);
+
   if (l1_entry) {
 
-    l1_entry -> valid = false;
-    tlb_l1_invalidations++;
-    
     if (l1_entry -> dirty) {
 
       is_dirty = true;
       replaced_entry = (l1_entry -> physical_page_number << PAGE_SIZE_BITS) & DRAM_ADDRESS_MASK;
     }
-    
-    log_dbg("Invalidated page %" PRIu64 " on Cache L1.", virtual_page_number);
+
+    clear_tlb_entry(l1_level, l1_entry);
+    tlb_core -> l1_invalidations++;
+
+    log_dbg("Invalidated %s %" PRIu64 " on Cache L1.", page, virtual_page_number);
   }
 
   // Invalidate from cache L2
-  increment_time(TLB_L2_LATENCY_NS);
-  tlb_entry_t* l2_entry = get_entry(tlb_l2, TLB_L2_SIZE, virtual_page_number);
+  increment_time(TIME_TLB, tlb_core -> l2_level.latency_ns);
+  tlb_level_t* l2_level = get_level(false, huge);
+  tlb_entry_t* l2_entry = get_entry(l2_level, virtual_page_number, huge);
 
   if (l2_entry) {
 
-    l2_entry -> valid = false;
-    tlb_l2_invalidations++;
-    
     if (l2_entry -> dirty && !is_dirty) {
 
       is_dirty = true;
       replaced_entry = (l2_entry -> physical_page_number << PAGE_SIZE_BITS) & DRAM_ADDRESS_MASK;
     }
-    
-    log_dbg("Invalidated page %" PRIu64 " on Cache L2.", virtual_page_number);
+
+    clear_tlb_entry(l2_level, l2_entry);
+    tlb_core -> l2_invalidations++;
+
+    log_dbg("Invalidated %s %" PRIu64 " on Cache L2.", page, virtual_page_number);
   }
-  
+
+  // Drop a prefetched translation
+  if (!huge && tlb_prefetch_buffer_enabled()) {
+    tlb_entry_t* prefetched = get_entry(&tlb_core -> prefetch_level, virtual_page_number, false);
+
+    if (prefetched)
+      clear_tlb_entry(&tlb_core -> prefetch_level, prefetched);
+  }
+
   // Write back if necessary
   if (is_dirty)
     write_back_tlb_entry(replaced_entry);
 }
 
 
+/**
+ * @brief Flushes every valid entry of a TLB level of the current core.
+ *
+ * Dirty L1 entries mark their L2 entry as dirty if present, and are written
+ * back otherwise; dirty L2 entries are written back.
+ *
+ * @param level TLB level to flush
+ * @param is_L1 True for an L1 level, False for an L2 level
+ */
+void flush_tlb_level(tlb_level_t* level, bool is_L1) {
+  for (uint64_t slot = 0; slot < level -> size; slot++) {
+    tlb_entry_t* entry = &level -> entries[slot];
+
+    if (!entry -> valid)
+      continue;
+
+    if (entry -> dirty) {
+      tlb_entry_t* l2_entry = NULL;
+      if (is_L1)
+        l2_entry = get_entry(get_level(false, entry -> huge), entry -> virtual_page_number, entry -> huge);
+
+      if (l2_entry)
+        l2_entry -> dirty = true;
+      else
+        write_back_tlb_entry((entry -> physical_page_number << PAGE_SIZE_BITS) & DRAM_ADDRESS_MASK);
+    }
+
+    clear_tlb_entry(level, entry);
+    tlb_core -> flushed_entries++;
+  }
+}
+
+
+/**
+ * @brief Switches the current core to another address space.
+ *
+ * In flush mode, every TLB entry of the core is flushed (L1 first, so that its
+ * dirty bits reach L2). In tagged mode, entries carry their ASID in the high
+ * bits of their VPN (see page_key()) and are kept.
+ *
+ * @param asid ASID of the address space the core runs next
+ */
+void tlb_select_asid(unsigned asid) {
+  if (asid == tlb_core -> asid)
+    return;
+
+  if (asid >= MAX_ASIDS) {
+    panic("Invalid ASID %u (expected below %u)", asid, MAX_ASIDS);
+  }
+
+  tlb_core -> asid = asid;
+  tlb_core -> context_switches++;
+  event_emit(EVENT_CONTEXT_SWITCH, OP_READ, 0, asid, 0);
+  log_dbg("Context switch to ASID %u.", asid);
+
+  if (tlb_asid_mode != TLB_ASID_FLUSH)
+    return;
+
+  flush_tlb_level(&tlb_core -> l1_level, true);
+  if (tlb_core -> l1_huge != &tlb_core -> l1_level)
+    flush_tlb_level(tlb_core -> l1_huge, true);
+
+  flush_tlb_level(&tlb_core -> l2_level, false);
+  if (tlb_core -> l2_huge != &tlb_core -> l2_level)
+    flush_tlb_level(tlb_core -> l2_huge, false);
+
+  if (tlb_prefetch_buffer_enabled())
+    flush_tlb_level(&tlb_core -> prefetch_level, false);
+
+  tlb_core -> has_huge_entries = false;
+}
+
+
+/**
+ * @brief Returns the ASID of the address space the current core runs.
+ *
+ * @return ASID of the current core
+ */
+unsigned get_current_asid() {
+  return tlb_core -> asid;
+}
+
+
+/**
+ * @brief Invalidates an entry in both L1 and L2 TLBs for the given VPN.
+ *
+ * @param virtual_page_number VPN of the entry to invalidate
+ */
+void tlb_invalidate(va_t virtual_page_number) {
+  invalidate_tlb_entries(virtual_page_number, false);
+}
+
+
+/**
+ * @brief Invalidates a huge page entry in both L1 and L2 TLBs.
+ *
+ * @param huge_page_number Huge page number of the entry to invalidate
+ */
+void tlb_invalidate_huge(va_t huge_page_number) {
+  invalidate_tlb_entries(huge_page_number, true);
+}
+
+
+/**
+ * @brief Invalidates a translation in the current core and in other cores
+ * that may cache it.
+ *
+ * The other cores are interrupted (IPI): the current core waits
+ * @c tlb_shootdown_latency_ns for their acknowledgements, and each target
+ * spends @c tlb_shootdown_handler_ns in the handler on top of the
+ * invalidation itself, on its own clock.
+ *
+ * @param virtual_page_number VPN (or huge page number) of the translation
+ * @param huge True to invalidate a huge page entry
+ * @param cores Bit mask of the cores that may cache the translation
+ */
+void shootdown_tlb_entries(va_t virtual_page_number, bool huge, uint64_t cores) {
+  unsigned initiator = (unsigned)(tlb_core - tlb_cores);
+
+  invalidate_tlb_entries(virtual_page_number, huge);
+
+  cores &= ~(1llu << initiator);
+  if (!cores)
+    return;
+
+  increment_time(TIME_SHOOTDOWN, tlb_shootdown_latency_ns);
+  tlb_core -> shootdowns.sent++;
+  tlb_core -> shootdowns.time_ns += tlb_shootdown_latency_ns;
+
+  for (unsigned core = 0; core < tlb_core_count; core++) {
+    if (!(cores & (1llu << core)))
+      continue;
+
+    tlb_core = &tlb_cores[core];
+    clock_select_core(core);
+
+    time_ns_t start = get_time();
+    increment_time(TIME_SHOOTDOWN, tlb_shootdown_handler_ns);
+    invalidate_tlb_entries(virtual_page_number, huge);
+
+    tlb_core -> shootdowns.received++;
+    tlb_core -> shootdowns.time_ns += get_time() - start;
+
+    log_dbg("Shootdown of %s %" PRIx64 " on core %u.", huge ? "huge page" : "page", virtual_page_number, core);
+  }
+
+  tlb_core = &tlb_cores[initiator];
+  clock_select_core(initiator);
+}
+
+
+/**
+ * @brief Invalidates a page in the TLBs of the current core and shoots it
+ * down in the other given cores.
+ *
+ * @param virtual_page_number VPN of the entry to invalidate
+ * @param cores Bit mask of the cores that may cache the translation
+ */
+void tlb_shootdown(va_t virtual_page_number, uint64_t cores) {
+  shootdown_tlb_entries(virtual_page_number, false, cores);
+}
+
+
+/**
+ * @brief Invalidates a huge page in the TLBs of the current core and shoots
+ * it down in the other given cores.
+ *
+ * @param huge_page_number Huge page number of the entry to invalidate
+ * @param cores Bit mask of the cores that may cache the translation
+ */
+void tlb_shootdown_huge(va_t huge_page_number, uint64_t cores) {
+  shootdown_tlb_entries(huge_page_number, true, cores);
+}
+
+
 /**
  * @brief Adds a new translation to the TLB.
  *
- * If an empty entry is available, it is used. Otherwise, the Least Recently Used (LRU) entry is replaced.
+ * The translation is stored in @p tlb_victim_entry, which was picked by
+ * get_victim_entry() in the array of its page size. If that slot still holds
+ * a valid translation, it is the Least Recently Used (LRU) entry and is
+ * replaced:
  * - If replacing an L1 entry that is dirty, marks the corresponding L2 entry as dirty if present.
  *   If not, adds a new corresponding L2 entry as dirty.
  * - If replacing an L2 entry that is dirty, writes back to memory.
  *
  * @param is_L1 True if adding to L1 TLB, False if adding to L2 TLB
- * @param tlb_empty_entry Pointer to an empty TLB entry, or NULL if none
- * @param tlb_LRU_entry Pointer to the LRU TLB entry
- * @param virtual_page_number VPN of the translation
- * @param physical_page_number PPN of the translation
- * @param last_access Last access counter for the entry
+ * @param tlb_victim_entry Pointer to the free or LRU TLB entry to use
+ * @param virtual_page_number VPN (or huge page number) of the translation
+ * @param physical_page_number PPN of the translation (first frame for huge pages)
  * @param is_dirty True if the operation was a write, False if a read
+ * @param huge True if the translation maps a huge page
  */
-void add_entry_to_tlb(bool is_L1, tlb_entry_t* tlb_empty_entry, tlb_entry_t* tlb_LRU_entry,
-                      va_t virtual_page_number, pa_dram_t physical_page_number, uint64_t last_access, bool is_dirty) {
+void add_entry_to_tlb(bool is_L1, tlb_entry_t* tlb_victim_entry,
+                      va_t virtual_page_number, pa_dram_t physical_page_number, bool is_dirty, bool huge) {
+
+  tlb_level_t* level = get_level(is_L1, huge);
+
+  if (tlb_victim_entry -> valid && tlb_victim_entry -> dirty) {
+    // Needs to replace a dirty LRU entry
+
+    if (is_L1) {
 
-  if (tlb_empty_entry) {
-    set_tlb_entry(tlb_empty_entry, virtual_page_number, physical_page_number, last_access, is_dirty);
+      tlb_level_t* l2_level = get_level(false, tlb_victim_entry -> huge);
+      tlb_entry_t* l2_entry = get_entry(l2_level, tlb_victim_entry -> virtual_page_number, tlb_victim_entry -> huge);
+
+      if (l2_entry)
+        l2_entry -> dirty = true;
+
+      else
+        add_entry_to_tlb(false, get_victim_entry(l2_level, tlb_victim_entry -> virtual_page_number), tlb_victim_entry -> virtual_page_number,
+                         tlb_victim_entry -> physical_page_number, tlb_victim_entry -> dirty, tlb_victim_entry -> huge);
+
+    } else {
+
+      pa_dram_t replaced_entry = ((tlb_victim_entry -> physical_page_number) << PAGE_SIZE_BITS) & DRAM_ADDRESS_MASK;
+      write_back_tlb_entry(replaced_entry);
+    }
   }
-  else {
-    // Needs to replace LRU entry
-
-    if (tlb_LRU_entry -> dirty) {
-      
-      if (is_L1) {
-
-        tlb_entry_t* l2_entry = get_entry(tlb_l2, TLB_L2_SIZE, tlb_LRU_entry -> virtual_page_number);
-
-        if (l2_entry)
-          l2_entry -> dirty = true;
-
-        else {
-
-          tlb_entry_t* tlb_l2_empty_entry = NULL;
-          tlb_entry_t* tlb_l2_LRU_entry = NULL;
-
-          // Search for empty entry and LRU
-          for (size_t i = 0; i < TLB_L2_SIZE; i++)
-          {
-            // Get empty entry
-            if (!tlb_l2[i].valid) {
-              *tlb_l2_empty_entry = tlb_l2[i];
-              break;
-            }
-            
-            // Get oldest access entry
-            else if (!tlb_l2_LRU_entry || tlb_l2[i].last_access < tlb_l2_LRU_entry -> last_access) {
-              *tlb_l2_LRU_entry = tlb_l2[i];
-            }
-          }
-
-          add_entry_to_tlb(false, tlb_l2_empty_entry, tlb_l2_LRU_entry, tlb_LRU_entry -> virtual_page_number,
-                            tlb_LRU_entry -> physical_page_number, tlb_LRU_entry -> last_access, tlb_LRU_entry -> dirty);
-        }
-          
-      } else {
-        
-        pa_dram_t replaced_entry = ((tlb_LRU_entry -> physical_page_number) << PAGE_SIZE_BITS) & DRAM_ADDRESS_MASK;
-        write_back_tlb_entry(replaced_entry);
-      }
+
+  if (huge)
+    tlb_core -> has_huge_entries = true;
+
+  set_tlb_entry(level, tlb_victim_entry, virtual_page_number, physical_page_number, is_dirty, huge);
+}
+
+
+/**
+ * @brief Looks up the translation of a VPN in one TLB level, for both page
+ * sizes: the base page entry first, then the huge page entry covering it.
+ *
+ * @param is_L1 True to search the L1 TLB, False to search the L2 TLB
+ * @param virtual_page_number VPN to search
+ * @return Pointer to the TLB entry if found, NULL otherwise
+ */
+tlb_entry_t* lookup_tlb_entry(bool is_L1, va_t virtual_page_number) {
+  tlb_entry_t* entry = get_entry(get_level(is_L1, false), virtual_page_number, false);
+
+  if (!entry && tlb_core -> has_huge_entries)
+    entry = get_entry(get_level(is_L1, true), virtual_page_number >> HUGE_PAGE_ORDER, true);
+
+  return entry;
+}
+
+
+/**
+ * @brief Computes the physical address of a virtual address through a TLB entry.
+ *
+ * @param entry Valid TLB entry mapping the address
+ * @param virtual_address Virtual address to translate
+ * @return Translated physical address
+ */
+static inline pa_dram_t get_entry_address(const tlb_entry_t* entry, va_t virtual_address) {
+  va_t offset = virtual_address & (entry -> huge ? HUGE_PAGE_OFFSET_MASK : PAGE_OFFSET_MASK);
+  return ((entry -> physical_page_number << PAGE_SIZE_BITS) | offset) & DRAM_ADDRESS_MASK;
+}
+
+
+/**
+ * @brief Makes a freshly filled entry usable only once its miss completes.
+ *
+ * @param entry Filled TLB entry
+ * @param ready_ns Completion time of the miss
+ * @param cause What a wait for the miss is charged to
+ */
+static inline void set_tlb_entry_ready(tlb_entry_t* entry, time_ns_t ready_ns, time_cause_t cause) {
+  entry -> ready_ns = ready_ns;
+  entry -> ready_cause = cause;
+}
+
+
+/**
+ * @brief Accounts the first use of a prefetched translation.
+ *
+ * The prefetch walk started when the entry was filled: if it is not over
+ * yet, the lookup waits for it (a late prefetch). Whatever is left of the
+ * walk is the time saved.
+ *
+ * @param entry Prefetched TLB or prefetch buffer entry
+ */
+void use_prefetched_entry(tlb_entry_t* entry) {
+  time_ns_t now = get_time();
+  time_ns_t wait = entry -> ready_ns > now ? entry -> ready_ns - now : 0;
+
+  if (wait) {
+    tlb_core -> prefetch.late++;
+    wait_until(TIME_MEMORY, entry -> ready_ns);
+  }
+
+  tlb_core -> prefetch.useful++;
+  time_ns_t walk_ns = page_table_walk_ns((entry -> virtual_page_number & PAGE_INDEX_MASK) << PAGE_SIZE_BITS);
+  tlb_core -> prefetch.saved_ns += walk_ns > wait ? walk_ns - wait : 0;
+  entry -> prefetched = false;
+}
+
+
+/**
+ * @brief Trains the prefetcher on a VPN that missed both TLB levels, and
+ * prefetches the translations it predicts.
+ *
+ * Predicted pages already cached, or whose translation is not a resident
+ * base page, are skipped. The others are filled in the prefetch buffer or in
+ * the L2 TLB, and become usable once a page walk, done in the background,
+ * is over.
+ *
+ * @param virtual_page_number VPN of the L2 miss
+ * @param warm True when warming: the prefetches are not counted
+ */
+void prefetch_tlb_entries(va_t virtual_page_number, bool warm) {
+  va_t pages[TLB_PREFETCH_MAX_DEGREE];
+  unsigned count = tlb_prefetcher_predict(&tlb_core -> prefetcher, &tlb_prefetch_config, virtual_page_number, pages);
+  bool to_buffer = tlb_prefetch_buffer_enabled();
+
+  for (unsigned i = 0; i < count; i++) {
+    va_t page = pages[i];
+
+    if (lookup_tlb_entry(true, page) || lookup_tlb_entry(false, page))
+      continue;
+    if (to_buffer && get_entry(&tlb_core -> prefetch_level, page, false))
+      continue;
+
+    va_t page_address = (page & PAGE_INDEX_MASK) << PAGE_SIZE_BITS;
+    pa_dram_t physical_address;
+    if (!page_table_probe(page_address, &physical_address))
+      continue;
+
+    pa_dram_t physical_page_number = (physical_address >> PAGE_SIZE_BITS) & PHYSICAL_PAGE_NUMBER_MASK;
+    tlb_entry_t* entry;
+
+    if (to_buffer) {
+      entry = get_victim_entry(&tlb_core -> prefetch_level, page);
+      set_tlb_entry(&tlb_core -> prefetch_level, entry, page, physical_page_number, false, false);
     }
+    else {
+      entry = get_victim_entry(&tlb_core -> l2_level, page);
+      add_entry_to_tlb(false, entry, page, physical_page_number, false, false);
+    }
+
+    entry -> prefetched = true;
+    entry -> ready_ns = get_time() + page_table_walk_ns(page_address);
+    if (!warm)
+      tlb_core -> prefetch.issued++;
 
-    set_tlb_entry(tlb_LRU_entry, virtual_page_number, physical_page_number, last_access, is_dirty);
+    log_dbg("Prefetched translation (VPN=%" PRIx64 " PPN=%" PRIx64 ")", page, physical_page_number);
   }
 }
 
@@ -232,42 +1221,46 @@ void add_entry_to_tlb(bool is_L1, tlb_entry_t* tlb_empty_entry, tlb_entry_t* tlb
  * @brief Searches for an entry in the L1 TLB matching the given VPN.
  *
  * - If found:
- *   - Increments @c tlb_l1_hits
- *   - Updates the entry's last access counter
+ *   - Increments @c l1_hits (and @c l1_huge_hits for huge pages)
+ *   - Promotes the entry to most recently used
+ *   - Waits for the miss that filled the entry, if it is not over
  *   - Sets the dirty bit if the operation is a write
  *   - Returns the translated physical address
  *
  * - If not found:
- *   - Increments @c tlb_l1_misses
- *   - Identifies an empty entry (if any) and the LRU entry
+ *   - Increments @c l1_misses
+ *   - Identifies the slot to fill (an empty entry if any, else the LRU entry)
  *
  * @param virtual_address Full virtual address to translate
  * @param virtual_page_number VPN of the translation
- * @param virtual_page_offset Offset within the page
  * @param op Operation type (Read or Write)
- * @param tlb_l1_n_access Current access counter
- * @param tlb_l1_empty_entry Output pointer to an empty entry, or NULL if none
- * @param tlb_l1_LRU_entry Output pointer to the LRU entry
+ * @param tlb_l1_victim_entry Output pointer to the empty or LRU base page entry
  * @param success Output flag, true if found, false otherwise
  * @return Translated physical address if found, 0 otherwise
  */
-pa_dram_t search_tlb_l1(va_t virtual_address, va_t virtual_page_number, va_t virtual_page_offset, op_t op, uint64_t tlb_l1_n_access,
-                        tlb_entry_t** tlb_l1_empty_entry, tlb_entry_t** tlb_l1_LRU_entry, bool* success) {
+pa_dram_t search_tlb_l1(va_t virtual_address, va_t virtual_page_number, op_t op,
+                        tlb_entry_t** tlb_l1_victim_entry, bool* success) {
 
-  increment_time(TLB_L1_LATENCY_NS);
-  tlb_entry_t* l1_entry = get_entry(tlb_l1, TLB_L1_SIZE, virtual_page_number);
+  increment_time(TIME_TLB, tlb_core -> l1_level.latency_ns);
+  tlb_entry_t* l1_entry = lookup_tlb_entry(true, virtual_page_number);
 
   // If found in TLB
   if (l1_entry) {
 
-    tlb_l1_hits++;
-    l1_entry -> last_access = tlb_l1_n_access;
+    tlb_core -> l1_hits++;
+    tlb_core -> asid_stats[tlb_core -> asid].l1_hits++;
+    if (l1_entry -> huge)
+      tlb_core -> l1_huge_hits++;
+
+    touch_tlb_entry(get_level(true, l1_entry -> huge), l1_entry);
+    wait_until(l1_entry -> ready_cause, l1_entry -> ready_ns);
 
     if (op == OP_WRITE) {
       l1_entry -> dirty = true;
     }
 
-    pa_dram_t translated_address = ((l1_entry -> physical_page_number << PAGE_SIZE_BITS) | virtual_page_offset) & DRAM_ADDRESS_MASK;
+    pa_dram_t translated_address = get_entry_address(l1_entry, virtual_address);
+    event_emit(EVENT_TLB_HIT, op, 1, virtual_page_number, translated_address >> PAGE_SIZE_BITS);
     log_dbg("Cache L1 found (VA=%" PRIx64 " VPN=%" PRIx64 " PA=%" PRIx64 ")",
             virtual_address, virtual_page_number, translated_address);
 
@@ -275,22 +1268,11 @@ pa_dram_t search_tlb_l1(va_t virtual_address, va_t virtual_page_number, va_t vir
     return translated_address;
   }
 
-  // Search for empty entry and LRU
-  for (size_t i = 0; i < TLB_L1_SIZE; i++)
-  {
-    // Get empty entry
-    if (!tlb_l1[i].valid) {
-      *tlb_l1_empty_entry = &tlb_l1[i];
-      break;
-    }
-
-    // Get oldest access entry
-    else if (!*tlb_l1_LRU_entry || tlb_l1[i].last_access < (*tlb_l1_LRU_entry) -> last_access) {
-      *tlb_l1_LRU_entry = &tlb_l1[i];
-    }
-  }
+  *tlb_l1_victim_entry = get_victim_entry(&tlb_core -> l1_level, virtual_page_number);
+  event_emit(EVENT_TLB_MISS, op, 1, virtual_page_number, 0);
 
-  tlb_l1_misses++;
+  tlb_core -> l1_misses++;
+  tlb_core -> asid_stats[tlb_core -> asid].l1_misses++;
   *success = false;
   return 0;
 }
@@ -300,67 +1282,69 @@ pa_dram_t search_tlb_l1(va_t virtual_address, va_t virtual_page_number, va_t vir
  * @brief Searches for an entry in the L2 TLB matching the given VPN.
  *
  * - If found:
- *   - Increments @c tlb_l2_hits
- *   - Updates the entry's last access counter
+ *   - Increments @c l2_hits (and @c l2_huge_hits for huge pages)
+ *   - Promotes the entry to most recently used
+ *   - Waits for the miss or the prefetch that filled the entry, if it is not over
  *   - Sets the dirty bit if the operation is a write
  *   - Returns the translated physical address
  *
  * - If not found:
- *   - Increments @c tlb_l2_misses
- *   - Identifies an empty entry (if any) and the LRU entry
+ *   - Increments @c l2_misses
+ *   - Identifies the slot to fill (an empty entry if any, else the LRU entry)
  *
  * @param virtual_address Full virtual address to translate
  * @param virtual_page_number VPN of the translation
- * @param virtual_page_offset Offset within the page
  * @param op Operation type (Read or Write)
- * @param tlb_l2_n_access Current access counter
- * @param tlb_l2_empty_entry Output pointer to an empty entry, or NULL if none
- * @param tlb_l2_LRU_entry Output pointer to the LRU entry
+ * @param tlb_l2_victim_entry Output pointer to the empty or LRU base page entry
  * @param success Output flag, true if found, false otherwise
  * @param is_dirty Output flag, true if the found entry is dirty
+ * @param is_huge Output flag, true if the found entry maps a huge page
  * @return Translated physical address if found, 0 otherwise
  */
-pa_dram_t search_tlb_l2(va_t virtual_address, va_t virtual_page_number, va_t virtual_page_offset, op_t op, uint64_t tlb_l2_n_access,
-                        tlb_entry_t** tlb_l2_empty_entry, tlb_entry_t** tlb_l2_LRU_entry, bool* success, bool* is_dirty) {
+pa_dram_t search_tlb_l2(va_t virtual_address, va_t virtual_page_number, op_t op,
+                        tlb_entry_t** tlb_l2_victim_entry, bool* success, bool* is_dirty, bool* is_huge) {
 
-  increment_time(TLB_L2_LATENCY_NS);
-  tlb_entry_t* l2_entry = get_entry(tlb_l2, TLB_L2_SIZE, virtual_page_number);
+  increment_time(TIME_TLB, tlb_core -> l2_level.latency_ns);
+  tlb_entry_t* l2_entry = lookup_tlb_entry(false, virtual_page_number);
 
   // If found in TLB
   if (l2_entry) {
 
-    tlb_l2_hits++;
-    l2_entry -> last_access = tlb_l2_n_access;
+    tlb_core -> l2_hits++;
+    tlb_core -> asid_stats[tlb_core -> asid].l2_hits++;
+    if (l2_entry -> huge)
+      tlb_core -> l2_huge_hits++;
+
+    touch_tlb_entry(get_level(false, l2_entry -> huge), l2_entry);
+
+    if (l2_entry -> prefetched) {
+      use_prefetched_entry(l2_entry);
+      page_table_use_prefetch(virtual_address, op);
+    }
+    else {
+      wait_until(l2_entry -> ready_cause, l2_entry -> ready_ns);
+    }
 
     if (op == OP_WRITE) {
       l2_entry -> dirty = true;
     }
 
-    pa_dram_t translated_address = ((l2_entry -> physical_page_number << PAGE_SIZE_BITS) | virtual_page_offset) & DRAM_ADDRESS_MASK;
+    pa_dram_t translated_address = get_entry_address(l2_entry, virtual_address);
+    event_emit(EVENT_TLB_HIT, op, 2, virtual_page_number, translated_address >> PAGE_SIZE_BITS);
     log_dbg("Cache L2 found (VA=%" PRIx64 " VPN=%" PRIx64 " PA=%" PRIx64 ")",
             virtual_address, virtual_page_number, translated_address);
 
     *success = true;
     *is_dirty = l2_entry -> dirty;
+    *is_huge = l2_entry -> huge;
     return translated_address;
   }
 
-  // Search for empty entry and LRU
-  for (size_t i = 0; i < TLB_L2_SIZE; i++)
-  {
-    // Get empty entry
-    if (!tlb_l2[i].valid) {
-      *tlb_l2_empty_entry = &tlb_l2[i];
-      break;
-    }
-    
-    // Get oldest access entry
-    else if (!*tlb_l2_LRU_entry || tlb_l2[i].last_access < (*tlb_l2_LRU_entry) -> last_access) {
-      *tlb_l2_LRU_entry = &tlb_l2[i];
-    }
-  }
+  *tlb_l2_victim_entry = get_victim_entry(&tlb_core -> l2_level, virtual_page_number);
+  event_emit(EVENT_TLB_MISS, op, 2, virtual_page_number, 0);
 
-  tlb_l2_misses++;
+  tlb_core -> l2_misses++;
+  tlb_core -> asid_stats[tlb_core -> asid].l2_misses++;
   *success = false;
   return 0;
 }
@@ -382,6 +1366,7 @@ pa_dram_t search_tlb_l2(va_t virtual_address, va_t virtual_page_number, va_t vir
  *   - Returns the physical address
  *
  * If the operation is a write, the dirty bit is set in the corresponding entry.
+ * Huge pages are cached with a single entry, in the huge page arrays.
  *
  * @param virtual_address Virtual address to translate
  * @param op Operation type (Read or Write)
@@ -393,47 +1378,335 @@ pa_dram_t tlb_translate(va_t virtual_address, op_t op) {
   pa_dram_t physical_page_number;
 
   virtual_address &= VIRTUAL_ADDRESS_MASK;
-  va_t virtual_page_offset = virtual_address & PAGE_OFFSET_MASK;
-  va_t virtual_page_number = (virtual_address >> PAGE_SIZE_BITS) & PAGE_INDEX_MASK;
+  va_t virtual_page_number = page_key(tlb_core -> asid, (virtual_address >> PAGE_SIZE_BITS) & PAGE_INDEX_MASK);
+  va_t huge_page_number = virtual_page_number >> HUGE_PAGE_ORDER;
   bool success = false;
   bool is_dirty = (op == OP_WRITE);
+  bool is_huge = false;
 
   // Check in Cache L1
 
-  uint64_t tlb_l1_n_access = tlb_l1_hits + tlb_l1_misses + 1;
-  tlb_entry_t* tlb_l1_empty_entry = NULL;
-  tlb_entry_t* tlb_l1_LRU_entry = NULL;
+  tlb_entry_t* tlb_l1_victim_entry = NULL;
 
-  physical_add = search_tlb_l1(virtual_address, virtual_page_number, virtual_page_offset, 
-    op, tlb_l1_n_access, &tlb_l1_empty_entry, &tlb_l1_LRU_entry, &success);
+  physical_add = search_tlb_l1(virtual_address, virtual_page_number,
+    op, &tlb_l1_victim_entry, &success);
 
   if (success)
     return physical_add;
 
   // Check in Cache L2
 
-  uint64_t tlb_l2_n_access = tlb_l2_hits + tlb_l2_misses + 1;
-  tlb_entry_t* tlb_l2_empty_entry = NULL;
-  tlb_entry_t* tlb_l2_LRU_entry = NULL;
+  tlb_entry_t* tlb_l2_victim_entry = NULL;
 
-  physical_add = search_tlb_l2(virtual_address, virtual_page_number, virtual_page_offset, 
-    op, tlb_l2_n_access, &tlb_l2_empty_entry, &tlb_l2_LRU_entry, &success, &is_dirty);
+  physical_add = search_tlb_l2(virtual_address, virtual_page_number,
+    op, &tlb_l2_victim_entry, &success, &is_dirty, &is_huge);
 
   if (success) {
     // If there is a hit on L2 but a miss on L1, we add the entry to L1
-    physical_page_number = (physical_add >> PAGE_SIZE_BITS) & PHYSICAL_PAGE_NUMBER_MASK;
-    add_entry_to_tlb(true, tlb_l1_empty_entry, tlb_l1_LRU_entry, virtual_page_number, physical_page_number, tlb_l1_n_access, is_dirty);
+    if (is_huge) {
+      physical_page_number = ((physical_add & ~HUGE_PAGE_OFFSET_MASK) >> PAGE_SIZE_BITS) & PHYSICAL_PAGE_NUMBER_MASK;
+      add_entry_to_tlb(true, get_victim_entry(tlb_core -> l1_huge, huge_page_number), huge_page_number, physical_page_number,
+                       is_dirty, true);
+    }
+    else {
+      physical_page_number = (physical_add >> PAGE_SIZE_BITS) & PHYSICAL_PAGE_NUMBER_MASK;
+      add_entry_to_tlb(true, tlb_l1_victim_entry, virtual_page_number, physical_page_number, is_dirty, false);
+    }
 
     return physical_add;
   }
 
-  // Search in Page Table and add to both caches
+  // A prefetched translation in the prefetch buffer replaces the walk
+  tlb_entry_t* prefetched = NULL;
+  if (tlb_prefetch_buffer_enabled())
+    prefetched = get_entry(&tlb_core -> prefetch_level, virtual_page_number, false);
+
+  if (prefetched) {
+    physical_page_number = prefetched -> physical_page_number;
+    use_prefetched_entry(prefetched);
+    clear_tlb_entry(&tlb_core -> prefetch_level, prefetched);
+    page_table_use_prefetch(virtual_address, op);
+
+    add_entry_to_tlb(false, tlb_l2_victim_entry, virtual_page_number, physical_page_number, is_dirty, false);
+    add_entry_to_tlb(true, tlb_l1_victim_entry, virtual_page_number, physical_page_number, is_dirty, false);
+    prefetch_tlb_entries(virtual_page_number, false);
+
+    return ((physical_page_number << PAGE_SIZE_BITS) | (virtual_address & PAGE_OFFSET_MASK)) & DRAM_ADDRESS_MASK;
+  }
+
+  // Search in Page Table and add to both caches.
+  // The victims were picked before the walk: if the walk evicts a page, the
+  // invalidated slots are only reused by later insertions. Huge pages are
+  // only known after the walk, so their victims are picked then.
+  // Prefetches are issued last, so that they cannot take those slots.
+  // In overlap mode the miss completes later, in the background: the new
+  // entries are only usable from then on.
 
+  clock_begin_miss();
   physical_add = page_table_translate(virtual_address, op) & DRAM_ADDRESS_MASK;
-  physical_page_number = (physical_add >> PAGE_SIZE_BITS) & PHYSICAL_PAGE_NUMBER_MASK;
+  bool huge = page_table_is_huge(virtual_address);
+
+  time_cause_t ready_cause;
+  time_ns_t ready_ns = clock_end_miss(&ready_cause);
+
+  if (tlb_prefetch_config.policy != TLB_PREFETCH_NONE)
+    tlb_core -> prefetch.demand_walks++;
+
+  if (huge) {
+    physical_page_number = ((physical_add & ~HUGE_PAGE_OFFSET_MASK) >> PAGE_SIZE_BITS) & PHYSICAL_PAGE_NUMBER_MASK;
+    tlb_l2_victim_entry = get_victim_entry(tlb_core -> l2_huge, huge_page_number);
+    add_entry_to_tlb(false, tlb_l2_victim_entry, huge_page_number, physical_page_number, is_dirty, true);
+    set_tlb_entry_ready(tlb_l2_victim_entry, ready_ns, ready_cause);
+
+    tlb_l1_victim_entry = get_victim_entry(tlb_core -> l1_huge, huge_page_number);
+    add_entry_to_tlb(true, tlb_l1_victim_entry, huge_page_number, physical_page_number, is_dirty, true);
+    set_tlb_entry_ready(tlb_l1_victim_entry, ready_ns, ready_cause);
+  }
+  else {
+    physical_page_number = (physical_add >> PAGE_SIZE_BITS) & PHYSICAL_PAGE_NUMBER_MASK;
+
+    add_entry_to_tlb(false, tlb_l2_victim_entry, virtual_page_number, physical_page_number, is_dirty, false);
+    set_tlb_entry_ready(tlb_l2_victim_entry, ready_ns, ready_cause);
+    add_entry_to_tlb(true, tlb_l1_victim_entry, virtual_page_number, physical_page_number, is_dirty, false);
+    set_tlb_entry_ready(tlb_l1_victim_entry, ready_ns, ready_cause);
+  }
 
-  add_entry_to_tlb(false, tlb_l2_empty_entry, tlb_l2_LRU_entry, virtual_page_number, physical_page_number, tlb_l2_n_access, is_dirty);
-  add_entry_to_tlb(true, tlb_l1_empty_entry, tlb_l1_LRU_entry, virtual_page_number, physical_page_number, tlb_l1_n_access, is_dirty);
+  if (tlb_prefetch_config.policy != TLB_PREFETCH_NONE)
+    prefetch_tlb_entries(virtual_page_number, false);
 
   return physical_add;
 }
+
+
+/**
+ * @brief Translates a virtual address for tlb_warm().
+ *
+ * @param virtual_address Virtual address to translate (masked)
+ * @param op Operation type (Read or Write)
+ * @return Translated physical address
+ */
+static pa_dram_t warm_translation(va_t virtual_address, op_t op) {
+  va_t virtual_page_number = page_key(tlb_core -> asid, (virtual_address >> PAGE_SIZE_BITS) & PAGE_INDEX_MASK);
+  va_t huge_page_number = virtual_page_number >> HUGE_PAGE_ORDER;
+  pa_dram_t physical_page_number;
+
+  tlb_entry_t* entry = lookup_tlb_entry(true, virtual_page_number);
+  if (entry) {
+    touch_tlb_entry(get_level(true, entry -> huge), entry);
+    if (op == OP_WRITE)
+      entry -> dirty = true;
+    return get_entry_address(entry, virtual_address);
+  }
+  tlb_entry_t* tlb_l1_victim_entry = get_victim_entry(&tlb_core -> l1_level, virtual_page_number);
+
+  entry = lookup_tlb_entry(false, virtual_page_number);
+  if (entry) {
+    touch_tlb_entry(get_level(false, entry -> huge), entry);
+    if (entry -> prefetched) {
+      entry -> prefetched = false;
+      page_table_use_prefetch(virtual_address, op);
+    }
+    if (op == OP_WRITE)
+      entry -> dirty = true;
+
+    pa_dram_t physical_add = get_entry_address(entry, virtual_address);
+    if (entry -> huge) {
+      physical_page_number = ((physical_add & ~HUGE_PAGE_OFFSET_MASK) >> PAGE_SIZE_BITS) & PHYSICAL_PAGE_NUMBER_MASK;
+      add_entry_to_tlb(true, get_victim_entry(tlb_core -> l1_huge, huge_page_number), huge_page_number, physical_page_number,
+                       entry -> dirty, true);
+    }
+    else {
+      physical_page_number = (physical_add >> PAGE_SIZE_BITS) & PHYSICAL_PAGE_NUMBER_MASK;
+      add_entry_to_tlb(true, tlb_l1_victim_entry, virtual_page_number, physical_page_number, entry -> dirty, false);
+    }
+    return physical_add;
+  }
+  tlb_entry_t* tlb_l2_victim_entry = get_victim_entry(&tlb_core -> l2_level, virtual_page_number);
+  bool is_dirty = (op == OP_WRITE);
+
+  tlb_entry_t* prefetched = NULL;
+  if (tlb_prefetch_buffer_enabled())
+    prefetched = get_entry(&tlb_core -> prefetch_level, virtual_page_number, false);
+
+  if (prefetched) {
+    physical_page_number = prefetched -> physical_page_number;
+    clear_tlb_entry(&tlb_core -> prefetch_level, prefetched);
+    page_table_use_prefetch(virtual_address, op);
+
+    add_entry_to_tlb(false, tlb_l2_victim_entry, virtual_page_number, physical_page_number, is_dirty, false);
+    add_entry_to_tlb(true, tlb_l1_victim_entry, virtual_page_number, physical_page_number, is_dirty, false);
+    prefetch_tlb_entries(virtual_page_number, true);
+
+    return ((physical_page_number << PAGE_SIZE_BITS) | (virtual_address & PAGE_OFFSET_MASK)) & DRAM_ADDRESS_MASK;
+  }
+
+  pa_dram_t physical_add = page_table_warm(virtual_address, op) & DRAM_ADDRESS_MASK;
+
+  if (page_table_is_huge(virtual_address)) {
+    physical_page_number = ((physical_add & ~HUGE_PAGE_OFFSET_MASK) >> PAGE_SIZE_BITS) & PHYSICAL_PAGE_NUMBER_MASK;
+    add_entry_to_tlb(false, get_victim_entry(tlb_core -> l2_huge, huge_page_number), huge_page_number, physical_page_number,
+                     is_dirty, true);
+    add_entry_to_tlb(true, get_victim_entry(tlb_core -> l1_huge, huge_page_number), huge_page_number, physical_page_number,
+                     is_dirty, true);
+  }
+  else {
+    physical_page_number = (physical_add >> PAGE_SIZE_BITS) & PHYSICAL_PAGE_NUMBER_MASK;
+    add_entry_to_tlb(false, tlb_l2_victim_entry, virtual_page_number, physical_page_number, is_dirty, false);
+    add_entry_to_tlb(true, tlb_l1_victim_entry, virtual_page_number, physical_page_number, is_dirty, false);
+  }
+
+  if (tlb_prefetch_config.policy != TLB_PREFETCH_NONE)
+    prefetch_tlb_entries(virtual_page_number, true);
+
+  return physical_add;
+}
+
+
+/**
+ * @brief Computes the slot of a page in the table of batched warming
+ * references.
+ *
+ * @param virtual_page_number VPN of the page
+ * @return Slot of the page
+ */
+static inline tlb_warm_slot_t* get_warm_slot(va_t virtual_page_number) {
+  return &tlb_warm_slots[(virtual_page_number * 0x9e3779b97f4a7c15llu) >> (64 - TLB_WARM_SLOT_BITS)];
+}
+
+
+/**
+ * @brief Makes the same changes to the TLBs as tlb_translate(), for functional
+ * warming (see sample.h): same entries touched, filled, evicted and dirtied,
+ * same victims and prefetches, but no time, statistics or events.
+ *
+ * Misses go through page_table_warm(), so page faults are still handled, and
+ * only cost nothing while the clock is frozen. The L1 entry that holds the
+ * page afterwards is remembered, so that the next references to the page can
+ * be batched by tlb_warm_hit().
+ *
+ * @param virtual_address Virtual address to translate
+ * @param op Operation type (Read or Write)
+ * @return Translated physical address
+ */
+pa_dram_t tlb_warm(va_t virtual_address, op_t op) {
+  virtual_address &= VIRTUAL_ADDRESS_MASK;
+  pa_dram_t physical_address = warm_translation(virtual_address, op);
+
+  va_t virtual_page_number = page_key(tlb_core -> asid, (virtual_address >> PAGE_SIZE_BITS) & PAGE_INDEX_MASK);
+  tlb_entry_t* entry = lookup_tlb_entry(true, virtual_page_number);
+  tlb_warm_slot_t* slot = get_warm_slot(virtual_page_number);
+
+  // A pending slot keeps its page until the next flush
+  if (entry && !slot -> references) {
+    slot -> core = tlb_core;
+    slot -> virtual_page_number = virtual_page_number;
+    slot -> virtual_address = virtual_address & ~PAGE_OFFSET_MASK;
+    slot -> entry = entry;
+    slot -> entry_page_number = entry -> virtual_page_number;
+    slot -> entry_huge = entry -> huge;
+  }
+
+  return physical_address;
+}
+
+
+/**
+ * @brief Batches a functional warming reference that hits the L1 TLB.
+ *
+ * Only pages whose L1 entry is known from their last tlb_warm() are batched:
+ * the reference is counted, and dirties the entry, but the entry is not moved
+ * in its recency list until tlb_warm_flush().
+ *
+ * @param virtual_address Virtual address referenced
+ * @param op Operation type (Read or Write)
+ * @return True if batched, False if tlb_warm() is needed
+ */
+bool tlb_warm_hit(va_t virtual_address, op_t op) {
+  virtual_address &= VIRTUAL_ADDRESS_MASK;
+  va_t virtual_page_number = page_key(tlb_core -> asid, (virtual_address >> PAGE_SIZE_BITS) & PAGE_INDEX_MASK);
+  tlb_warm_slot_t* slot = get_warm_slot(virtual_page_number);
+  tlb_entry_t* entry = slot -> entry;
+
+  if (slot -> virtual_page_number != virtual_page_number || slot -> core != tlb_core || !entry ||
+      !entry -> valid || entry -> virtual_page_number != slot -> entry_page_number ||
+      entry -> huge != slot -> entry_huge)
+    return false;
+
+  if (!slot -> references++)
+    tlb_warm_pending[tlb_warm_pending_count++] = (uint32_t)(slot - tlb_warm_slots);
+  slot -> last_use = ++tlb_warm_clock;
+
+  if (op == OP_WRITE)
+    entry -> dirty = true;
+
+  return true;
+}
+
+
+/**
+ * @brief Makes the changes of the references batched by tlb_warm_hit().
+ *
+ * Every batched page moves to the front of its recency list once, in the
+ * order of its last reference, which leaves LRU lists as the references one
+ * by one would have; FIFO and random levels do not move on hits. Their
+ * references reach the page table through page_table_warm_references().
+ */
+void tlb_warm_flush() {
+  // Few pages are batched between two flushes: insertion sort by last use
+  for (unsigned i = 1; i < tlb_warm_pending_count; i++) {
+    uint32_t pending = tlb_warm_pending[i];
+    uint64_t last_use = tlb_warm_slots[pending].last_use;
+    unsigned j = i;
+
+    for (; j > 0 && tlb_warm_slots[tlb_warm_pending[j - 1]].last_use > last_use; j--)
+      tlb_warm_pending[j] = tlb_warm_pending[j - 1];
+    tlb_warm_pending[j] = pending;
+  }
+
+  for (unsigned i = 0; i < tlb_warm_pending_count; i++) {
+    tlb_warm_slot_t* slot = &tlb_warm_slots[tlb_warm_pending[i]];
+    tlb_level_t* level = slot -> entry_huge ? slot -> core -> l1_huge : &slot -> core -> l1_level;
+
+    touch_tlb_entry(level, slot -> entry);
+    page_table_warm_references(slot -> virtual_address, slot -> references);
+    slot -> references = 0;
+  }
+
+  tlb_warm_pending_count = 0;
+}
+
+
+/**
+ * @brief Translates a virtual address if the TLBs of the current core can do
+ * it on their own, i.e. on an L1 or L2 hit.
+ *
+ * Misses (and prefetched entries) need the shared page table, and random victims the shared rand()
+ * state: in both cases nothing is changed and false is returned. Otherwise
+ * the translation only touches the current core, so one host thread per core
+ * can call this concurrently.
+ *
+ * @param virtual_address Virtual address to translate
+ * @param op Operation type (Read or Write)
+ * @param physical_address Output translated physical address
+ * @return True if translated, False if tlb_translate() is needed
+ */
+bool tlb_translate_local(va_t virtual_address, op_t op, pa_dram_t* physical_address) {
+  virtual_address &= VIRTUAL_ADDRESS_MASK;
+  va_t virtual_page_number = page_key(tlb_core -> asid, (virtual_address >> PAGE_SIZE_BITS) & PAGE_INDEX_MASK);
+
+  if (!lookup_tlb_entry(true, virtual_page_number)) {
+    tlb_entry_t* l2_entry = lookup_tlb_entry(false, virtual_page_number);
+
+    // The first use of a prefetched entry updates the shared page table
+    if (!l2_entry || l2_entry -> prefetched)
+      return false;
+
+    // The L1 fill may pick random victims in L1 and L2
+    if (tlb_core -> l1_level.replacement == TLB_REPLACEMENT_RANDOM ||
+        tlb_core -> l2_level.replacement == TLB_REPLACEMENT_RANDOM)
+      return false;
+  }
+
+  *physical_address = tlb_translate(virtual_address, op);
+  return true;
+}
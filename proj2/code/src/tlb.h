@@ -1,19 +1,146 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "checkpoint.h"
+#include "clock.h"
+#include "constants.h"
 #include "memory.h"
+#include "tlb_prefetch.h"
 
-void tlb_init();
+// Replacement policy used inside each set of a TLB level.
+typedef enum { TLB_REPLACEMENT_LRU, TLB_REPLACEMENT_FIFO, TLB_REPLACEMENT_RANDOM } tlb_replacement_t;
+
+// Where huge page translations are cached.
+// separate: each level has a huge page array of its own (huge_entries,
+//           huge_ways), looked up in parallel with the base page one.
+// unified: huge page entries share the base page array of each level, which
+//          is probed for both page sizes.
+typedef enum { TLB_HUGE_SEPARATE, TLB_HUGE_UNIFIED } tlb_huge_t;
+
+// What a context switch (see tlb_select_asid()) does to the TLBs of a core.
+// tagged: entries are tagged with their ASID, like x86 PCIDs, and are kept.
+// flush: every entry is flushed, like a CR3 write without PCIDs.
+typedef enum { TLB_ASID_TAGGED, TLB_ASID_FLUSH } tlb_asid_mode_t;
+
+// Geometry of one TLB level.
+// Entries are split in (entries / ways) sets, indexed by the low bits of the
+// virtual page number. ways == 1 is direct-mapped, ways == entries (or 0) is
+// fully associative. The huge page array, when separate, is indexed the same
+// way by the huge page number.
+typedef struct {
+  uint64_t entries;
+  uint64_t ways;
+  time_ns_t latency_ns;
+  tlb_replacement_t replacement;
+  uint64_t huge_entries;
+  uint64_t huge_ways;
+} tlb_level_config_t;
+
+// Every core has private TLBs with the same geometry. Invalidating a page
+// that other cores may cache costs a shootdown: shootdown_latency_ns on the
+// core that invalidates, shootdown_handler_ns on every other core involved.
+typedef struct {
+  tlb_level_config_t l1;
+  tlb_level_config_t l2;
+  tlb_huge_t huge;
+  tlb_asid_mode_t asid_mode;
+  tlb_prefetch_config_t prefetch;
+  unsigned cores;
+  time_ns_t shootdown_latency_ns;
+  time_ns_t shootdown_handler_ns;
+} tlb_config_t;
+
+typedef struct {
+  // Shootdowns started by the core, and received from other cores.
+  uint64_t sent;
+  uint64_t received;
+
+  // Time the core spent waiting for, or handling, shootdowns.
+  time_ns_t time_ns;
+} tlb_shootdown_stats_t;
+
+typedef struct {
+  uint64_t l1_hits;
+  uint64_t l1_misses;
+  uint64_t l2_hits;
+  uint64_t l2_misses;
+} tlb_asid_stats_t;
+
+#define TLB_DEFAULT_CONFIG                                      \
+  ((tlb_config_t){                                              \
+      .l1 = {TLB_L1_SIZE, 0, TLB_L1_LATENCY_NS,                 \
+             TLB_REPLACEMENT_LRU, TLB_L1_HUGE_SIZE, 0},         \
+      .l2 = {TLB_L2_SIZE, 0, TLB_L2_LATENCY_NS,                 \
+             TLB_REPLACEMENT_LRU, TLB_L2_HUGE_SIZE, 0},         \
+      .huge = TLB_HUGE_SEPARATE,                                \
+      .asid_mode = TLB_ASID_TAGGED,                             \
+      .prefetch = TLB_PREFETCH_DEFAULT_CONFIG,                  \
+      .cores = 1,                                               \
+      .shootdown_latency_ns = TLB_SHOOTDOWN_LATENCY_NS,         \
+      .shootdown_handler_ns = TLB_SHOOTDOWN_HANDLER_NS,         \
+  })
+
+const char* tlb_replacement_name(tlb_replacement_t replacement);
+const char* tlb_huge_name(tlb_huge_t huge);
+const char* tlb_asid_mode_name(tlb_asid_mode_t asid_mode);
+
+// (Re)allocates both TLB levels of every core with the given geometry,
+// invalidates every entry and resets statistics. Core 0 becomes current.
+void tlb_init(const tlb_config_t* config);
+
+// Saves or restores the TLBs and statistics of every core. Restoring needs
+// tlb_init() with the same configuration first.
+void tlb_checkpoint(checkpoint_t* checkpoint);
+
+// Makes a core current: tlb_translate() and tlb_invalidate() use its TLBs.
+// Panics if there is no such core.
+void tlb_select_core(unsigned core);
+
+// Switches the current core to another address space, if it is not already
+// running it. Every core starts in ASID 0. Panics if the ASID is too large.
+void tlb_select_asid(unsigned asid);
+unsigned get_current_asid();
 
 // TLB translation function.
 // Can also update the content of the TLB.
 pa_dram_t tlb_translate(va_t virtual_address, op_t op);
 
+// Same changes to the TLBs as tlb_translate(), without time, statistics or
+// events, for functional warming.
+pa_dram_t tlb_warm(va_t virtual_address, op_t op);
+
+// Functional warming of a reference that hits the L1 TLB of the current core,
+// in a batch: the entry is dirtied at once, but moved in its recency list, and
+// the page table told of the reference, only by tlb_warm_flush(). Returns
+// false, without side effects, unless tlb_warm() found the page in the L1 TLB
+// last time and it is still there; tlb_warm() is then needed.
+//
+// The batch must be flushed before any other TLB or page table operation, and
+// before another core or ASID is selected.
+bool tlb_warm_hit(va_t virtual_address, op_t op);
+void tlb_warm_flush();
+
+// Same as tlb_translate(), but only if the TLBs of the current core hit
+// without touching shared state. Returns false, without side effects,
+// otherwise. Cores may be translated concurrently, one host thread each.
+bool tlb_translate_local(va_t virtual_address, op_t op,
+                         pa_dram_t* physical_address);
+
 // Invalidate entries on the TLB.
 // This can happen if a page is swapped out of memory and into the disk.
 void tlb_invalidate(va_t virtual_page_number);
 
+// Invalidates the huge page entries of a huge page number (a virtual page
+// number shifted right by HUGE_PAGE_ORDER), when it is split.
+void tlb_invalidate_huge(va_t huge_page_number);
+
+// Same as tlb_invalidate() and tlb_invalidate_huge(), plus a shootdown of the
+// entries of the other cores of the `cores` bit mask.
+void tlb_shootdown(va_t virtual_page_number, uint64_t cores);
+void tlb_shootdown_huge(va_t huge_page_number, uint64_t cores);
+
 uint64_t get_total_tlb_l1_hits();
 uint64_t get_total_tlb_l1_misses();
 uint64_t get_total_tlb_l1_invalidations();
@@ -21,3 +148,21 @@ uint64_t get_total_tlb_l1_invalidations();
 uint64_t get_total_tlb_l2_hits();
 uint64_t get_total_tlb_l2_misses();
 uint64_t get_total_tlb_l2_invalidations();
+
+// Hits on huge page entries, included in the totals above.
+uint64_t get_total_tlb_l1_huge_hits();
+uint64_t get_total_tlb_l2_huge_hits();
+
+// Statistics of a single core. The totals above add up every core.
+void get_core_tlb_hits(unsigned core, uint64_t* l1_hits, uint64_t* l1_misses,
+                       uint64_t* l2_hits, uint64_t* l2_misses);
+const tlb_shootdown_stats_t* get_tlb_shootdown_stats(unsigned core);
+time_ns_t get_tlb_shootdown_latency();
+
+// Lookups of one address space, on every core.
+tlb_asid_stats_t get_asid_tlb_stats(unsigned asid);
+uint64_t get_total_context_switches();
+uint64_t get_total_tlb_flushed_entries();
+
+// Prefetches of every core.
+tlb_prefetch_stats_t get_total_tlb_prefetch_stats();
@@ -0,0 +1,167 @@
+#include "tlb_prefetch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "page_table.h"
+
+const char* tlb_prefetch_policy_name(tlb_prefetch_policy_t policy) {
+  switch (policy) {
+    case TLB_PREFETCH_NONE:
+      return "none";
+    case TLB_PREFETCH_SEQUENTIAL:
+      return "sequential";
+    case TLB_PREFETCH_STRIDE:
+      return "stride";
+    case TLB_PREFETCH_DISTANCE:
+      return "distance";
+  }
+  return "?";
+}
+
+const char* tlb_prefetch_target_name(tlb_prefetch_target_t target) {
+  switch (target) {
+    case TLB_PREFETCH_BUFFER:
+      return "buffer";
+    case TLB_PREFETCH_L2:
+      return "l2";
+  }
+  return "?";
+}
+
+void tlb_prefetcher_init(tlb_prefetcher_t* prefetcher,
+                         const tlb_prefetch_config_t* config) {
+  free(prefetcher->table);
+  memset(prefetcher, 0, sizeof(*prefetcher));
+
+  if (config->policy == TLB_PREFETCH_NONE) {
+    return;
+  }
+  if (config->degree == 0 || config->degree > TLB_PREFETCH_MAX_DEGREE) {
+    panic("Invalid TLB prefetch degree: %" PRIu64 " (expected 1 to %d)",
+          config->degree, TLB_PREFETCH_MAX_DEGREE);
+  }
+  if (config->target == TLB_PREFETCH_BUFFER && config->buffer_entries == 0) {
+    panic("The TLB prefetch buffer needs at least one entry");
+  }
+
+  if (config->policy == TLB_PREFETCH_DISTANCE) {
+    if (config->table_entries == 0) {
+      panic("The distance prefetcher needs at least one table entry");
+    }
+    prefetcher->table =
+        calloc(config->table_entries, sizeof(tlb_prefetch_row_t));
+    if (!prefetcher->table) {
+      panic("Failed to allocate the TLB prefetch table");
+    }
+  }
+}
+
+void tlb_prefetcher_checkpoint(tlb_prefetcher_t* prefetcher,
+                               const tlb_prefetch_config_t* config,
+                               checkpoint_t* checkpoint) {
+  CHECKPOINT_VALUE(checkpoint, prefetcher->has_last);
+  CHECKPOINT_VALUE(checkpoint, prefetcher->last_page);
+  CHECKPOINT_VALUE(checkpoint, prefetcher->has_stride);
+  CHECKPOINT_VALUE(checkpoint, prefetcher->last_stride);
+  if (prefetcher->table) {
+    checkpoint_data(checkpoint, prefetcher->table,
+                    config->table_entries * sizeof(tlb_prefetch_row_t));
+  }
+}
+
+// Row of a distance, direct-mapped.
+static inline tlb_prefetch_row_t* get_row(tlb_prefetcher_t* prefetcher,
+                                          const tlb_prefetch_config_t* config,
+                                          va_t distance) {
+  return &prefetcher->table[(distance * 0x9e3779b97f4a7c15llu) %
+                            config->table_entries];
+}
+
+// Remembers that `next` followed `distance`, the newest distance first.
+void record_distance(tlb_prefetcher_t* prefetcher,
+                     const tlb_prefetch_config_t* config, va_t distance,
+                     va_t next) {
+  tlb_prefetch_row_t* row = get_row(prefetcher, config, distance);
+  if (!row->valid || row->distance != distance) {
+    row->valid = true;
+    row->distance = distance;
+    row->n_next = 0;
+  }
+
+  unsigned slot = 0;
+  while (slot < row->n_next && row->next[slot] != next) {
+    slot++;
+  }
+  if (slot == row->n_next && row->n_next < TLB_PREFETCH_DISTANCE_SLOTS) {
+    row->n_next++;
+  }
+  if (slot == TLB_PREFETCH_DISTANCE_SLOTS) {
+    slot--;
+  }
+  memmove(&row->next[1], &row->next[0], slot * sizeof(va_t));
+  row->next[0] = next;
+}
+
+// Adds page + delta to the predictions if it stays in the address space.
+static inline unsigned add_prediction(va_t page, va_t delta, va_t* pages,
+                                      unsigned count) {
+  va_t virtual_page_number = (page & PAGE_INDEX_MASK) + delta;
+  if (delta == 0 || virtual_page_number >= TOTAL_PAGES) {
+    return count;
+  }
+  pages[count] = page_key(page_key_asid(page), virtual_page_number);
+  return count + 1;
+}
+
+unsigned tlb_prefetcher_predict(tlb_prefetcher_t* prefetcher,
+                                const tlb_prefetch_config_t* config, va_t page,
+                                va_t* pages) {
+  unsigned count = 0;
+  bool has_distance = prefetcher->has_last &&
+                      page_key_asid(prefetcher->last_page) ==
+                          page_key_asid(page);
+  va_t distance = page - prefetcher->last_page;
+
+  switch (config->policy) {
+    case TLB_PREFETCH_NONE:
+      break;
+
+    case TLB_PREFETCH_SEQUENTIAL:
+      for (uint64_t i = 1; i <= config->degree; i++) {
+        count = add_prediction(page, i, pages, count);
+      }
+      break;
+
+    case TLB_PREFETCH_STRIDE:
+      if (has_distance && prefetcher->has_stride &&
+          distance == prefetcher->last_stride) {
+        for (uint64_t i = 1; i <= config->degree; i++) {
+          count = add_prediction(page, distance * i, pages, count);
+        }
+      }
+      break;
+
+    case TLB_PREFETCH_DISTANCE:
+      if (has_distance) {
+        if (prefetcher->has_stride) {
+          record_distance(prefetcher, config, prefetcher->last_stride,
+                          distance);
+        }
+        tlb_prefetch_row_t* row = get_row(prefetcher, config, distance);
+        if (row->valid && row->distance == distance) {
+          for (unsigned slot = 0; slot < row->n_next; slot++) {
+            count = add_prediction(page, row->next[slot], pages, count);
+          }
+        }
+      }
+      break;
+  }
+
+  prefetcher->has_stride = has_distance;
+  prefetcher->last_stride = distance;
+  prefetcher->has_last = true;
+  prefetcher->last_page = page;
+  return count;
+}
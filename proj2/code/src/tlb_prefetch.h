@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "checkpoint.h"
+#include "clock.h"
+#include "constants.h"
+#include "memory.h"
+
+// TLB prefetchers, trained on the L2 TLB misses of a core. Each miss predicts
+// pages whose translations are fetched in the background (the walk is not
+// charged to the core) if they are resident, into a prefetch buffer looked up
+// on L2 misses, or directly into the L2 TLB.
+// none: no prefetching.
+// sequential: the next `degree` pages.
+// stride: `degree` pages ahead once two consecutive misses have the same
+//         stride.
+// distance: a table of `table_entries` rows, indexed by the distance between
+//           the last two misses, remembers the distances that followed it
+//           (Markov prediction on distances, as in Kandiraju and
+//           Sivasubramaniam's distance prefetching).
+typedef enum {
+  TLB_PREFETCH_NONE,
+  TLB_PREFETCH_SEQUENTIAL,
+  TLB_PREFETCH_STRIDE,
+  TLB_PREFETCH_DISTANCE,
+} tlb_prefetch_policy_t;
+
+typedef enum { TLB_PREFETCH_BUFFER, TLB_PREFETCH_L2 } tlb_prefetch_target_t;
+
+typedef struct {
+  tlb_prefetch_policy_t policy;
+  tlb_prefetch_target_t target;
+  uint64_t buffer_entries;
+  uint64_t degree;
+  uint64_t table_entries;
+} tlb_prefetch_config_t;
+
+#define TLB_PREFETCH_DEFAULT_CONFIG \
+  ((tlb_prefetch_config_t){TLB_PREFETCH_NONE, TLB_PREFETCH_BUFFER, 16, 2, 64})
+
+// Distances remembered per row of the distance table.
+#define TLB_PREFETCH_DISTANCE_SLOTS 2
+
+// Largest number of pages predicted by one miss.
+#define TLB_PREFETCH_MAX_DEGREE 16
+
+typedef struct {
+  va_t distance;
+  bool valid;
+  va_t next[TLB_PREFETCH_DISTANCE_SLOTS];
+  unsigned n_next;
+} tlb_prefetch_row_t;
+
+// Training state of one core.
+typedef struct {
+  bool has_last;
+  va_t last_page;
+  bool has_stride;
+  va_t last_stride;
+  tlb_prefetch_row_t* table;
+} tlb_prefetcher_t;
+
+typedef struct {
+  // Translations fetched, and those a demand access then used.
+  uint64_t issued;
+  uint64_t useful;
+
+  // Useful prefetches whose walk was not over when the access came.
+  uint64_t late;
+
+  // Page walks of demand accesses, i.e. misses not covered.
+  uint64_t demand_walks;
+
+  // Walk time avoided by useful prefetches, minus the time spent waiting for
+  // late ones.
+  time_ns_t saved_ns;
+} tlb_prefetch_stats_t;
+
+const char* tlb_prefetch_policy_name(tlb_prefetch_policy_t policy);
+const char* tlb_prefetch_target_name(tlb_prefetch_target_t target);
+
+// (Re)initializes the training state of a core. Panics on an invalid
+// configuration.
+void tlb_prefetcher_init(tlb_prefetcher_t* prefetcher,
+                         const tlb_prefetch_config_t* config);
+void tlb_prefetcher_checkpoint(tlb_prefetcher_t* prefetcher,
+                               const tlb_prefetch_config_t* config,
+                               checkpoint_t* checkpoint);
+
+// Trains on a miss of `page` (a page key) and writes the predicted page keys,
+// in the same address space, to `pages`. Returns their number, at most
+// TLB_PREFETCH_MAX_DEGREE.
+unsigned tlb_prefetcher_predict(tlb_prefetcher_t* prefetcher,
+                                const tlb_prefetch_config_t* config, va_t page,
+                                va_t* pages);
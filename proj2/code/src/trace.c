@@ -0,0 +1,461 @@
+#include "trace.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "log.h"
+
+// Header of binary instructions files.
+#define TRACE_HEADER_SIZE (TRACE_MAGIC_SIZE + sizeof(uint64_t))
+
+// Seek index entry: the state of the decoder before a record.
+typedef struct {
+  uint64_t offset;
+  uint64_t address;
+  uint32_t core;
+  uint32_t asid;
+} trace_index_entry_t;
+
+// Footer of the seek index: the number of entries, then TRACE_INDEX_MAGIC.
+#define TRACE_FOOTER_SIZE (sizeof(uint64_t) + TRACE_MAGIC_SIZE)
+
+// Longest encoding of a record: 5 bits in the first byte, then 59 bits in
+// groups of 7, then a 32-bit core and a 32-bit ASID.
+#define TRACE_MAX_RECORD_SIZE (10 + 5 + 5)
+
+bool trace_parse_line(const char* line, trace_record_t* record,
+                      bool* is_switch) {
+  char instruction;
+  uint64_t address;
+  unsigned core = 0;
+  if (*line >= '0' && *line <= '9') {
+    if (sscanf(line, "%u %c %" SCNx64, &core, &instruction, &address) != 3) {
+      return false;
+    }
+  } else if (sscanf(line, "%c %" SCNx64, &instruction, &address) != 2) {
+    return false;
+  }
+
+  *is_switch = false;
+  switch (instruction) {
+    case 'R':
+      record->op = OP_READ;
+      break;
+    case 'W':
+      record->op = OP_WRITE;
+      break;
+    case 'C':
+      // The ASID is decimal, like a PCID.
+      if (sscanf(strchr(line, 'C') + 1, "%" SCNu64, &address) != 1 ||
+          address >= MAX_ASIDS) {
+        return false;
+      }
+      *is_switch = true;
+      record->asid = address;
+      break;
+    default:
+      return false;
+  }
+  record->address = address;
+  record->core = core;
+  return true;
+}
+
+static inline uint64_t zigzag_encode(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t zigzag_decode(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static inline size_t encode_varint(uint64_t value, uint8_t* out) {
+  size_t size = 0;
+  while (value >= 0x80) {
+    out[size++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  out[size++] = value;
+  return size;
+}
+
+// Encodes one record into `out`, returning the number of bytes used.
+size_t encode_record(const trace_record_t* record,
+                     const trace_record_t* previous, uint8_t* out) {
+  uint64_t delta =
+      zigzag_encode((int64_t)(record->address - previous->address));
+  bool context_change =
+      record->core != previous->core || record->asid != previous->asid;
+  size_t size = 0;
+
+  uint8_t byte = ((delta & 0x1f) << 2) | (context_change << 1) |
+                 (record->op == OP_WRITE);
+  delta >>= 5;
+  while (delta) {
+    out[size++] = byte | 0x80;
+    byte = delta & 0x7f;
+    delta >>= 7;
+  }
+  out[size++] = byte;
+
+  if (context_change) {
+    size += encode_varint(record->core, out + size);
+    size += encode_varint(record->asid, out + size);
+  }
+  return size;
+}
+
+static inline bool decode_varint(const uint8_t** cursor, const uint8_t* end,
+                                 uint64_t* value) {
+  *value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    if (*cursor == end) {
+      return false;
+    }
+    uint8_t byte = *(*cursor)++;
+    *value |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool decode_record(trace_reader_t* reader, trace_record_t* record) {
+  const uint8_t* cursor = reader->cursor;
+  const uint8_t* end = reader->data + reader->size;
+  if (cursor == end) {
+    return false;
+  }
+
+  uint8_t byte = *cursor++;
+  record->op = (byte & 1) ? OP_WRITE : OP_READ;
+  bool context_change = byte & 2;
+  uint64_t delta = (byte >> 2) & 0x1f;
+
+  for (unsigned shift = 5; byte & 0x80; shift += 7) {
+    if (cursor == end || shift >= 64) {
+      return false;
+    }
+    byte = *cursor++;
+    delta |= (uint64_t)(byte & 0x7f) << shift;
+  }
+
+  if (context_change) {
+    uint64_t core;
+    uint64_t asid;
+    if (!decode_varint(&cursor, end, &core) ||
+        !decode_varint(&cursor, end, &asid) || core >= MAX_CORES ||
+        asid >= MAX_ASIDS) {
+      return false;
+    }
+    reader->previous_core = core;
+    reader->previous_asid = asid;
+  }
+
+  record->address = reader->previous_address + zigzag_decode(delta);
+  record->core = reader->previous_core;
+  record->asid = reader->previous_asid;
+  reader->previous_address = record->address;
+  reader->cursor = cursor;
+  return true;
+}
+
+void trace_open(const char* path, trace_reader_t* reader) {
+  memset(reader, 0, sizeof(*reader));
+  reader->path = path;
+
+  if (strncmp(path, KERNEL_PREFIX, strlen(KERNEL_PREFIX)) == 0) {
+    kernel_config_t config;
+    kernel_parse(path + strlen(KERNEL_PREFIX), &config);
+    kernel_start(&reader->kernel, &config);
+    reader->is_kernel = true;
+    return;
+  }
+
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    panic("Failed to open instructions file %s", path);
+  }
+
+  char magic[TRACE_MAGIC_SIZE];
+  if (fread(magic, 1, TRACE_MAGIC_SIZE, file) != TRACE_MAGIC_SIZE ||
+      memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_SIZE) != 0) {
+    rewind(file);
+    reader->file = file;
+    return;
+  }
+
+  struct stat st;
+  if (fstat(fileno(file), &st) != 0 || (size_t)st.st_size < TRACE_HEADER_SIZE) {
+    panic("Truncated binary instructions file %s", path);
+  }
+
+  void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+  fclose(file);
+  if (data == MAP_FAILED) {
+    panic("Failed to map instructions file %s", path);
+  }
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+  reader->data = data;
+  reader->size = st.st_size;
+  reader->cursor = reader->data + TRACE_HEADER_SIZE;
+
+  // The header is little-endian, like the host.
+  memcpy(&reader->remaining, reader->data + TRACE_MAGIC_SIZE, sizeof(uint64_t));
+  reader->count = reader->remaining;
+
+  // Files without a seek index are only skipped by decoding.
+  const uint8_t* footer = reader->data + reader->size - TRACE_FOOTER_SIZE;
+  if (reader->size < TRACE_HEADER_SIZE + TRACE_FOOTER_SIZE ||
+      memcmp(footer + sizeof(uint64_t), TRACE_INDEX_MAGIC,
+             TRACE_MAGIC_SIZE) != 0) {
+    return;
+  }
+  uint64_t entries;
+  memcpy(&entries, footer, sizeof(entries));
+  size_t index_size = entries * sizeof(trace_index_entry_t);
+  if (entries > reader->count / TRACE_INDEX_INTERVAL ||
+      index_size > reader->size - TRACE_HEADER_SIZE - TRACE_FOOTER_SIZE) {
+    panic("Invalid seek index in instructions file %s", path);
+  }
+  reader->index = footer - index_size;
+  reader->index_entries = entries;
+}
+
+bool trace_next(trace_reader_t* reader, trace_record_t* record) {
+  if (reader->is_kernel) {
+    record->core = 0;
+    record->asid = 0;
+    return kernel_next(&reader->kernel, &record->op, &record->address);
+  }
+  if (reader->file) {
+    char line[256];
+    bool is_switch;
+    do {
+      if (!fgets(line, sizeof(line), reader->file)) {
+        return false;
+      }
+      if (!trace_parse_line(line, record, &is_switch) ||
+          record->core >= MAX_CORES) {
+        panic("Invalid instruction format: %s", line);
+      }
+      if (is_switch) {
+        reader->asids[record->core] = record->asid;
+      }
+    } while (is_switch);
+    record->asid = reader->asids[record->core];
+    return true;
+  }
+
+  if (reader->remaining == 0) {
+    return false;
+  }
+  if (!decode_record(reader, record)) {
+    panic("Truncated or invalid binary instructions file %s", reader->path);
+  }
+  reader->remaining--;
+  return true;
+}
+
+uint64_t trace_skip(trace_reader_t* reader, uint64_t count) {
+  if (reader->is_kernel) {
+    return kernel_skip(&reader->kernel, count);
+  }
+
+  uint64_t skipped = 0;
+  if (reader->file) {
+    trace_record_t record;
+    while (skipped < count && trace_next(reader, &record)) {
+      skipped++;
+    }
+    return skipped;
+  }
+
+  if (count > reader->remaining) {
+    count = reader->remaining;
+  }
+
+  // Jump to the last indexed record up to the target, if past the current
+  // one: entry i is the state before record (i + 1) * TRACE_INDEX_INTERVAL.
+  uint64_t position = reader->count - reader->remaining;
+  uint64_t entry = (position + count) / TRACE_INDEX_INTERVAL;
+  if (entry > reader->index_entries) {
+    entry = reader->index_entries;
+  }
+  if (entry && entry * TRACE_INDEX_INTERVAL > position) {
+    trace_index_entry_t state;
+    memcpy(&state, reader->index + (entry - 1) * sizeof(state),
+           sizeof(state));
+    if (state.offset < TRACE_HEADER_SIZE || state.offset >= reader->size ||
+        state.core >= MAX_CORES || state.asid >= MAX_ASIDS) {
+      panic("Invalid seek index in instructions file %s", reader->path);
+    }
+    skipped = entry * TRACE_INDEX_INTERVAL - position;
+    reader->cursor = reader->data + state.offset;
+    reader->previous_address = state.address;
+    reader->previous_core = state.core;
+    reader->previous_asid = state.asid;
+    reader->remaining -= skipped;
+  }
+
+  // Only the address deltas and context changes matter.
+  const uint8_t* cursor = reader->cursor;
+  const uint8_t* end = reader->data + reader->size;
+  va_t address = reader->previous_address;
+  count -= skipped;
+  uint64_t decoded = 0;
+  for (; decoded < count; decoded++) {
+    bool context_change;
+    uint64_t delta;
+    uint64_t word;
+    uint64_t stops = 0;
+    if (end - cursor >= (ptrdiff_t)sizeof(word)) {
+      // The bytes without a continue bit end the records: no loop over the
+      // bytes of a record that fits in a word.
+      memcpy(&word, cursor, sizeof(word));
+      stops = ~word & 0x8080808080808080llu;
+    }
+    if (stops) {
+      unsigned length = __builtin_ctzll(stops) / 8 + 1;
+      uint64_t bits = (word >> 2 & 0x1f) | (word >> 8 & 0x7f) << 5 |
+                      (word >> 16 & 0x7f) << 12 | (word >> 24 & 0x7f) << 19 |
+                      (word >> 32 & 0x7f) << 26 | (word >> 40 & 0x7f) << 33 |
+                      (word >> 48 & 0x7f) << 40 | (word >> 56 & 0x7f) << 47;
+      delta = bits & ((1llu << (5 + 7 * (length - 1))) - 1);
+      context_change = word & 2;
+      cursor += length;
+    } else {
+      if (cursor == end) {
+        panic("Truncated or invalid binary instructions file %s",
+              reader->path);
+      }
+      uint8_t byte = *cursor++;
+      context_change = byte & 2;
+      delta = (byte >> 2) & 0x1f;
+      for (unsigned shift = 5; byte & 0x80; shift += 7) {
+        if (cursor == end || shift >= 64) {
+          panic("Truncated or invalid binary instructions file %s",
+                reader->path);
+        }
+        byte = *cursor++;
+        delta |= (uint64_t)(byte & 0x7f) << shift;
+      }
+    }
+    address += zigzag_decode(delta);
+
+    if (context_change) {
+      uint64_t core;
+      uint64_t asid;
+      if (!decode_varint(&cursor, end, &core) ||
+          !decode_varint(&cursor, end, &asid) || core >= MAX_CORES ||
+          asid >= MAX_ASIDS) {
+        panic("Truncated or invalid binary instructions file %s",
+              reader->path);
+      }
+      reader->previous_core = core;
+      reader->previous_asid = asid;
+    }
+  }
+  reader->cursor = cursor;
+  reader->previous_address = address;
+  reader->remaining -= decoded;
+  return skipped + decoded;
+}
+
+void trace_close(trace_reader_t* reader) {
+  if (reader->file) {
+    fclose(reader->file);
+  }
+  if (reader->data) {
+    munmap((void*)reader->data, reader->size);
+  }
+  memset(reader, 0, sizeof(*reader));
+}
+
+uint64_t trace_convert(const char* input_path, const char* output_path) {
+  trace_reader_t reader;
+  trace_open(input_path, &reader);
+
+  FILE* output = fopen(output_path, "wb");
+  if (!output) {
+    panic("Failed to create instructions file %s", output_path);
+  }
+
+  // The record count is patched in once known.
+  uint64_t count = 0;
+  fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_SIZE, output);
+  fwrite(&count, sizeof(count), 1, output);
+
+  trace_record_t record;
+  trace_record_t previous = {OP_READ, 0, 0, 0};
+  uint8_t buffer[TRACE_MAX_RECORD_SIZE];
+  uint64_t offset = TRACE_HEADER_SIZE;
+  trace_index_entry_t* index = NULL;
+  uint64_t entries = 0;
+  while (trace_next(&reader, &record)) {
+    if (count && count % TRACE_INDEX_INTERVAL == 0) {
+      if ((entries & (entries - 1)) == 0) {
+        index = realloc(index, (entries ? 2 * entries : 1) * sizeof(*index));
+        if (!index) {
+          panic("Failed to allocate the seek index of %s", output_path);
+        }
+      }
+      index[entries++] = (trace_index_entry_t){
+          offset, previous.address, previous.core, previous.asid};
+    }
+    size_t size = encode_record(&record, &previous, buffer);
+    fwrite(buffer, 1, size, output);
+    offset += size;
+    previous = record;
+    count++;
+  }
+
+  fwrite(index, sizeof(*index), entries, output);
+  fwrite(&entries, sizeof(entries), 1, output);
+  fwrite(TRACE_INDEX_MAGIC, 1, TRACE_MAGIC_SIZE, output);
+  free(index);
+
+  fseek(output, TRACE_MAGIC_SIZE, SEEK_SET);
+  fwrite(&count, sizeof(count), 1, output);
+  if (ferror(output) | fclose(output)) {
+    panic("Failed to write instructions file %s", output_path);
+  }
+
+  trace_close(&reader);
+  return count;
+}
+
+void trace_load(const char* path, trace_t* trace) {
+  trace_reader_t reader;
+  trace_open(path, &reader);
+
+  uint64_t capacity = reader.data ? reader.remaining : 1024;
+  trace->records = malloc((capacity ? capacity : 1) * sizeof(trace_record_t));
+  trace->count = 0;
+
+  trace_record_t record;
+  while (trace_next(&reader, &record)) {
+    if (trace->count == capacity) {
+      capacity *= 2;
+      trace->records =
+          realloc(trace->records, capacity * sizeof(trace_record_t));
+    }
+    if (!trace->records) {
+      panic("Failed to allocate instructions of %s", path);
+    }
+    trace->records[trace->count++] = record;
+  }
+
+  trace_close(&reader);
+}
+
+void trace_free(trace_t* trace) {
+  free(trace->records);
+  trace->records = NULL;
+  trace->count = 0;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "constants.h"
+#include "kernel.h"
+#include "memory.h"
+
+// Instructions files come in two formats:
+//
+// - Text: one "[<core>] R|W <hex address>" per line. The core defaults to 0.
+//   Context switch lines, "[<core>] C <asid>", make the following references
+//   of the core belong to another address space (ASID 0 until the first one).
+// - Binary: TRACE_MAGIC, the number of records (uint64_t, little-endian), then
+//   one variable-length record per reference. Each record encodes the delta to
+//   the previous address (zigzag-encoded, so small backward steps stay small)
+//   as a LEB128 varint, with the operation and a context change flag packed in
+//   the lowest bits of the first byte:
+//
+//     byte 0:  [continue:1][delta bits 0-4:5][context change:1][op:1]
+//     byte n:  [continue:1][next 7 delta bits:7]
+//
+//   When the core or the ASID changes, the new core and ASID follow as LEB128
+//   varints. Sequential accesses take 1 byte per reference instead of ~10.
+//
+//   A seek index may follow the records: the byte offset of every
+//   TRACE_INDEX_INTERVAL-th record and the address, core and ASID before it
+//   (uint64_t, uint64_t, uint32_t, uint32_t), then the number of entries
+//   (uint64_t) and TRACE_INDEX_MAGIC. It lets trace_skip() jump over records
+//   without decoding them.
+//
+// Binary files are memory-mapped and decoded in place.
+//
+// A path starting with KERNEL_PREFIX is not a file but a built-in benchmark
+// kernel, generated on the fly (see kernel.h).
+#define TRACE_MAGIC "TLBTRC01"
+#define TRACE_MAGIC_SIZE 8
+#define TRACE_INDEX_MAGIC "TLBIDX01"
+#define TRACE_INDEX_INTERVAL 4096
+
+// One memory reference of an instructions file.
+typedef struct {
+  op_t op;
+  va_t address;
+  unsigned core;
+  unsigned asid;
+} trace_record_t;
+
+// A whole instructions file, decoded in memory.
+typedef struct {
+  trace_record_t* records;
+  uint64_t count;
+} trace_t;
+
+// Sequential reader over an instructions file of either format.
+typedef struct {
+  const char* path;
+
+  // Text format.
+  FILE* file;
+
+  // Binary format.
+  const uint8_t* data;
+  size_t size;
+  const uint8_t* cursor;
+  uint64_t count;
+  uint64_t remaining;
+  va_t previous_address;
+  unsigned previous_core;
+  unsigned previous_asid;
+  const uint8_t* index;
+  uint64_t index_entries;
+
+  // ASID of every core, for the text format.
+  unsigned asids[MAX_CORES];
+
+  // Built-in kernel.
+  bool is_kernel;
+  kernel_t kernel;
+} trace_reader_t;
+
+// Parses one "[<core>] R|W <hex address>" or "[<core>] C <asid>" line. A
+// context switch only sets the core and ASID of `record`, and `is_switch`.
+// Returns false if the line is invalid.
+bool trace_parse_line(const char* line, trace_record_t* record,
+                      bool* is_switch);
+
+// Opens an instructions file, detecting its format, or a built-in kernel.
+// Panics on error.
+void trace_open(const char* path, trace_reader_t* reader);
+
+// Reads the next record. Returns false at the end of the file, panics if the
+// file is malformed.
+bool trace_next(trace_reader_t* reader, trace_record_t* record);
+
+// Skips the next `count` records, faster than reading them: a built-in kernel
+// does not generate most of them, and a binary file jumps through its seek
+// index, and only sums the address deltas of the others. Returns the number skipped, fewer at the end of the file.
+uint64_t trace_skip(trace_reader_t* reader, uint64_t count);
+void trace_close(trace_reader_t* reader);
+
+// Converts an instructions file (of either format) to the binary format.
+// Returns the number of records written. Panics on error.
+uint64_t trace_convert(const char* input_path, const char* output_path);
+
+// Decodes a whole instructions file. Panics on error.
+void trace_load(const char* path, trace_t* trace);
+void trace_free(trace_t* trace);
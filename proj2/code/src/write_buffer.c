@@ -0,0 +1,238 @@
+#include "write_buffer.h"
+
+#include <stdlib.h>
+
+#include "constants.h"
+#include "log.h"
+#include "swap.h"
+
+typedef struct {
+  va_t page;
+  pa_disk_t disk_address;
+  time_ns_t queued_ns;
+
+  // Set once the disk took the page, with the end of its write.
+  bool issued;
+  time_ns_t done_ns;
+
+  // Faulted back in before its write was issued: nothing to write.
+  bool cancelled;
+} write_buffer_entry_t;
+
+write_buffer_config_t write_buffer_config;
+write_buffer_entry_t* write_buffer_entries = NULL;
+
+// Addresses of the pages of a write.
+pa_disk_t* write_buffer_request = NULL;
+
+// Ring of write_buffer_count entries from write_buffer_head, in eviction
+// order. The first write_buffer_issued ones are written, or being written;
+// the others are queued.
+uint64_t write_buffer_head = 0;
+uint64_t write_buffer_count = 0;
+uint64_t write_buffer_issued = 0;
+
+// The flusher writes one batch at a time, and is busy until then.
+time_ns_t write_buffer_disk_free_ns = 0;
+
+uint64_t buffered_writes = 0;
+uint64_t write_buffer_flushes = 0;
+uint64_t cancelled_writes = 0;
+uint64_t write_buffer_hits = 0;
+time_ns_t write_buffer_stall_ns = 0;
+
+void write_buffer_init(const write_buffer_config_t* config) {
+  write_buffer_config = *config;
+
+  free(write_buffer_entries);
+  free(write_buffer_request);
+  write_buffer_entries = NULL;
+  write_buffer_request = NULL;
+  write_buffer_head = 0;
+  write_buffer_count = 0;
+  write_buffer_issued = 0;
+  write_buffer_disk_free_ns = 0;
+
+  buffered_writes = 0;
+  write_buffer_flushes = 0;
+  cancelled_writes = 0;
+  write_buffer_hits = 0;
+  write_buffer_stall_ns = 0;
+
+  if (config->entries == 0) {
+    return;
+  }
+  if (config->batch == 0) {
+    panic("Invalid write buffer batch: 0 pages");
+  }
+
+  write_buffer_entries =
+      calloc(config->entries, sizeof(write_buffer_entry_t));
+  write_buffer_request = malloc(config->entries * sizeof(pa_disk_t));
+  if (!write_buffer_entries || !write_buffer_request) {
+    panic("Failed to allocate write buffer");
+  }
+}
+
+bool write_buffer_enabled() { return write_buffer_entries != NULL; }
+
+void write_buffer_checkpoint(checkpoint_t* checkpoint) {
+  if (write_buffer_enabled()) {
+    checkpoint_data(checkpoint, write_buffer_entries,
+                    write_buffer_config.entries * sizeof(write_buffer_entry_t));
+  }
+  CHECKPOINT_VALUE(checkpoint, write_buffer_head);
+  CHECKPOINT_VALUE(checkpoint, write_buffer_count);
+  CHECKPOINT_VALUE(checkpoint, write_buffer_issued);
+  CHECKPOINT_VALUE(checkpoint, write_buffer_disk_free_ns);
+
+  CHECKPOINT_VALUE(checkpoint, buffered_writes);
+  CHECKPOINT_VALUE(checkpoint, write_buffer_flushes);
+  CHECKPOINT_VALUE(checkpoint, cancelled_writes);
+  CHECKPOINT_VALUE(checkpoint, write_buffer_hits);
+  CHECKPOINT_VALUE(checkpoint, write_buffer_stall_ns);
+}
+
+static inline write_buffer_entry_t* get_write_buffer_entry(uint64_t i) {
+  return &write_buffer_entries[(write_buffer_head + i) %
+                               write_buffer_config.entries];
+}
+
+// Plays the flusher forward to `now`: frees the slots of completed writes,
+// and whenever it is idle, issues the queued pages as one write.
+void write_buffer_advance(time_ns_t now) {
+  for (;;) {
+    while (write_buffer_count > 0 && get_write_buffer_entry(0)->issued &&
+           get_write_buffer_entry(0)->done_ns <= now) {
+      write_buffer_head = (write_buffer_head + 1) % write_buffer_config.entries;
+      write_buffer_count--;
+      write_buffer_issued--;
+    }
+
+    if (write_buffer_issued == write_buffer_count) {
+      return;
+    }
+
+    // A cancelled page at the front of the queue is dropped
+    write_buffer_entry_t* first = get_write_buffer_entry(write_buffer_issued);
+    if (first->cancelled) {
+      first->issued = true;
+      first->done_ns = 0;
+      write_buffer_issued++;
+      continue;
+    }
+
+    time_ns_t start = first->queued_ns;
+    if (start < write_buffer_disk_free_ns) {
+      start = write_buffer_disk_free_ns;
+    }
+    if (start > now) {
+      return;
+    }
+
+    // Everything queued by then goes in the same write
+    uint64_t batch_start = write_buffer_issued;
+    uint64_t pages = 0;
+    while (write_buffer_issued < write_buffer_count &&
+           pages < write_buffer_config.batch) {
+      write_buffer_entry_t* entry = get_write_buffer_entry(write_buffer_issued);
+      if (entry->queued_ns > start) {
+        break;
+      }
+      if (!entry->cancelled) {
+        log_disk_access(entry->disk_address, OP_WRITE);
+        write_buffer_request[pages++] = entry->disk_address;
+      }
+      entry->issued = true;
+      write_buffer_issued++;
+    }
+
+    time_ns_t done = start + swap_disk_request(write_buffer_request, pages);
+    for (uint64_t i = batch_start; i < write_buffer_issued; i++) {
+      get_write_buffer_entry(i)->done_ns = done;
+    }
+    write_buffer_disk_free_ns = done;
+    write_buffer_flushes++;
+    log_dbg("***** Flushing %" PRIu64 " buffered pages to disk *****", pages);
+  }
+}
+
+// Stalls the current core until `time`, on behalf of the buffer.
+static void write_buffer_stall(time_ns_t now, time_ns_t time) {
+  if (time > now) {
+    write_buffer_stall_ns += time - now;
+    wait_until(TIME_DISK, time);
+  }
+}
+
+void write_buffer_add(va_t page, pa_disk_t disk_address) {
+  time_ns_t now = get_time_in_miss();
+  write_buffer_advance(now);
+
+  // Every slot holds a page to write: wait for the oldest one
+  while (write_buffer_count == write_buffer_config.entries) {
+    write_buffer_entry_t* oldest = get_write_buffer_entry(0);
+    time_ns_t next = oldest->issued ? oldest->done_ns : write_buffer_disk_free_ns;
+    if (next < oldest->queued_ns) {
+      next = oldest->queued_ns;
+    }
+    write_buffer_stall(now, next);
+    if (next > now) {
+      now = next;
+    }
+    write_buffer_advance(now);
+  }
+
+  write_buffer_entry_t* entry = get_write_buffer_entry(write_buffer_count);
+  entry->page = page;
+  entry->disk_address = disk_address;
+  entry->queued_ns = now;
+  entry->issued = false;
+  entry->done_ns = 0;
+  entry->cancelled = false;
+  write_buffer_count++;
+  buffered_writes++;
+
+  write_buffer_advance(now);
+}
+
+bool write_buffer_take(va_t page) {
+  if (!write_buffer_enabled()) {
+    return false;
+  }
+  write_buffer_advance(get_time_in_miss());
+
+  for (uint64_t i = 0; i < write_buffer_count; i++) {
+    write_buffer_entry_t* entry = get_write_buffer_entry(i);
+    if (entry->page != page || entry->cancelled ||
+        (entry->issued && entry->done_ns <= get_time_in_miss())) {
+      continue;
+    }
+
+    if (!entry->issued) {
+      entry->cancelled = true;
+      cancelled_writes++;
+    }
+    write_buffer_hits++;
+    return true;
+  }
+  return false;
+}
+
+uint64_t get_total_buffered_writes() { return buffered_writes; }
+uint64_t get_total_write_buffer_flushes() { return write_buffer_flushes; }
+uint64_t get_total_cancelled_writes() { return cancelled_writes; }
+uint64_t get_total_write_buffer_hits() { return write_buffer_hits; }
+time_ns_t get_total_write_buffer_stall_time() { return write_buffer_stall_ns; }
+
+uint64_t get_write_buffer_pending() {
+  uint64_t pending = 0;
+  for (uint64_t i = 0; i < write_buffer_count; i++) {
+    write_buffer_entry_t* entry = get_write_buffer_entry(i);
+    if (!entry->cancelled &&
+        (!entry->issued || entry->done_ns > get_elapsed_time())) {
+      pending++;
+    }
+  }
+  return pending;
+}
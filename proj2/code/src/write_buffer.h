@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "checkpoint.h"
+#include "clock.h"
+#include "memory.h"
+
+// Write-back buffer of dirty pages evicted to swap. Instead of writing the
+// page to disk before the fault goes on, the eviction queues it and a
+// flusher writes it in the background, one disk write at a time. While a
+// write is in progress, queued pages pile up and are coalesced into one
+// write of up to `batch` pages once it is over. A fault only stalls when all
+// `entries` slots hold pages not yet written; disk reads do not wait for the
+// flusher. A page faulted back in while still buffered is copied from the
+// buffer, and its pending write is cancelled.
+// entries == 0 disables it: dirty evictions write synchronously.
+typedef struct {
+  uint64_t entries;
+  uint64_t batch;
+} write_buffer_config_t;
+
+#define WRITE_BUFFER_DEFAULT_CONFIG ((write_buffer_config_t){0, 8})
+
+// (Re)initializes an empty buffer and an idle disk. Panics on an invalid
+// configuration.
+void write_buffer_init(const write_buffer_config_t* config);
+bool write_buffer_enabled();
+void write_buffer_checkpoint(checkpoint_t* checkpoint);
+
+// Queues the write of evicted page `page` (a page key) to disk_address.
+void write_buffer_add(va_t page, pa_disk_t disk_address);
+
+// Takes a page back from the buffer, cancelling its write if it was not
+// issued yet. Returns false if the page is not buffered.
+bool write_buffer_take(va_t page);
+
+uint64_t get_total_buffered_writes();
+uint64_t get_total_write_buffer_flushes();
+uint64_t get_total_cancelled_writes();
+uint64_t get_total_write_buffer_hits();
+uint64_t get_write_buffer_pending();
+time_ns_t get_total_write_buffer_stall_time();
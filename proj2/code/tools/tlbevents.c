@@ -0,0 +1,258 @@
+// Offline tools for the event files recorded by tlbsim --events.
+//
+//   tlbevents decode [--all] FILE
+//     Prints the DRAM and disk accesses as tlbsim prints them on stdout. With
+//     --all, also prints the instructions, TLB lookups, page faults and
+//     evictions.
+//
+//   tlbevents summary [--phase N] FILE
+//     Prints the TLB hit rates, faults and accesses of every phase of N
+//     instructions (default 10000), and a histogram of the latency of the
+//     instructions (time between the start of consecutive instructions of
+//     the same core). With several cores, phases end at the latest core.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "event.h"
+#include "log.h"
+
+#define USAGE                                  \
+  "Usage: %s decode [--all] <events_file>\n"   \
+  "       %s summary [--phase N] <events_file>"
+
+#define LATENCY_BUCKETS 64
+
+static inline char op_char(op_t op) { return op == OP_READ ? 'R' : 'W'; }
+
+void decode(const char* path, bool all) {
+  event_reader_t reader;
+  event_reader_open(path, &reader);
+
+  event_t event;
+  while (event_next(&reader, &event)) {
+    switch (event.kind) {
+      case EVENT_DRAM:
+        log("[%" PRIu64 "] %c DRAM[%" PRIx64 "]", event.time, op_char(event.op),
+            event.value);
+        continue;
+      case EVENT_DISK:
+        log("[%" PRIu64 "] %c Disk[%" PRIx64 "]", event.time, op_char(event.op),
+            event.value);
+        continue;
+      default:
+        break;
+    }
+
+    if (!all) {
+      continue;
+    }
+
+    switch (event.kind) {
+      case EVENT_INSTRUCTION:
+        log("* %c %" PRIx64, op_char(event.op), event.value);
+        break;
+      case EVENT_TLB_HIT:
+        log("[%" PRIu64 "] TLB L%u hit VPN=%" PRIx64 " PFN=%" PRIx64,
+            event.time, event.level, event.value, event.frame);
+        break;
+      case EVENT_TLB_MISS:
+        log("[%" PRIu64 "] TLB L%u miss VPN=%" PRIx64, event.time, event.level,
+            event.value);
+        break;
+      case EVENT_PAGE_FAULT:
+        log("[%" PRIu64 "] Page fault VPN=%" PRIx64 " PFN=%" PRIx64,
+            event.time, event.value, event.frame);
+        break;
+      case EVENT_EVICTION:
+        log("[%" PRIu64 "] Evicted %s page VPN=%" PRIx64 " PFN=%" PRIx64,
+            event.time, event.op == OP_WRITE ? "dirty" : "clean", event.value,
+            event.frame);
+        break;
+      case EVENT_CONTEXT_SWITCH:
+        log("[%" PRIu64 "] Core %u switches to ASID %" PRIu64, event.time,
+            event.core, event.value);
+        break;
+      default:
+        break;
+    }
+  }
+
+  event_reader_close(&reader);
+}
+
+typedef struct {
+  uint64_t instructions;
+  time_ns_t start;
+  time_ns_t end;
+  uint64_t tlb_hits[3];
+  uint64_t tlb_misses[3];
+  uint64_t page_faults;
+  uint64_t evictions;
+  uint64_t dram_accesses;
+  uint64_t disk_accesses;
+} phase_t;
+
+float hit_rate(uint64_t hits, uint64_t misses) {
+  return (hits + misses) > 0 ? 100.0 * hits / (hits + misses) : 0.0;
+}
+
+void log_phase(const char* name, const phase_t* phase) {
+  log("%-8s %12" PRIu64 " %14" PRIu64 " %7.2f%% %7.2f%% %10" PRIu64
+      " %10" PRIu64 " %12" PRIu64 " %10" PRIu64,
+      name, phase->instructions, phase->end - phase->start,
+      hit_rate(phase->tlb_hits[1], phase->tlb_misses[1]),
+      hit_rate(phase->tlb_hits[2], phase->tlb_misses[2]), phase->page_faults,
+      phase->evictions, phase->dram_accesses, phase->disk_accesses);
+}
+
+void add_phase(phase_t* total, const phase_t* phase) {
+  total->instructions += phase->instructions;
+  total->end = phase->end;
+  for (int level = 1; level <= 2; level++) {
+    total->tlb_hits[level] += phase->tlb_hits[level];
+    total->tlb_misses[level] += phase->tlb_misses[level];
+  }
+  total->page_faults += phase->page_faults;
+  total->evictions += phase->evictions;
+  total->dram_accesses += phase->dram_accesses;
+  total->disk_accesses += phase->disk_accesses;
+}
+
+// Bucket b holds latencies in [2^(b-1), 2^b), bucket 0 latencies of 0 ns.
+static inline unsigned latency_bucket(time_ns_t latency) {
+  return latency ? 64 - __builtin_clzll(latency) : 0;
+}
+
+void summary(const char* path, uint64_t phase_length) {
+  event_reader_t reader;
+  event_reader_open(path, &reader);
+
+  log("%-8s %12s %14s %8s %8s %10s %10s %12s %10s", "Phase", "Instructions",
+      "Elapsed (ns)", "L1 hit", "L2 hit", "Faults", "Evictions", "DRAM",
+      "Disk");
+
+  phase_t total = {0};
+  phase_t phase = {0};
+  uint64_t n_phases = 0;
+
+  uint64_t latencies[LATENCY_BUCKETS + 1] = {0};
+  bool started[MAX_CORES] = {false};
+  time_ns_t instruction_start[MAX_CORES] = {0};
+  time_ns_t core_end[MAX_CORES] = {0};
+
+  event_t event;
+  while (event_next(&reader, &event)) {
+    if (event.time > phase.end) {
+      phase.end = event.time;
+    }
+
+    if (event.kind == EVENT_INSTRUCTION) {
+      unsigned core = event.core;
+      if (started[core]) {
+        latencies[latency_bucket(event.time - instruction_start[core])]++;
+      }
+      started[core] = true;
+      instruction_start[core] = event.time;
+
+      if (phase.instructions == phase_length) {
+        char name[32];
+        snprintf(name, sizeof(name), "%" PRIu64, n_phases++);
+        log_phase(name, &phase);
+        add_phase(&total, &phase);
+        time_ns_t end = phase.end;
+        memset(&phase, 0, sizeof(phase));
+        phase.start = end;
+        phase.end = end;
+      }
+      phase.instructions++;
+    }
+    core_end[event.core] = event.time;
+
+    switch (event.kind) {
+      case EVENT_TLB_HIT:
+        phase.tlb_hits[event.level > 2 ? 2 : event.level]++;
+        break;
+      case EVENT_TLB_MISS:
+        phase.tlb_misses[event.level > 2 ? 2 : event.level]++;
+        break;
+      case EVENT_PAGE_FAULT:
+        phase.page_faults++;
+        break;
+      case EVENT_EVICTION:
+        phase.evictions++;
+        break;
+      case EVENT_DRAM:
+        phase.dram_accesses++;
+        break;
+      case EVENT_DISK:
+        phase.disk_accesses++;
+        break;
+      default:
+        break;
+    }
+  }
+
+  for (unsigned core = 0; core < MAX_CORES; core++) {
+    if (started[core]) {
+      latencies[latency_bucket(core_end[core] - instruction_start[core])]++;
+    }
+  }
+  if (phase.instructions) {
+    char name[32];
+    snprintf(name, sizeof(name), "%" PRIu64, n_phases++);
+    log_phase(name, &phase);
+    add_phase(&total, &phase);
+  }
+  log_phase("Total", &total);
+
+  log("");
+  log("Instruction latency (ns):");
+  for (unsigned bucket = 0; bucket <= LATENCY_BUCKETS; bucket++) {
+    if (!latencies[bucket]) {
+      continue;
+    }
+    uint64_t low = bucket ? 1llu << (bucket - 1) : 0;
+    uint64_t high = bucket ? (1llu << (bucket - 1)) * 2 - 1 : 0;
+    log("  %12" PRIu64 " - %12" PRIu64 ": %12" PRIu64 " (%6.2f%%)", low, high,
+        latencies[bucket], 100.0 * latencies[bucket] / total.instructions);
+  }
+
+  event_reader_close(&reader);
+}
+
+int main(int argc, char* argv[]) {
+  log_init();
+
+  if (argc < 3) {
+    panic(USAGE, argv[0], argv[0]);
+  }
+
+  const char* command = argv[1];
+  bool all = false;
+  uint64_t phase_length = 10000;
+
+  int arg = 2;
+  for (; arg < argc - 1; arg++) {
+    if (strcmp(command, "decode") == 0 && strcmp(argv[arg], "--all") == 0) {
+      all = true;
+    } else if (strcmp(command, "summary") == 0 &&
+               strcmp(argv[arg], "--phase") == 0 && arg + 1 < argc - 1) {
+      phase_length = strtoull(argv[++arg], NULL, 0);
+    } else {
+      panic(USAGE, argv[0], argv[0]);
+    }
+  }
+  if (arg != argc - 1 || phase_length == 0) {
+    panic(USAGE, argv[0], argv[0]);
+  }
+
+  if (strcmp(command, "decode") == 0) {
+    decode(argv[arg], all);
+  } else if (strcmp(command, "summary") == 0) {
+    summary(argv[arg], phase_length);
+  } else {
+    panic(USAGE, argv[0], argv[0]);
+  }
+  return 0;
+}